@@ -7,6 +7,292 @@
 
 //#define SHOW_WRITE_TIME
 
+static unsigned int elapsed(const struct timespec &start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/*
+ * Reads the source ahead of eFilePushThread into a small ring of buffers, on a
+ * thread of its own. The push thread then only waits for the decoder, the read
+ * latency of a network mount overlaps with the writes to the fifo.
+ * The reader follows the scatter-gather spans just like the push thread did, the
+ * ring is dropped when the push thread pauses, so a seek reads from the new
+ * position. The read size grows when the push thread finds the ring empty and
+ * shrinks while the ring stays full.
+ */
+class eFilePushReadAhead: public eThread
+{
+public:
+	enum { slotCount = 4 };
+	eFilePushReadAhead(int blocksize, size_t buffersize, int prio_class, int prio);
+	~eFilePushReadAhead();
+
+	/* starts reading at position, with the state of the current source span */
+	void start(ePtr<iTsSource> &source, iFilePushScatterGather *sg, off_t position, size_t bytes_read, size_t span_remaining);
+	/* stops the reader and drops the ring */
+	void stop();
+	bool running() const { return m_running; }
+	/* wakes up get(), which returns -1 then */
+	void interrupt();
+
+	/* waits for the next buffer.. returns its length, 0 at the end of the file or on a
+	   read error, -1 when interrupted. a read after the end is started by the next get() */
+	int get(unsigned char *&data, off_t &position);
+	/* the buffer from get() is written */
+	void release();
+private:
+	struct slot
+	{
+		unsigned char *data;
+		int len;
+		off_t position;
+	};
+	int m_blocksize;
+	size_t m_buffersize, m_readsize, m_minreadsize;
+	int m_prio_class, m_prio;
+	ePtr<iTsSource> m_source;
+	iFilePushScatterGather *m_sg;
+	off_t m_position;
+	size_t m_bytes_read, m_span_remaining;
+	unsigned char *m_memory;
+	slot m_slots[slotCount];
+	int m_head, m_count;     // oldest filled slot, filled slots including the one held by get()
+	bool m_held, m_wait_retry, m_interrupted, m_running;
+	int m_stop;
+	eSingleLock m_lock;
+	eCondition m_filled, m_freed;
+
+	/* statistics of one run */
+	unsigned int m_fill_histogram[slotCount + 1];
+	unsigned int m_reads, m_underruns;
+	unsigned long long m_bytes, m_read_time;
+
+	void thread();
+};
+
+eFilePushReadAhead::eFilePushReadAhead(int blocksize, size_t buffersize, int prio_class, int prio)
+	:m_blocksize(blocksize),
+	m_buffersize(buffersize - buffersize % blocksize),
+	m_prio_class(prio_class),
+	m_prio(prio),
+	m_sg(NULL),
+	m_memory(NULL),
+	m_head(0),
+	m_count(0),
+	m_held(false),
+	m_wait_retry(false),
+	m_interrupted(false),
+	m_running(false),
+	m_stop(0)
+{
+	m_minreadsize = m_buffersize / 8;
+	m_minreadsize -= m_minreadsize % blocksize;
+	if (m_minreadsize < (size_t)blocksize)
+		m_minreadsize = blocksize;
+	m_readsize = m_minreadsize;
+}
+
+eFilePushReadAhead::~eFilePushReadAhead()
+{
+	stop();
+	free(m_memory);
+}
+
+void eFilePushReadAhead::start(ePtr<iTsSource> &source, iFilePushScatterGather *sg, off_t position, size_t bytes_read, size_t span_remaining)
+{
+	if (!m_memory)
+	{
+		m_memory = (unsigned char*)malloc(slotCount * m_buffersize);
+		if (!m_memory)
+			eFatal("Failed to allocate %zu bytes", slotCount * m_buffersize);
+		for (int i = 0; i < slotCount; ++i)
+			m_slots[i].data = m_memory + i * m_buffersize;
+	}
+	m_source = source;
+	m_sg = sg;
+	m_position = position;
+	m_bytes_read = bytes_read;
+	m_span_remaining = span_remaining;
+	m_head = m_count = 0;
+	m_held = m_wait_retry = m_interrupted = false;
+	m_stop = 0;
+	memset(m_fill_histogram, 0, sizeof(m_fill_histogram));
+	m_reads = m_underruns = 0;
+	m_bytes = m_read_time = 0;
+	m_running = true;
+	run();
+}
+
+void eFilePushReadAhead::stop()
+{
+	if (!m_running)
+		return;
+	{
+		eSingleLocker l(m_lock);
+		m_stop = 1;
+		m_freed.signal();
+	}
+	sendSignal(SIGUSR1);  /* a read from a network mount may take a while */
+	kill();
+	m_running = false;
+	m_source = NULL;
+
+	if (m_reads)
+	{
+		eDebug("[eFilePushReadAhead] %u reads, %llu kB at %llu kB/s, read size now %d kB, %u underruns, fill levels:",
+			m_reads, m_bytes >> 10, m_read_time ? m_bytes * 1000000 / m_read_time >> 10 : 0, (int)(m_readsize >> 10), m_underruns);
+		for (int i = 0; i <= slotCount; ++i)
+			if (m_fill_histogram[i])
+				eDebug("     %d: %6u", i, m_fill_histogram[i]);
+	}
+}
+
+void eFilePushReadAhead::interrupt()
+{
+	eSingleLocker l(m_lock);
+	m_interrupted = true;
+	m_filled.signal();
+}
+
+int eFilePushReadAhead::get(unsigned char *&data, off_t &position)
+{
+	eSingleLocker l(m_lock);
+	bool retry = m_wait_retry && !m_count;
+	if (retry)
+	{
+		/* the push thread reads again after the end of the file */
+		m_wait_retry = false;
+		m_freed.signal();
+	}
+	++m_fill_histogram[m_count];
+	if (!m_count && !retry)
+	{
+		++m_underruns;
+		/* larger requests, fewer round trips */
+		if (m_readsize < m_buffersize)
+		{
+			m_readsize *= 2;
+			if (m_readsize > m_buffersize)
+				m_readsize = m_buffersize;
+		}
+	}
+	while (!m_count && !m_interrupted)
+		m_filled.wait(m_lock);
+	if (m_interrupted)
+	{
+		m_interrupted = false;
+		return -1;
+	}
+	slot &s = m_slots[m_head];
+	data = s.data;
+	position = s.position;
+	int len = s.len;
+	if (len)
+		m_held = true;
+	else
+	{
+		/* nothing to write, the end of file marker is done */
+		m_head = (m_head + 1) % slotCount;
+		--m_count;
+	}
+	return len;
+}
+
+void eFilePushReadAhead::release()
+{
+	eSingleLocker l(m_lock);
+	if (!m_held)
+		return;
+	m_held = false;
+	m_head = (m_head + 1) % slotCount;
+	--m_count;
+	m_freed.signal();
+}
+
+void eFilePushReadAhead::thread()
+{
+	hasStarted();
+	setIoPrio(m_prio_class, m_prio);
+
+	while (1)
+	{
+		size_t readsize;
+		slot *s;
+		{
+			eSingleLocker l(m_lock);
+			if (!m_stop && m_count == slotCount && m_readsize > m_minreadsize)
+			{
+				/* the decoder takes less than we read, smaller reads are enough */
+				m_readsize -= m_readsize / 4;
+				m_readsize -= m_readsize % m_blocksize;
+				if (m_readsize < m_minreadsize)
+					m_readsize = m_minreadsize;
+			}
+			while (!m_stop && (m_count == slotCount || m_wait_retry))
+				m_freed.wait(m_lock);
+			if (m_stop)
+				break;
+			s = &m_slots[(m_head + m_count) % slotCount];
+			readsize = m_readsize;
+		}
+
+		if (m_sg && !m_span_remaining)
+		{
+			off_t span_offset;
+			m_sg->getNextSourceSpan(m_position, m_bytes_read, span_offset, m_span_remaining);
+			ASSERT(!(m_span_remaining % m_blocksize));
+			m_position = span_offset;
+			m_bytes_read = 0;
+		}
+			/* if we have a source span, don't read past the end */
+		if (m_sg && readsize > m_span_remaining)
+			readsize = m_span_remaining;
+
+		int len = 0;
+		if (readsize)
+		{
+			struct timespec start;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			len = m_source->read(m_position, s->data, readsize);
+			if (len < 0)
+			{
+				len = 0;
+				if (m_stop)
+					break;
+				if (errno == EINTR || errno == EBUSY || errno == EAGAIN)
+					continue;
+				if (errno == EOVERFLOW)
+				{
+					eWarning("OVERFLOW while playback?");
+					continue;
+				}
+				eDebug("[eFilePushReadAhead] *read error* (%m) - not yet handled");
+			}
+			/* a read might be mis-aligned in case of a short read. */
+			len -= len % m_blocksize;
+			++m_reads;
+			m_bytes += len;
+			m_read_time += elapsed(start);
+		}
+
+		s->len = len;
+		s->position = m_position;
+		m_position += len;
+		m_bytes_read += len;
+		if (m_sg)
+			m_span_remaining -= len;
+
+		eSingleLocker l(m_lock);
+		++m_count;
+		if (!len)
+			m_wait_retry = true;
+		m_filled.signal();
+	}
+}
+
 eFilePushThread::eFilePushThread(int io_prio_class, int io_prio_level, int blocksize, size_t buffersize)
 	:prio_class(io_prio_class),
 	prio(io_prio_level),
@@ -17,6 +303,11 @@ eFilePushThread::eFilePushThread(int io_prio_class, int io_prio_level, int block
 	m_blocksize(blocksize),
 	m_buffersize(buffersize),
 	m_buffer((unsigned char *)malloc(buffersize)),
+	m_splice(false),
+	m_remote(false),
+	m_readahead(NULL),
+	m_bytes_spliced(0),
+	m_bytes_copied(0),
 	m_messagepump(eApp, 0),
 	m_run_state(0)
 {
@@ -27,6 +318,7 @@ eFilePushThread::eFilePushThread(int io_prio_class, int io_prio_level, int block
 
 eFilePushThread::~eFilePushThread()
 {
+	delete m_readahead;
 	free(m_buffer);
 }
 
@@ -43,6 +335,42 @@ static void ignore_but_report_signals()
 	sigaction(SIGUSR1, &act, 0);
 }
 
+/* returns the number of bytes spliced from the source to m_fd_dest, or -1 with errno set */
+int eFilePushThread::spliceData(size_t maxread)
+{
+	/* only what the file has already.. a partial packet in the pipe can't be taken back */
+	off_t available = m_source->length() - m_current_position;
+	if (available <= 0)
+		return 0;
+	if ((off_t)maxread > available)
+		maxread = available - available % m_blocksize;
+
+	size_t done = 0;
+	while (done < maxread)
+	{
+		ssize_t r = m_source->splice(m_current_position + done, m_fd_dest, maxread - done);
+		if (r > 0)
+		{
+			done += r;
+			continue;
+		}
+		if (r < 0 && (errno == EINVAL || errno == ENOSYS) && !done)
+		{
+			eDebug("[eFilePushThread] splice not possible (%m), copying");
+			m_splice = false;
+			errno = EAGAIN;  /* read the same data again */
+			return -1;
+		}
+			/* the rest of a started packet must follow, unless we stop */
+		if (done % m_blocksize && !m_stop && (r == 0 || errno == EINTR || errno == EAGAIN))
+			continue;
+		if (!done)
+			return r;
+		break;
+	}
+	return done;
+}
+
 void eFilePushThread::thread()
 {
 	ignore_but_report_signals();
@@ -61,60 +389,85 @@ void eFilePushThread::thread()
 
 	while (!m_stop)
 	{
-		if (m_sg && !current_span_remaining)
+		unsigned char *data = m_buffer;
+		bool readahead = m_remote;
+		bool spliced = false;
+		if (readahead)
 		{
-			m_sg->getNextSourceSpan(m_current_position, bytes_read, current_span_offset, current_span_remaining);
-			ASSERT(!(current_span_remaining % m_blocksize));
-			m_current_position = current_span_offset;
-			bytes_read = 0;
+				/* the reader thread follows the spans from here on */
+			if (!m_readahead->running())
+				m_readahead->start(m_source, m_sg, m_current_position, bytes_read, current_span_remaining);
+			buf_end = m_readahead->get(data, m_current_position);
+			if (buf_end < 0)
+			{
+				buf_end = 0;
+				if (m_stop)
+					break;
+				continue;
+			}
 		}
-		size_t maxread = m_buffersize;
+		else
+		{
+			if (m_sg && !current_span_remaining)
+			{
+				m_sg->getNextSourceSpan(m_current_position, bytes_read, current_span_offset, current_span_remaining);
+				ASSERT(!(current_span_remaining % m_blocksize));
+				m_current_position = current_span_offset;
+				bytes_read = 0;
+			}
+			size_t maxread = m_buffersize;
 		
-			/* if we have a source span, don't read past the end */
-		if (m_sg && maxread > current_span_remaining)
-			maxread = current_span_remaining;
+				/* if we have a source span, don't read past the end */
+			if (m_sg && maxread > current_span_remaining)
+				maxread = current_span_remaining;
 
-			/* align to blocksize */
-		maxread -= maxread % m_blocksize;
+				/* align to blocksize */
+			maxread -= maxread % m_blocksize;
 
-		if (maxread)
-		{
+			spliced = m_splice && !wantRecordData();
+			if (maxread)
+			{
 #ifdef SHOW_WRITE_TIME
-			struct timeval starttime;
-			struct timeval now;
-			gettimeofday(&starttime, NULL);
+				struct timeval starttime;
+				struct timeval now;
+				gettimeofday(&starttime, NULL);
 #endif
-			buf_end = m_source->read(m_current_position, m_buffer, maxread);
+				if (spliced)
+					buf_end = spliceData(maxread);
+				else
+					buf_end = m_source->read(m_current_position, m_buffer, maxread);
 #ifdef SHOW_WRITE_TIME
-			gettimeofday(&now, NULL);
-			suseconds_t diff = (1000000 * (now.tv_sec - starttime.tv_sec)) + now.tv_usec - starttime.tv_usec;
-			eDebug("[eFilePushThread] read %d bytes time: %9u us", buf_end, (unsigned int)diff);
+				gettimeofday(&now, NULL);
+				suseconds_t diff = (1000000 * (now.tv_sec - starttime.tv_sec)) + now.tv_usec - starttime.tv_usec;
+				eDebug("[eFilePushThread] read %d bytes time: %9u us", buf_end, (unsigned int)diff);
 #endif
-		}
-		else
-			buf_end = 0;
-
-		if (buf_end < 0)
-		{
-			buf_end = 0;
-			/* Check m_stop after interrupted syscall. */
-			if (m_stop) {
-				break;
 			}
-			if (errno == EINTR || errno == EBUSY || errno == EAGAIN)
-				continue;
-			if (errno == EOVERFLOW)
+			else
+				buf_end = 0;
+
+			if (buf_end < 0)
 			{
-				eWarning("OVERFLOW while playback?");
-				continue;
+				buf_end = 0;
+				/* Check m_stop after interrupted syscall. */
+				if (m_stop) {
+					break;
+				}
+				if (errno == EINTR || errno == EBUSY || errno == EAGAIN)
+					continue;
+				if (errno == EOVERFLOW)
+				{
+					eWarning("OVERFLOW while playback?");
+					continue;
+				}
+				eDebug("eFilePushThread *read error* (%m) - not yet handled");
 			}
-			eDebug("eFilePushThread *read error* (%m) - not yet handled");
-		}
 
-			/* a read might be mis-aligned in case of a short read. */
-		int d = buf_end % m_blocksize;
-		if (d)
-			buf_end -= d;
+				/* a read might be mis-aligned in case of a short read.
+				   spliced data is in the pipe already, the position has to follow it */
+			int d = buf_end % m_blocksize;
+			if (d && !spliced)
+				buf_end -= d;
+		}
 
 		if (buf_end == 0)
 		{
@@ -161,14 +514,22 @@ void eFilePushThread::thread()
 				continue;
 			}
 			break;
+		} else if (spliced)
+		{
+			eofcount = 0;
+			m_current_position += buf_end;
+			bytes_read += buf_end;
+			m_bytes_spliced += buf_end;
+			if (m_sg)
+				current_span_remaining -= buf_end;
 		} else
 		{
 			/* Write data to mux */
 			int buf_start = 0;
-			filterRecordData(m_buffer, buf_end);
+			filterRecordData(data, buf_end);
 			while ((buf_start != buf_end) && !m_stop)
 			{
-				int w = write(m_fd_dest, m_buffer + buf_start, buf_end - buf_start);
+				int w = write(m_fd_dest, data + buf_start, buf_end - buf_start);
 
 				if (w <= 0)
 				{
@@ -188,13 +549,22 @@ void eFilePushThread::thread()
 				buf_start += w;
 			}
 
+			if (readahead)
+				m_readahead->release();
+
 			eofcount = 0;
 			m_current_position += buf_end;
-			bytes_read += buf_end;
-			if (m_sg)
-				current_span_remaining -= buf_end;
+			m_bytes_copied += buf_end;
+			if (!readahead)
+			{
+				bytes_read += buf_end;
+				if (m_sg)
+					current_span_remaining -= buf_end;
+			}
 		}
 	}
+	if (m_readahead->running())
+		m_readahead->stop();
 	sendEvent(evtStopped);
 
 	{ /* mutex lock scope */
@@ -210,7 +580,7 @@ void eFilePushThread::thread()
 	}
 	
 	} while (m_stop == 0);
-	eDebug("FILEPUSH THREAD STOP");
+	eDebug("FILEPUSH THREAD STOP (%lld kB spliced, %lld kB copied)", (long long)(m_bytes_spliced >> 10), (long long)(m_bytes_copied >> 10));
 }
 
 void eFilePushThread::start(ePtr<iTsSource> &source, int fd_dest)
@@ -218,6 +588,13 @@ void eFilePushThread::start(ePtr<iTsSource> &source, int fd_dest)
 	m_source = source;
 	m_fd_dest = fd_dest;
 	m_current_position = 0;
+	/* on network mounts the reads have to be ahead of the decoder,
+	   streams and sources that can't splice are copied */
+	m_remote = source->isRemote();
+	m_splice = !source->isStream() && !m_remote;
+	m_bytes_spliced = m_bytes_copied = 0;
+	if (!m_readahead)
+		m_readahead = new eFilePushReadAhead(m_blocksize, m_buffersize, prio_class, prio);
 	m_run_state = 1;
 	m_stop = 0;
 	run();
@@ -231,6 +608,7 @@ void eFilePushThread::stop()
 	m_stop = 1;
 	eDebug("eFilePushThread stopping thread");
 	m_run_cond.signal(); /* Break out of pause if needed */
+	m_readahead->interrupt();
 	sendSignal(SIGUSR1);
 	kill(0); /* Kill means join actually */
 }
@@ -246,6 +624,7 @@ void eFilePushThread::pause()
 	 * for the thread to acknowledge that */
 	eSingleLocker lock(m_run_mutex);
 	m_stop = 2;
+	m_readahead->interrupt();
 	sendSignal(SIGUSR1);
 	m_run_cond.signal(); /* Trigger if in weird state */
 	while (m_run_state) {
@@ -8,6 +8,8 @@
 #include <sys/types.h>
 #include <lib/base/rawfile.h>
 
+class eFilePushReadAhead;
+
 class iFilePushScatterGather
 {
 public:
@@ -39,6 +41,8 @@ public:
 	void sendEvent(int evt);
 protected:
 	virtual void filterRecordData(const unsigned char *data, int len);
+		/* true while filterRecordData has to see the data, it is spliced to the destination otherwise */
+	virtual bool wantRecordData() { return false; }
 private:
 	int prio_class;
 	int prio;
@@ -51,9 +55,15 @@ private:
 	size_t m_buffersize;
 	unsigned char* m_buffer;
 	off_t m_current_position;
+	bool m_splice;
+	bool m_remote;
+	eFilePushReadAhead *m_readahead;
+	off_t m_bytes_spliced, m_bytes_copied;
 
 	ePtr<iTsSource> m_source;
 
+	int spliceData(size_t maxread);
+
 	eFixedMessagePump<int> m_messagepump;
 	eSingleLock m_run_mutex;
 	eCondition m_run_cond;
@@ -0,0 +1,261 @@
+#include <lib/base/ioscheduler.h>
+#include <lib/base/ioprio.h>
+#include <lib/base/eerror.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+eSingleLock eIOScheduler::s_lock;
+std::map<dev_t, eIOScheduler*> eIOScheduler::s_schedulers;
+
+static unsigned int elapsed(const struct timespec &start, const struct timespec &now)
+{
+	return (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static bool before(const struct timespec &a, const struct timespec &b)
+{
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+// writes all of the vectors, returns 0 or -1 with errno set
+static int writeExtent(int fd, struct iovec *iov, int count, off_t offset)
+{
+	while (count)
+	{
+		ssize_t r = pwritev(fd, iov, count, offset);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (r == 0)
+		{
+			errno = EIO;
+			return -1;
+		}
+		offset += r;
+		while (count && (size_t)r >= iov->iov_len)
+		{
+			r -= iov->iov_len;
+			++iov;
+			--count;
+		}
+		if (count)
+		{
+			iov->iov_base = (char*)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+	return 0;
+}
+
+eIOScheduler::client::client(eIOScheduler *scheduler, int fd, unsigned int buffers)
+	:m_scheduler(scheduler), m_fd(fd), m_buffers(buffers ? buffers : 1), m_overflows(0), m_servedOverflows(0), m_pending(0)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+int eIOScheduler::client::submit(request *r, const unsigned char *data, size_t len, off_t offset, unsigned int overflows)
+{
+	eSingleLocker l(m_scheduler->m_lock);
+	m_overflows = overflows;
+	r->data = data;
+	r->len = len;
+	r->offset = offset;
+	r->error = 0;
+	r->busy = len != 0;
+	if (!r->busy)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &r->queued);
+	m_queue.push_back(r);
+	++m_pending;
+	if (m_queue.size() > m_stats.maxQueued)
+		m_stats.maxQueued = m_queue.size();
+	m_scheduler->m_work.signal();
+	return 0;
+}
+
+int eIOScheduler::client::poll(request *r)
+{
+	eSingleLocker l(m_scheduler->m_lock);
+	if (r->busy)
+		return 1;
+	if (r->error)
+	{
+		errno = r->error;
+		r->error = 0;
+		return -1;
+	}
+	return 0;
+}
+
+int eIOScheduler::client::wait(request *r)
+{
+	{
+		eSingleLocker l(m_scheduler->m_lock);
+		while (r->busy)
+			m_done.wait(m_scheduler->m_lock);
+	}
+	return poll(r);
+}
+
+void eIOScheduler::client::getStatistics(statistics &stats)
+{
+	eSingleLocker l(m_scheduler->m_lock);
+	stats = m_stats;
+}
+
+eIOScheduler::eIOScheduler(dev_t device)
+	:m_device(device), m_stop(false)
+{
+}
+
+eIOScheduler::~eIOScheduler()
+{
+}
+
+eIOScheduler::client *eIOScheduler::attach(int fd, unsigned int buffers)
+{
+	struct stat s;
+	if (fstat(fd, &s) < 0)
+	{
+		eDebug("[eIOScheduler] fstat failed: %m");
+		return 0;
+	}
+	eSingleLocker l(s_lock);
+	eIOScheduler *scheduler;
+	std::map<dev_t, eIOScheduler*>::iterator it = s_schedulers.find(s.st_dev);
+	if (it != s_schedulers.end())
+		scheduler = it->second;
+	else
+	{
+		scheduler = new eIOScheduler(s.st_dev);
+		s_schedulers[s.st_dev] = scheduler;
+		scheduler->run();
+		eDebug("[eIOScheduler] started for device %x", (unsigned int)s.st_dev);
+	}
+	client *c = new client(scheduler, fd, buffers);
+	eSingleLocker sl(scheduler->m_lock);
+	scheduler->m_clients.push_back(c);
+	return c;
+}
+
+void eIOScheduler::detach(client *c)
+{
+	eSingleLocker l(s_lock);
+	eIOScheduler *scheduler = c->m_scheduler;
+	bool last;
+	{
+		eSingleLocker sl(scheduler->m_lock);
+		while (c->m_pending)
+			c->m_done.wait(scheduler->m_lock);
+		scheduler->m_clients.remove(c);
+		last = scheduler->m_clients.empty();
+		if (last)
+		{
+			scheduler->m_stop = true;
+			scheduler->m_work.signal();
+		}
+	}
+	delete c;
+	if (last)
+	{
+		scheduler->kill();
+		s_schedulers.erase(scheduler->m_device);
+		eDebug("[eIOScheduler] stopped for device %x", (unsigned int)scheduler->m_device);
+		delete scheduler;
+	}
+}
+
+// m_lock must be held
+eIOScheduler::client *eIOScheduler::next()
+{
+	client *best = 0;
+	unsigned int bestFill = 0;
+	for (std::list<client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+	{
+		client *c = *it;
+		if (c->m_queue.empty())
+			continue;
+		// in 1/256 of the buffers, a recording which lost data comes first
+		unsigned int fill = c->m_queue.size() * 256 / c->m_buffers;
+		if (c->m_overflows != c->m_servedOverflows)
+			fill += 256;
+		if (!best || fill > bestFill ||
+			(fill == bestFill && before(c->m_queue.front()->queued, best->m_queue.front()->queued)))
+		{
+			best = c;
+			bestFill = fill;
+		}
+	}
+	return best;
+}
+
+void eIOScheduler::thread()
+{
+	setIoPrio(IOPRIO_CLASS_RT, 7);
+	hasStarted();
+
+	struct iovec iov[maxVectors];
+	request *batch[maxVectors];
+	m_lock.lock();
+	while (!m_stop)
+	{
+		client *c = next();
+		if (!c)
+		{
+			m_work.wait(m_lock);
+			continue;
+		}
+		// the buffers which follow each other in the file make up one write
+		int count = 0;
+		size_t bytes = 0;
+		off_t offset = c->m_queue.front()->offset;
+		while (!c->m_queue.empty() && count < maxVectors)
+		{
+			request *r = c->m_queue.front();
+			if (count && (r->offset != offset + (off_t)bytes || bytes + r->len > maxExtent))
+				break;
+			iov[count].iov_base = (void*)r->data;
+			iov[count].iov_len = r->len;
+			batch[count++] = r;
+			bytes += r->len;
+			c->m_queue.pop_front();
+		}
+		if (c->m_queue.empty())
+			c->m_servedOverflows = c->m_overflows;
+		int fd = c->m_fd;
+
+		m_lock.unlock();
+		int error = writeExtent(fd, iov, count, offset) < 0 ? errno : 0;
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		m_lock.lock();
+
+		if (error)
+		{
+			errno = error;
+			eDebug("[eIOScheduler] writing %d bytes failed: %m", (int)bytes);
+		}
+		++c->m_stats.writes;
+		c->m_stats.bytes += bytes;
+		for (int i = 0; i < count; ++i)
+		{
+			unsigned int latency = elapsed(batch[i]->queued, now);
+			c->m_stats.latency += latency;
+			if (latency > c->m_stats.maxLatency)
+				c->m_stats.maxLatency = latency;
+			batch[i]->error = error;
+			batch[i]->busy = false;
+		}
+		c->m_stats.requests += count;
+		c->m_pending -= count;
+		c->m_done.signal();
+	}
+	m_lock.unlock();
+}
@@ -0,0 +1,94 @@
+#ifndef __lib_base_ioscheduler_h
+#define __lib_base_ioscheduler_h
+
+#include <map>
+#include <list>
+#include <deque>
+#include <time.h>
+#include <sys/types.h>
+#include <lib/base/thread.h>
+#include <lib/base/elock.h>
+
+/*
+ * One writer thread per file system for all recordings on it. Several
+ * recorders writing their buffers independently make the disk seek between
+ * the files for every buffer, the scheduler instead takes the queued buffers
+ * of one recording that follow each other in the file and writes them with
+ * one pwritev, so every file grows by large sequential extents.
+ * The next recording served is the one with the fullest queue, relative to
+ * its number of buffers.. when its queue is full the recorder can't read the
+ * demux anymore. Recordings whose demux did overflow are served first until
+ * their queue was empty once.
+ * The recorders submit requests and poll or wait for them like for aio, the
+ * time from submitting to completion is kept per recording.
+ */
+class eIOScheduler: public eThread
+{
+public:
+	enum { maxExtent = 4 * 1024 * 1024, maxVectors = 64 };
+
+	struct request
+	{
+		const unsigned char *data;
+		size_t len;
+		off_t offset;
+		bool busy;
+		int error;                // errno of the failed write
+		struct timespec queued;
+		request(): data(0), len(0), offset(0), busy(false), error(0) {}
+	};
+
+	struct statistics
+	{
+		unsigned int requests;    // buffers written
+		unsigned int writes;      // pwritev calls, requests / writes is the coalescing
+		unsigned long long bytes;
+		unsigned long long latency; // us, sum over all requests
+		unsigned int maxLatency;  // us
+		unsigned int maxQueued;   // most requests queued at once
+	};
+
+	class client
+	{
+		friend class eIOScheduler;
+		eIOScheduler *m_scheduler;
+		int m_fd;
+		unsigned int m_buffers;
+		unsigned int m_overflows, m_servedOverflows;
+		unsigned int m_pending;   // submitted and not complete yet
+		std::deque<request*> m_queue;
+		eCondition m_done;
+		statistics m_stats;
+		client(eIOScheduler *scheduler, int fd, unsigned int buffers);
+	public:
+		/* queues data for writing at offset.. overflows is the overflow count of the
+		   demux, a new overflow raises the priority of this recording */
+		int submit(request *r, const unsigned char *data, size_t len, off_t offset, unsigned int overflows);
+		/* returns 1 if busy, 0 if ready, <0 on error return */
+		int poll(request *r);
+		int wait(request *r);
+		void getStatistics(statistics &stats);
+	};
+
+	/* returns the client for writes to fd, served by the scheduler of its file
+	   system, or 0 when the file system can't be determined */
+	static client *attach(int fd, unsigned int buffers);
+	/* waits for the pending requests of c, the scheduler stops with its last client */
+	static void detach(client *c);
+private:
+	dev_t m_device;
+	eSingleLock m_lock;
+	eCondition m_work;
+	std::list<client*> m_clients;
+	bool m_stop;
+
+	static eSingleLock s_lock;
+	static std::map<dev_t, eIOScheduler*> s_schedulers;
+
+	eIOScheduler(dev_t device);
+	~eIOScheduler();
+	void thread();
+	client *next();
+};
+
+#endif
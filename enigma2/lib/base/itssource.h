@@ -1,6 +1,8 @@
 #ifndef __lib_base_idatasource_h
 #define __lib_base_idatasource_h
 
+#include <errno.h>
+#include <sys/types.h>
 #include <lib/base/object.h>
 
 class iTsSource: public iObject
@@ -13,11 +15,16 @@ public:
 
 	/* NOTE: you must be able to handle short reads! */
 	virtual ssize_t read(off_t offset, void *buf, size_t count)=0; /* NOTE: this is what you in normal case have to use!! */
+	/* like read(), but moves the data from the file into the pipe fd without a copy through
+	   user space. fails with EINVAL when the source can't do that, use read() then. */
+	virtual ssize_t splice(off_t offset, int fd, size_t count) { errno = EINVAL; return -1; }
 
 	virtual off_t length()=0;
 	virtual int valid()=0;
 	virtual off_t offset() = 0;
 	virtual bool isStream() { return false; }
+	/* true for files on a network mount, where every read may take a while */
+	virtual bool isRemote() { return false; }
 	int getPacketSize() const { return packetSize; }
 };
 
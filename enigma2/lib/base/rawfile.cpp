@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/vfs.h>
 #include <lib/base/rawfile.h>
 #include <lib/base/eerror.h>
 
@@ -10,6 +11,7 @@ eRawFile::eRawFile(int packetsize)
 	: iTsSource(packetsize)
 	, m_lock()
 	, m_fd(-1)
+	, m_remote(false)
 	, m_splitsize(0)
 	, m_totallength(0)
 	, m_current_offset(0)
@@ -35,6 +37,7 @@ int eRawFile::open(const char *filename)
 	m_last_offset = 0;
 	m_fd = ::open(filename, O_RDONLY | O_LARGEFILE);
 	posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	checkRemote();
 	return m_fd;
 }
 
@@ -43,6 +46,25 @@ void eRawFile::setfd(int fd)
 	close();
 	m_nrfiles = 1;
 	m_fd = fd;
+	checkRemote();
+}
+
+void eRawFile::checkRemote()
+{
+	struct statfs s;
+	m_remote = false;
+	if (m_fd < 0 || fstatfs(m_fd, &s) < 0)
+		return;
+	switch ((unsigned int)s.f_type)
+	{
+	case 0x6969:     /* nfs */
+	case 0x517B:     /* smbfs */
+	case 0xFF534D42: /* cifs */
+	case 0xFE534D42: /* smb2 */
+	case 0x65735546: /* fuse, sshfs and friends */
+		m_remote = true;
+		break;
+	}
 }
 
 off_t eRawFile::lseek_internal(off_t offset)
@@ -101,6 +123,35 @@ ssize_t eRawFile::read(off_t offset, void *buf, size_t count)
 	return ret;
 }
 
+ssize_t eRawFile::splice(off_t offset, int fd, size_t count)
+{
+	eSingleLocker l(m_lock);
+
+	if (offset != m_current_offset)
+	{
+		m_current_offset = lseek_internal(offset);
+		if (m_current_offset < 0)
+			return m_current_offset;
+	}
+
+	switchOffset(m_current_offset);
+
+	if (m_nrfiles >= 2)
+	{
+		if (m_current_offset + count > m_totallength)
+			count = m_totallength - m_current_offset;
+	}
+
+	// from the file position, like read()
+	ssize_t ret = ::splice(m_fd, NULL, fd, NULL, count, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+	if (ret > 0)
+	{
+		m_current_offset = m_last_offset += ret;
+	}
+	return ret;
+}
+
 int eRawFile::valid()
 {
 	return m_fd != -1;
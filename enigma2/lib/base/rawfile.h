@@ -18,13 +18,16 @@ public:
 
 	// iTsSource
 	ssize_t read(off_t offset, void *buf, size_t count);
+	ssize_t splice(off_t offset, int fd, size_t count);
 	off_t length();
 	off_t offset();
 	int valid();
+	bool isRemote() { return m_remote; }
 protected:
 	eSingleLock m_lock;
 	int m_fd;
 private:
+	bool m_remote;
 	off_t m_splitsize, m_totallength, m_current_offset, m_base_offset, m_last_offset;
 	int m_nrfiles;
 	int m_current_file;
@@ -36,6 +39,7 @@ private:
 	int switchOffset(off_t off);
 	off_t lseek_internal(off_t offset);
 	int openFileUncached(int nr);
+	void checkRemote();
 };
 
 class eDecryptRawFile: public eRawFile
@@ -45,6 +49,7 @@ public:
 	~eDecryptRawFile();
 	void setDemux(ePtr<eDVBDemux> demux);
 	ssize_t read(off_t offset, void *buf, size_t count);
+	ssize_t splice(off_t offset, int fd, size_t count) { errno = EINVAL; return -1; } // the data is decrypted on the way
 private:
 	ePtr<eDVBDemux> demux;
 	cRingBufferLinear *ringBuffer;
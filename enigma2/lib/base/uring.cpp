@@ -0,0 +1,182 @@
+#include <lib/base/uring.h>
+#include <lib/base/eerror.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* the syscall numbers differ between the architectures and abis (mips, alpha..),
+   they are taken from the kernel headers only. Without them setup() fails with
+   ENOSYS and the recorder writes with aio */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, const void *arg, unsigned int count)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+#endif
+
+eIOUring::eIOUring()
+	:m_fd(-1), m_queued(0), m_sqRing(MAP_FAILED), m_cqRing(MAP_FAILED), m_sqRingSize(0), m_cqRingSize(0),
+	m_sqes((struct io_uring_sqe*)MAP_FAILED), m_sqesSize(0)
+{
+}
+
+eIOUring::~eIOUring()
+{
+	close();
+}
+
+int eIOUring::setup(unsigned int entries, const struct iovec *buffers, unsigned int count)
+{
+#ifdef HAVE_IO_URING
+	close();
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	m_fd = io_uring_setup(entries, &p);
+	if (m_fd < 0)
+		return -1;
+
+	m_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	m_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (m_cqRingSize > m_sqRingSize)
+			m_sqRingSize = m_cqRingSize;
+		m_cqRingSize = m_sqRingSize;
+	}
+	m_sqRing = mmap(0, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	if (m_sqRing == MAP_FAILED)
+		goto error;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		m_cqRing = m_sqRing;
+	else
+	{
+		m_cqRing = mmap(0, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if (m_cqRing == MAP_FAILED)
+			goto error;
+	}
+	m_sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	m_sqes = (struct io_uring_sqe*)mmap(0, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if (m_sqes == MAP_FAILED)
+		goto error;
+
+	m_sqHead = (unsigned int*)((char*)m_sqRing + p.sq_off.head);
+	m_sqTail = (unsigned int*)((char*)m_sqRing + p.sq_off.tail);
+	m_sqArray = (unsigned int*)((char*)m_sqRing + p.sq_off.array);
+	m_sqMask = *(unsigned int*)((char*)m_sqRing + p.sq_off.ring_mask);
+	m_sqEntries = p.sq_entries;
+	m_cqHead = (unsigned int*)((char*)m_cqRing + p.cq_off.head);
+	m_cqTail = (unsigned int*)((char*)m_cqRing + p.cq_off.tail);
+	m_cqMask = *(unsigned int*)((char*)m_cqRing + p.cq_off.ring_mask);
+	m_cqes = (struct io_uring_cqe*)((char*)m_cqRing + p.cq_off.cqes);
+
+	/* pins the buffers, fails when RLIMIT_MEMLOCK is too small */
+	if (io_uring_register(m_fd, IORING_REGISTER_BUFFERS, buffers, count) < 0)
+		goto error;
+	m_queued = 0;
+	return 0;
+error:
+	int err = errno;
+	eDebug("[eIOUring] setup failed: %m");
+	close();
+	errno = err;
+	return -1;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void eIOUring::close()
+{
+	if (m_sqes != MAP_FAILED)
+		munmap(m_sqes, m_sqesSize);
+	if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+		munmap(m_cqRing, m_cqRingSize);
+	if (m_sqRing != MAP_FAILED)
+		munmap(m_sqRing, m_sqRingSize);
+	m_sqes = (struct io_uring_sqe*)MAP_FAILED;
+	m_sqRing = m_cqRing = MAP_FAILED;
+	if (m_fd >= 0)
+		::close(m_fd);  // unregisters the buffers too
+	m_fd = -1;
+	m_queued = 0;
+}
+
+int eIOUring::queueWrite(int fd, unsigned int index, const void *data, size_t len, off_t offset, __u64 userData)
+{
+#ifdef HAVE_IO_URING
+	unsigned int tail = *m_sqTail;
+	if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+		return -1;
+	unsigned int i = tail & m_sqMask;
+	struct io_uring_sqe *sqe = &m_sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITE_FIXED;
+	sqe->fd = fd;
+	sqe->addr = (unsigned long)data;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->buf_index = index;
+	sqe->user_data = userData;
+	m_sqArray[i] = i;
+	/* the kernel must see the entry before the new tail */
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	++m_queued;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+int eIOUring::submit(unsigned int minComplete)
+{
+#ifdef HAVE_IO_URING
+	while (1)
+	{
+		int r = io_uring_enter(m_fd, m_queued, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0);
+		if (r >= 0)
+		{
+			m_queued -= r;
+			return r;
+		}
+		/* the recording threads are stopped with a signal.. the requests must complete anyway */
+		if (errno != EINTR)
+			return -1;
+	}
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+int eIOUring::reap(__u64 &userData, int &result)
+{
+#ifdef HAVE_IO_URING
+	unsigned int head = *m_cqHead;
+	if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+		return 0;
+	struct io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+	userData = cqe->user_data;
+	result = cqe->res;
+	__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+	return 1;
+#else
+	return 0;
+#endif
+}
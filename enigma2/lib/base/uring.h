@@ -0,0 +1,51 @@
+#ifndef __lib_base_uring_h
+#define __lib_base_uring_h
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <asm/types.h>
+
+/*
+ * Minimal io_uring, just what the recording threads need: writes from a set
+ * of registered (fixed) buffers. Talks to the kernel directly, no liburing.
+ * The requests are queued in the submission ring and submitted in batches,
+ * completions are taken from the completion ring without a syscall.
+ * Not thread safe, one ring per thread. setup() fails on kernels without
+ * io_uring, the callers fall back to POSIX aio then.
+ */
+class eIOUring
+{
+public:
+	eIOUring();
+	~eIOUring();
+
+	/* creates the ring and registers the buffers.. returns 0 on success */
+	int setup(unsigned int entries, const struct iovec *buffers, unsigned int count);
+	void close();
+	bool active() const { return m_fd >= 0; }
+
+	/* queues a write from the registered buffer index, data must be inside it..
+	   returns -1 when the submission ring is full */
+	int queueWrite(int fd, unsigned int index, const void *data, size_t len, off_t offset, __u64 userData);
+	unsigned int queued() const { return m_queued; }
+	/* submits the queued requests and waits until minComplete are complete..
+	   returns the number submitted or -1 (errno set) */
+	int submit(unsigned int minComplete = 0);
+	/* takes one completion.. returns 0 when there is none */
+	int reap(__u64 &userData, int &result);
+private:
+	int m_fd;
+	unsigned int m_queued;
+	void *m_sqRing, *m_cqRing;
+	size_t m_sqRingSize, m_cqRingSize;
+	struct io_uring_sqe *m_sqes;
+	size_t m_sqesSize;
+	unsigned int *m_sqHead, *m_sqTail, *m_sqArray, m_sqMask, m_sqEntries;
+	unsigned int *m_cqHead, *m_cqTail, m_cqMask;
+	struct io_uring_cqe *m_cqes;
+
+	eIOUring(const eIOUring &);
+	eIOUring &operator=(const eIOUring &);
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include <lib/components/ts_indexer.h>
+#include <lib/dvb/pvrparse.h>
+#include <lib/base/ioprio.h>
+#include <lib/base/eerror.h>
+#include <lib/base/init.h>
+#include <lib/base/init_num.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+eBackgroundTSIndexer *eBackgroundTSIndexer::instance;
+
+static const size_t readSize = 188 * 2048;
+static const off_t dropSize = 16 * 1024 * 1024; // page cache given back in steps of this
+static const off_t probeSize = 8 * 1024 * 1024; // searched for the video pid
+
+static bool hasIndex(const std::string &filename)
+{
+	return ::access((filename + ".ap").c_str(), F_OK) == 0 || ::access((filename + ".sc").c_str(), F_OK) == 0;
+}
+
+/* the pid of the first video PES header.. the parser finds out by itself whether it's MPEG2 or H.264 */
+static int findVideoPid(int fd)
+{
+	unsigned char buffer[188 * 256];
+	ssize_t r = pread(fd, buffer, sizeof(buffer), 0);
+	if (r < 188 * 3)
+		return -1;
+	off_t offset = 0;
+	while (offset < 188 && (buffer[offset] != 0x47 || buffer[offset + 188] != 0x47 || buffer[offset + 376] != 0x47))
+		++offset;
+	if (offset == 188)
+		return -1;
+	while (offset < probeSize)
+	{
+		r = pread(fd, buffer, sizeof(buffer), offset);
+		if (r < 188)
+			break;
+		for (int i = 0; i + 188 <= r; i += 188)
+		{
+			const unsigned char *pkt = buffer + i;
+			if (pkt[0] != 0x47 || !(pkt[1] & 0x40) || !(pkt[3] & 0x10)) /* sync, pusi, payload */
+				continue;
+			const unsigned char *payload = pkt + 4;
+			if (pkt[3] & 0x20)
+				payload += pkt[4] + 1;
+			if (payload + 4 > pkt + 188)
+				continue;
+			if (!payload[0] && !payload[1] && payload[2] == 1 && (payload[3] & 0xF0) == 0xE0)
+				return ((pkt[1] & 0x1F) << 8) | pkt[2];
+		}
+		offset += r - r % 188;
+	}
+	return -1;
+}
+
+eBackgroundTSIndexer::eBackgroundTSIndexer():
+	messages(this,1),
+	stop_thread_timer(eTimer::create(this)),
+	m_abort(false)
+{
+	if (!instance)
+		instance=this;
+	CONNECT(messages.recv_msg, eBackgroundTSIndexer::gotMessage);
+	CONNECT(stop_thread_timer->timeout, eBackgroundTSIndexer::idle);
+}
+
+void eBackgroundTSIndexer::idle()
+{
+	quit(0);
+}
+
+eBackgroundTSIndexer::~eBackgroundTSIndexer()
+{
+	m_abort = true; // the partial index is removed
+	messages.send(Message());
+	if (instance==this)
+		instance=0;
+	kill();
+}
+
+void eBackgroundTSIndexer::thread()
+{
+	hasStarted();
+	nice(10);
+	setIoPrio(IOPRIO_CLASS_IDLE);
+	reset();
+	runLoop();
+	stop_thread_timer->stop();
+}
+
+bool eBackgroundTSIndexer::index(const std::string& filename)
+{
+	if (filename.empty() || hasIndex(filename))
+		return false;
+	{
+		eSingleLocker l(m_lock);
+		if (!m_queued.insert(filename).second)
+			return false;
+	}
+	messages.send(Message(filename));
+	run();
+	return true;
+}
+
+int eBackgroundTSIndexer::pending()
+{
+	eSingleLocker l(m_lock);
+	return m_queued.size();
+}
+
+void eBackgroundTSIndexer::gotMessage(const Message &msg)
+{
+	if (msg.filename.empty())
+	{
+		quit(0);
+		return;
+	}
+	if (!m_abort)
+		createIndex(msg.filename);
+	{
+		eSingleLocker l(m_lock);
+		m_queued.erase(msg.filename);
+	}
+	stop_thread_timer->start(1000, true); // stop thread in one second
+}
+
+int eBackgroundTSIndexer::createIndex(const std::string &filename)
+{
+	const char *c_filename = filename.c_str();
+	if (hasIndex(filename))
+		return 0;
+	int fd = ::open(c_filename, O_RDONLY | O_LARGEFILE);
+	if (fd < 0)
+	{
+		eDebug("[eBackgroundTSIndexer] cannot open %s: %m", c_filename);
+		return -1;
+	}
+	int pid = findVideoPid(fd);
+	if (pid < 0)
+	{
+		eDebug("[eBackgroundTSIndexer] no video found in %s", c_filename);
+		::close(fd);
+		return -1;
+	}
+	eDebug("[eBackgroundTSIndexer] indexing %s, video pid %04x", c_filename, pid);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* written under a temporary name, a player opening the file meanwhile sees no index */
+	std::string tmpname(filename + ".$$$");
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	off_t offset = 0;
+	int ret = 0;
+	{
+		eMPEGStreamParserTS parser;
+		parser.setOffline(true);
+		parser.setPid(pid, iDVBTSRecorder::video_pid, -1);
+		parser.startSave(tmpname);
+
+		unsigned char *buffer = (unsigned char*)malloc(readSize);
+		off_t dropped = 0;
+		while (buffer && !m_abort)
+		{
+			ssize_t r = ::read(fd, buffer, readSize);
+			if (r < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				eDebug("[eBackgroundTSIndexer] read error in %s: %m", c_filename);
+				ret = -1;
+				break;
+			}
+			if (r == 0)
+				break;
+			parser.parseData(offset, buffer, r);
+			offset += r;
+			if (offset - dropped >= dropSize)
+			{
+				posix_fadvise(fd, dropped, offset - dropped, POSIX_FADV_DONTNEED);
+				dropped = offset;
+			}
+		}
+		if (!buffer || m_abort)
+			ret = -1;
+		free(buffer);
+		::close(fd);
+
+		pts_t first;
+		if (!ret && parser.getFirstPTS(first) < 0)
+		{
+			/* scrambled, the stream time of a recording can't be recovered from the file */
+			eDebug("[eBackgroundTSIndexer] no PTS in %s", c_filename);
+			ret = -1;
+		}
+		if (!ret && parser.stopSave() != 0)
+			ret = -1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (ret < 0)
+	{
+		eDebug("[eBackgroundTSIndexer] %s not indexed%s", c_filename, m_abort ? " (aborted)" : "");
+		::unlink((tmpname + ".ap").c_str());
+		::unlink((tmpname + ".sc").c_str());
+		return -1;
+	}
+	if (::rename((tmpname + ".sc").c_str(), (filename + ".sc").c_str()) < 0 && errno != ENOENT)
+		eDebug("[eBackgroundTSIndexer] rename %s.sc failed: %m", tmpname.c_str());
+	if (::rename((tmpname + ".ap").c_str(), (filename + ".ap").c_str()) < 0)
+	{
+		eDebug("[eBackgroundTSIndexer] rename %s.ap failed: %m", tmpname.c_str());
+		::unlink((tmpname + ".ap").c_str());
+		return -1;
+	}
+	eDebug("[eBackgroundTSIndexer] indexed %s: %lld MB in %d s", c_filename,
+		(long long)(offset >> 20), (int)(end.tv_sec - start.tv_sec));
+	return 0;
+}
+
+eAutoInitP0<eBackgroundTSIndexer> init_eBackgroundTSIndexer(eAutoInitNumbers::configuration+1, "Background TS Indexer");
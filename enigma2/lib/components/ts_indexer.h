@@ -0,0 +1,53 @@
+#ifndef __lib_components_ts_indexer_h
+#define __lib_components_ts_indexer_h
+
+#include <set>
+#include <lib/base/thread.h>
+#include <lib/base/message.h>
+#include <lib/base/ebase.h>
+#include <lib/base/elock.h>
+
+/*
+ * Creates the .ap and .sc files of recordings which have none, e.g. imported
+ * files, so seeking in them uses the index instead of bitrate guesses. The
+ * files are read once at idle I/O priority and run through the same parser
+ * as a recording. Files are queued from the movie list and handled one after
+ * the other, the index is renamed into place when the file was complete.
+ */
+class eBackgroundTSIndexer: public eMainloop, private eThread, public Object
+{
+	struct Message
+	{
+		std::string filename;
+		Message()
+		{}
+		Message(const std::string& afilename)
+			:filename(afilename)
+		{}
+	};
+	eFixedMessagePump<Message> messages;
+	static eBackgroundTSIndexer *instance;
+	void gotMessage(const Message &message);
+	void thread();
+	void idle();
+	int createIndex(const std::string &filename);
+	ePtr<eTimer> stop_thread_timer;
+	eSingleLock m_lock;
+	std::set<std::string> m_queued;
+	volatile bool m_abort;
+#ifndef SWIG
+public:
+#endif
+	eBackgroundTSIndexer();
+	~eBackgroundTSIndexer();
+#ifdef SWIG
+public:
+#endif
+	/* queues filename unless it has an index already.. returns false if it was not queued */
+	bool index(const std::string& filename);
+	/* number of files queued or being indexed */
+	int pending();
+	static eBackgroundTSIndexer *getInstance() { return instance; }
+};
+
+#endif
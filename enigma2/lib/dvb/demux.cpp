@@ -34,6 +34,9 @@ static int recordingBufferCount = determineBufferCount();
 
 #include <lib/base/eerror.h>
 #include <lib/base/filepush.h>
+#include <lib/base/uring.h>
+#include <lib/base/ioscheduler.h>
+#include <lib/base/nconfig.h>
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/demux.h>
 #include <lib/dvb/esection.h>
@@ -400,7 +403,7 @@ RESULT eDVBPESReader::connectRead(const Slot2<void,const __u8*,int> &r, ePtr<eCo
 class eDVBRecordFileThread: public eFilePushThreadRecorder
 {
 public:
-	eDVBRecordFileThread(int packetsize, int bufferCount);
+	eDVBRecordFileThread(int packetsize, int bufferCount, bool aioOnly=false);
 	~eDVBRecordFileThread();
 	void setTimingPID(int pid, iDVBTSRecorder::timing_pid_type pidtype, int streamtype);
 	void startSaveMetaInformation(const std::string &filename);
@@ -417,10 +420,22 @@ protected:
 	{
 		struct aiocb aio;
 		unsigned char* buffer;
+		// the same buffer written through the ring, until the kernel wrote all of it
+		bool ring_busy;
+		int ring_error;
+		unsigned char* ring_data;
+		size_t ring_len;
+		off_t ring_offset;
+		eIOScheduler::request sched;
 		AsyncIO()
 		{
 			memset(&aio, 0, sizeof(struct aiocb));
 			buffer = NULL;
+			ring_busy = false;
+			ring_error = 0;
+			ring_data = NULL;
+			ring_len = 0;
+			ring_offset = 0;
 		}
 		int wait();
 		int start(int fd, off_t offset, size_t nbytes, void* buffer);
@@ -432,12 +447,28 @@ protected:
 	int m_fd_dest;
 	typedef std::vector<AsyncIO> AsyncIOvector;
 	unsigned char* m_allocated_buffer;
+	size_t m_allocated_buffersize;  // of one buffer, m_buffersize is less while a O_DIRECT tail is carried
 	AsyncIOvector m_aio;
 	AsyncIOvector::iterator m_current_buffer;
 	std::vector<int> m_buffer_use_histogram;
+
+	/* the shared scheduler of the file system or io_uring,
+	   POSIX aio is used when neither can be set up */
+	enum { ringBatch = 2, directAlignment = 4096 };
+	eIOScheduler::client *m_scheduler;
+	eIOUring m_ring;
+	bool m_use_scheduler, m_use_ring, m_want_direct_io, m_backend_ready, m_direct_io;
+	size_t m_carry;        // O_DIRECT: bytes at the start of the current buffer, not written yet
+	unsigned char* m_tail; // where the carried bytes are, until they are copied to the next buffer
+	void setupBackend();
+	const char *backendName();
+	void reapRing();
+	int startRing(AsyncIOvector::iterator it, unsigned char *data, size_t len, off_t offset);
+	int pollBuffer(AsyncIOvector::iterator it);
+	int waitBuffer(AsyncIOvector::iterator it);
 };
 
-eDVBRecordFileThread::eDVBRecordFileThread(int packetsize, int bufferCount):
+eDVBRecordFileThread::eDVBRecordFileThread(int packetsize, int bufferCount, bool aioOnly):
 	eFilePushThreadRecorder(
 		/* buffer */ (unsigned char*) ::mmap(NULL, bufferCount * packetsize * 1024, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, /*ignored*/-1, 0),
 		/*buffersize*/ packetsize * 1024),
@@ -446,13 +477,23 @@ eDVBRecordFileThread::eDVBRecordFileThread(int packetsize, int bufferCount):
 	 m_fd_dest(-1),
 	 m_aio(bufferCount),
 	 m_current_buffer(m_aio.begin()),
-	 m_buffer_use_histogram(bufferCount+1, 0)
+	 m_buffer_use_histogram(bufferCount+1, 0),
+	 m_scheduler(NULL),
+	 m_backend_ready(false),
+	 m_direct_io(false),
+	 m_carry(0),
+	 m_tail(NULL)
 {
+	// the config can only be read from the main thread
+	m_use_scheduler = !aioOnly && eConfigManager::getConfigBoolValue("config.recording.io_scheduler");
+	m_use_ring = !aioOnly && eConfigManager::getConfigBoolValue("config.recording.io_uring", true);
+	m_want_direct_io = m_use_ring && eConfigManager::getConfigBoolValue("config.recording.direct_io");
 	if (m_buffer == MAP_FAILED)
 		eFatal("Failed to allocate filepush buffer, contact MiLo\n");
 	// m_buffer actually points to a data block large enough to hold ALL buffers. m_buffer will
 	// move around during writes, so we must remember where the "head" is.
 	m_allocated_buffer = m_buffer;
+	m_allocated_buffersize = m_buffersize;
 	// m_buffersize is thus the size of a single buffer in the queue
 	// Initialize the buffer pointers
 	int index = 0;
@@ -465,7 +506,7 @@ eDVBRecordFileThread::eDVBRecordFileThread(int packetsize, int bufferCount):
 
 eDVBRecordFileThread::~eDVBRecordFileThread()
 {
-	::munmap(m_allocated_buffer, m_aio.size() * m_buffersize);
+	::munmap(m_allocated_buffer, m_aio.size() * m_allocated_buffersize);
 }
 
 void eDVBRecordFileThread::setTimingPID(int pid, iDVBTSRecorder::timing_pid_type pidtype, int streamtype)
@@ -556,6 +597,147 @@ int eDVBRecordFileThread::AsyncIO::start(int fd, off_t offset, size_t nbytes, vo
 	return aio_write(&aio);
 }
 
+// called by the recording thread with the first data
+void eDVBRecordFileThread::setupBackend()
+{
+	m_backend_ready = true;
+	if (m_use_scheduler)
+	{
+		m_scheduler = eIOScheduler::attach(m_fd_dest, m_aio.size());
+		if (m_scheduler)
+		{
+			eDebug("[eDVBRecordFileThread] writing through the io scheduler");
+			return;
+		}
+	}
+	if (!m_use_ring)
+		return;
+	std::vector<struct iovec> buffers(m_aio.size());
+	for (unsigned int i = 0; i < m_aio.size(); ++i)
+	{
+		buffers[i].iov_base = m_aio[i].buffer;
+		buffers[i].iov_len = m_allocated_buffersize;
+	}
+	if (m_ring.setup(m_aio.size() * 2, &buffers[0], buffers.size()) < 0)
+	{
+		eDebug("[eDVBRecordFileThread] io_uring not available (%m), using aio");
+		return;
+	}
+	// the buffers are page aligned.. but the decrypting source doesn't keep to the buffer size
+	if (m_want_direct_io && m_fd_source != 0 && !(m_allocated_buffersize & (directAlignment - 1)))
+	{
+		int flags = fcntl(m_fd_dest, F_GETFL);
+		m_direct_io = flags >= 0 && fcntl(m_fd_dest, F_SETFL, flags | O_DIRECT) == 0;
+		if (!m_direct_io)
+			eDebug("[eDVBRecordFileThread] O_DIRECT not supported: %m");
+	}
+	eDebug("[eDVBRecordFileThread] writing through io_uring%s", m_direct_io ? " with O_DIRECT" : "");
+}
+
+const char *eDVBRecordFileThread::backendName()
+{
+	if (m_scheduler)
+		return "io scheduler";
+	if (m_ring.active())
+		return m_direct_io ? "io_uring, O_DIRECT" : "io_uring";
+	return "aio";
+}
+
+void eDVBRecordFileThread::reapRing()
+{
+	__u64 index;
+	int result;
+	while (m_ring.reap(index, result))
+	{
+		AsyncIO &io = m_aio[index];
+		if (result < 0)
+		{
+			io.ring_error = result;
+			io.ring_busy = false;
+		}
+		else if ((size_t)result < io.ring_len)
+		{
+			// short write, write the rest
+			io.ring_data += result;
+			io.ring_len -= result;
+			io.ring_offset += result;
+			if (m_ring.queueWrite(m_fd_dest, index, io.ring_data, io.ring_len, io.ring_offset, index) < 0)
+			{
+				io.ring_error = -EAGAIN;
+				io.ring_busy = false;
+			}
+		}
+		else
+			io.ring_busy = false;
+	}
+}
+
+int eDVBRecordFileThread::startRing(AsyncIOvector::iterator it, unsigned char *data, size_t len, off_t offset)
+{
+	unsigned int index = it - m_aio.begin();
+	it->ring_data = data;
+	it->ring_len = len;
+	it->ring_offset = offset;
+	it->ring_error = 0;
+	if (m_ring.queueWrite(m_fd_dest, index, data, len, offset, index) < 0)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	it->ring_busy = true;
+	// one syscall submits a batch of writes
+	if (m_ring.queued() >= ringBatch && m_ring.submit() < 0)
+		return -1;
+	return 0;
+}
+
+// returns 1 if busy, 0 if ready, <0 on error return
+int eDVBRecordFileThread::pollBuffer(AsyncIOvector::iterator it)
+{
+	if (m_scheduler)
+	{
+		int r = m_scheduler->poll(&it->sched);
+		if (r < 0)
+			eDebug("[eDVBRecordFileThread] io scheduler write failed: %m");
+		return r;
+	}
+	if (!m_ring.active())
+		return it->poll();
+	reapRing();
+	if (it->ring_error)
+	{
+		errno = -it->ring_error;
+		eDebug("[eDVBRecordFileThread] io_uring write failed: %m");
+		it->ring_error = 0;
+		return -1;
+	}
+	return it->ring_busy ? 1 : 0;
+}
+
+int eDVBRecordFileThread::waitBuffer(AsyncIOvector::iterator it)
+{
+	if (m_scheduler)
+	{
+		int r = m_scheduler->wait(&it->sched);
+		if (r < 0)
+			eDebug("[eDVBRecordFileThread] io scheduler write failed: %m");
+		return r;
+	}
+	if (!m_ring.active())
+		return it->wait();
+	int r;
+	while ((r = pollBuffer(it)) > 0)
+	{
+		// submits what is still queued and sleeps until something completes
+		if (m_ring.submit(1) < 0)
+		{
+			eDebug("[eDVBRecordFileThread] io_uring_enter failed: %m");
+			return -1;
+		}
+	}
+	return r;
+}
+
 int eDVBRecordFileThread::asyncWrite(int len)
 {
 #ifdef SHOW_WRITE_TIME
@@ -574,13 +756,48 @@ int eDVBRecordFileThread::asyncWrite(int len)
 	gettimeofday(&starttime, NULL);
 #endif
 
-	int r = m_current_buffer->start(m_fd_dest, m_current_offset, len, m_buffer);
-	if (r < 0)
+	if (!m_backend_ready)
+		setupBackend();
+	int r;
+	if (m_scheduler)
 	{
-		eDebug("[eDVBRecordFileThread] aio_write failed: %m");
-		return r;
+		m_scheduler->submit(&m_current_buffer->sched, m_buffer, len, m_current_offset, m_overflow_count);
+		m_current_offset += len;
+	}
+	else if (m_ring.active())
+	{
+		// with O_DIRECT only whole blocks are written, the rest is carried to the next buffer
+		size_t total = m_carry + len;
+		size_t bytes = m_direct_io ? total & ~(size_t)(directAlignment - 1) : total;
+		m_current_offset += len;
+		if (!bytes)
+		{
+			// keep filling this buffer
+			m_carry = total;
+			m_tail = NULL;
+			m_buffer = m_current_buffer->buffer + m_carry;
+			m_buffersize = m_allocated_buffersize - m_carry;
+			return len;
+		}
+		r = startRing(m_current_buffer, m_current_buffer->buffer, bytes, m_current_offset - total);
+		if (r < 0)
+		{
+			eDebug("[eDVBRecordFileThread] io_uring write failed: %m");
+			return r;
+		}
+		m_carry = total - bytes;
+		m_tail = m_carry ? m_current_buffer->buffer + bytes : NULL;
+	}
+	else
+	{
+		r = m_current_buffer->start(m_fd_dest, m_current_offset, len, m_buffer);
+		if (r < 0)
+		{
+			eDebug("[eDVBRecordFileThread] aio_write failed: %m");
+			return r;
+		}
+		m_current_offset += len;
 	}
-	m_current_offset += len;
 
 #ifdef SHOW_WRITE_TIME
 	gettimeofday(&now, NULL);
@@ -590,7 +807,7 @@ int eDVBRecordFileThread::asyncWrite(int len)
 	// Count how many buffers are still "busy". Move backwards from current,
 	// because they can reasonably be expected to finish in that order.
 	AsyncIOvector::iterator i = m_current_buffer;
-	r = i->poll();
+	r = pollBuffer(i);
 	int busy_count = 0;
 	while (r > 0)
 	{
@@ -603,7 +820,7 @@ int eDVBRecordFileThread::asyncWrite(int len)
 			eDebug("[eFilePushThreadRecorder] Warning: All write buffers busy");
 			break;
 		}
-		r = i->poll();
+		r = pollBuffer(i);
 		if (r < 0)
 			return r;
 	}
@@ -622,22 +839,59 @@ int eDVBRecordFileThread::writeData(int len)
 	if (len < 0)
 		return len;
 	// Wait for previous aio to complete on this buffer before returning
-	int r = m_current_buffer->wait();
+	int r = waitBuffer(m_current_buffer);
 	if (r < 0)
 		return -1;
+	if (m_tail)
+	{
+		// the unaligned end of the previous buffer is written with the next one
+		memcpy(m_current_buffer->buffer, m_tail, m_carry);
+		m_tail = NULL;
+		m_buffer = m_current_buffer->buffer + m_carry;
+		m_buffersize = m_allocated_buffersize - m_carry;
+	}
+	else
+		m_buffersize = m_allocated_buffersize - m_carry;
 
 	return len;
 }
 
 void eDVBRecordFileThread::flush()
 {
-	eDebug("[eDVBRecordFileThread] waiting for aio to complete");
+	eDebug("[eDVBRecordFileThread] waiting for %s to complete", backendName());
 	for (AsyncIOvector::iterator it = m_aio.begin(); it != m_aio.end(); ++it)
 	{
-		it->wait();
+		waitBuffer(it);
 	}
+	if (m_carry && m_fd_dest >= 0)
+	{
+		// the last partial block can't be written with O_DIRECT
+		int flags = fcntl(m_fd_dest, F_GETFL);
+		if (flags >= 0)
+			fcntl(m_fd_dest, F_SETFL, flags & ~O_DIRECT);
+		if (pwrite(m_fd_dest, m_current_buffer->buffer, m_carry, m_current_offset - m_carry) != (ssize_t)m_carry)
+			eDebug("[eDVBRecordFileThread] writing the last %d bytes failed: %m", (int)m_carry);
+	}
+	const char *backend = backendName();
+	if (m_scheduler)
+	{
+		eIOScheduler::statistics s;
+		m_scheduler->getStatistics(s);
+		eIOScheduler::detach(m_scheduler);
+		m_scheduler = NULL;
+		if (s.requests)
+			eDebug("[eDVBRecordFileThread] io scheduler: %u buffers in %u writes (%u kB average), latency %u us average, %u us max, up to %u buffers queued",
+				s.requests, s.writes, (unsigned int)(s.bytes / s.writes >> 10),
+				(unsigned int)(s.latency / s.requests), s.maxLatency, s.maxQueued);
+	}
+	m_ring.close();
+	m_backend_ready = m_direct_io = false;
+	m_carry = 0;
+	m_tail = NULL;
+	m_buffer = m_current_buffer->buffer;
+	m_buffersize = m_allocated_buffersize;
 	int bufferCount = m_aio.size();
-	eDebug("[eDVBRecordFileThread] buffer usage histogram (%d buffers of %d kB)", bufferCount, m_buffersize>>10);
+	eDebug("[eDVBRecordFileThread] buffer usage histogram (%d buffers of %d kB, %s)", bufferCount, (int)(m_allocated_buffersize>>10), backend);
 	for (int i=0; i <= bufferCount; ++i)
 	{
 		if (m_buffer_use_histogram[i] != 0) eDebug("     %2d: %6d", i, m_buffer_use_histogram[i]);
@@ -656,7 +910,7 @@ class eDVBRecordStreamThread: public eDVBRecordFileThread
 {
 public:
 	eDVBRecordStreamThread(int packetsize):
-		eDVBRecordFileThread(packetsize, /*bufferCount*/ 4)
+		eDVBRecordFileThread(packetsize, /*bufferCount*/ 4, /*aioOnly*/ true)
 	{
 	}
 protected:
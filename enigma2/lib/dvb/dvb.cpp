@@ -1081,6 +1081,8 @@ RESULT eDVBResourceManager::allocateChannel(const eDVBChannelID &channelid, eUse
 	ePtr<eDVBAllocatedFrontend> fe;
 
 	int err = allocateFrontend(fe, feparm, simulate);
+	while (err == errAllSourcesBusy && !simulate && releaseBackgroundChannel(feparm))
+		err = allocateFrontend(fe, feparm, simulate);
 	if (err)
 		return err;
 
@@ -1148,6 +1150,8 @@ RESULT eDVBResourceManager::allocateRawChannel(eUsePtr<iDVBChannel> &channel, in
 	}
 
 	int err = allocateFrontendByIndex(fe, slot_index);
+	while (err && releaseBackgroundSlot(slot_index))
+		err = allocateFrontendByIndex(fe, slot_index);
 	if (err)
 		return err;
 
@@ -1155,6 +1159,89 @@ RESULT eDVBResourceManager::allocateRawChannel(eUsePtr<iDVBChannel> &channel, in
 	return 0;
 }
 
+RESULT eDVBResourceManager::allocateBackgroundChannel(const eDVBChannelID &channelid)
+{
+		/* the epg of a channel in use is read anyway */
+	for (std::list<active_channel>::iterator i(m_active_channels.begin()); i != m_active_channels.end(); ++i)
+		if (i->m_channel_id == channelid)
+			return errChannelInUse;
+
+	if (!m_list)
+		return errNoChannelList;
+
+	ePtr<iDVBFrontendParameters> feparm;
+	if (m_list->getChannelFrontendData(channelid, feparm))
+		return errChannelNotInList;
+
+		/* allocateFrontend only takes unused frontends */
+	ePtr<eDVBAllocatedFrontend> fe;
+	int err = allocateFrontend(fe, feparm);
+	if (err)
+		return err;
+
+	ePtr<eDVBChannel> ch = new eDVBChannel(this, fe);
+	if (ch->setChannel(channelid, feparm))
+		return errChidNotFound;
+
+	eDebug("allocate background channel.. %04x:%04x", channelid.transport_stream_id.get(), channelid.original_network_id.get());
+	m_background_channels.push_back(eUsePtr<iDVBChannel>());
+	m_background_channels.back() = ch;
+	return 0;
+}
+
+bool eDVBResourceManager::hasBackgroundChannel(const eDVBChannelID &channelid)
+{
+	for (std::list<eUsePtr<iDVBChannel> >::iterator i(m_background_channels.begin()); i != m_background_channels.end(); ++i)
+		if (((eDVBChannel*)&(**i))->getChannelID() == channelid)
+			return true;
+	return false;
+}
+
+void eDVBResourceManager::releaseBackgroundChannel(const eDVBChannelID &channelid)
+{
+	for (std::list<eUsePtr<iDVBChannel> >::iterator i(m_background_channels.begin()); i != m_background_channels.end(); ++i)
+	{
+		if (((eDVBChannel*)&(**i))->getChannelID() == channelid)
+		{
+			m_background_channels.erase(i);
+			return;
+		}
+	}
+}
+
+	/* gives up a background channel whose frontend could tune feparm, when a frontend is needed..
+	   returns false when there is none, the others would be released for nothing */
+bool eDVBResourceManager::releaseBackgroundChannel(ePtr<iDVBFrontendParameters> &feparm)
+{
+	for (std::list<eUsePtr<iDVBChannel> >::iterator i(m_background_channels.begin()); i != m_background_channels.end(); ++i)
+	{
+		eDVBChannel *ch = (eDVBChannel*)&(**i);
+		if (ch->m_frontend && ch->m_frontend->get().isCompatibleWith(feparm) > 0)
+		{
+			eDebug("release background channel on slot %d", ch->m_frontend->get().getSlotID());
+			m_background_channels.erase(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+	/* same for a raw channel on the given slot */
+bool eDVBResourceManager::releaseBackgroundSlot(int slot_index)
+{
+	for (std::list<eUsePtr<iDVBChannel> >::iterator i(m_background_channels.begin()); i != m_background_channels.end(); ++i)
+	{
+		eDVBChannel *ch = (eDVBChannel*)&(**i);
+		if (ch->m_frontend && ch->m_frontend->get().getSlotID() == slot_index)
+		{
+			eDebug("release background channel on slot %d", slot_index);
+			m_background_channels.erase(i);
+			return true;
+		}
+	}
+	return false;
+}
+
 
 RESULT eDVBResourceManager::allocatePVRChannel(const eDVBChannelID &channelid, eUsePtr<iDVBPVRChannel> &channel)
 {
@@ -1301,6 +1388,7 @@ int eDVBResourceManager::canAllocateChannel(const eDVBChannelID &channelid, cons
 
 	int *decremented_cached_channel_fe_usecount=NULL,
 		*decremented_fe_usecount=NULL;
+	std::vector<int*> decremented_background_fe_usecounts;
 
 	for (std::list<active_channel>::iterator i(active_channels.begin()); i != active_channels.end(); ++i)
 	{
@@ -1362,6 +1450,28 @@ int eDVBResourceManager::canAllocateChannel(const eDVBChannelID &channelid, cons
 	else
 		decremented_cached_channel_fe_usecount=NULL;
 
+		/* the frontends of the background channels are given up when needed */
+	if (!simulate)
+	{
+		for (std::list<eUsePtr<iDVBChannel> >::iterator i(m_background_channels.begin()); i != m_background_channels.end(); ++i)
+		{
+			eDVBChannel *channel = (eDVBChannel*) &(**i);
+			ePtr<iDVBFrontend> fe;
+			if (channel->getUseCount() == 1 && !channel->getFrontend(fe))
+			{
+				for (eSmartPtrList<eDVBRegisteredFrontend>::iterator ii(m_frontend.begin()); ii != m_frontend.end(); ++ii)
+				{
+					if ( &(*fe) == &(*ii->m_frontend) )
+					{
+						--ii->m_inuse;
+						decremented_background_fe_usecounts.push_back(&ii->m_inuse);
+						break;
+					}
+				}
+			}
+		}
+	}
+
 	ePtr<iDVBFrontendParameters> feparm;
 
 	if (!m_list)
@@ -1384,6 +1494,8 @@ error:
 		++(*decremented_fe_usecount);
 	if (decremented_cached_channel_fe_usecount)
 		++(*decremented_cached_channel_fe_usecount);
+	for (std::vector<int*>::iterator i(decremented_background_fe_usecounts.begin()); i != decremented_background_fe_usecounts.end(); ++i)
+		++(**i);
 
 	return ret;
 }
@@ -1439,6 +1551,7 @@ protected:
 	int m_parity_switch_delay;
 	int m_parity;
 	void filterRecordData(const unsigned char *data, int len);
+	bool wantRecordData() { return m_parity_switch_delay != 0; }
 };
 
 void eDVBChannelFilePush::filterRecordData(const unsigned char *_data, int len)
@@ -194,6 +194,11 @@ class eDVBResourceManager: public iObject, public Object
 	eUsePtr<iDVBChannel> m_cached_channel;
 	Connection m_cached_channel_state_changed_conn;
 	ePtr<eTimer> m_releaseCachedChannelTimer;
+		/* channels tuned for background work (epg harvesting). only held here, so they are
+		   released as soon as their frontend is needed for something else */
+	std::list<eUsePtr<iDVBChannel> > m_background_channels;
+	bool releaseBackgroundChannel(ePtr<iDVBFrontendParameters> &feparm);
+	bool releaseBackgroundSlot(int slot_index);
 	void DVBChannelStateChanged(iDVBChannel*);
 	void feStateChanged();
 #ifndef SWIG
@@ -214,6 +219,7 @@ public:
 		errChannelNotInList = -5,
 		errAllSourcesBusy = -6,
 		errNoSourceFound = -7,
+		errChannelInUse = -8,
 	};
 	
 	RESULT connectChannelAdded(const Slot1<void,eDVBChannel*> &channelAdded, ePtr<eConnection> &connection);
@@ -222,6 +228,10 @@ public:
 		/* allocate channel... */
 	RESULT allocateChannel(const eDVBChannelID &channelid, eUsePtr<iDVBChannel> &channel, bool simulate=false);
 	RESULT allocatePVRChannel(const eDVBChannelID &channelid, eUsePtr<iDVBPVRChannel> &channel);
+		/* tunes an idle frontend to the channel without taking it from anyone */
+	RESULT allocateBackgroundChannel(const eDVBChannelID &channelid);
+	bool hasBackgroundChannel(const eDVBChannelID &channelid);
+	void releaseBackgroundChannel(const eDVBChannelID &channelid);
 	static RESULT getInstance(ePtr<eDVBResourceManager> &);
 
 			/* allocates a frontend able to tune to frontend paramters 'feperm'.
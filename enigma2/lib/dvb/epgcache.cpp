@@ -8,6 +8,8 @@
 #endif
 
 #include <fstream>
+#include <algorithm>
+#include <set>
 #include <time.h>
 #include <unistd.h>  // for usleep
 #include <sys/vfs.h> // for statfs
@@ -15,16 +17,27 @@
 #include <lib/base/eerror.h>
 #include <lib/base/encoding.h>
 #include <lib/base/estring.h>
+#include <lib/base/ioprio.h>
 #include <lib/dvb/pmt.h>
 #include <lib/dvb/db.h>
 #include <lib/python/python.h>
 #include <lib/base/nconfig.h>
 #include <dvbsi++/descriptor_tag.h>
+#include <dvbsi++/descriptor_container.h>
 
 int eventData::CacheSize=0;
-bool eventData::isCacheCorrupt = 0;
-descriptorMap eventData::descriptors;
-__u8 eventData::data[4108];
+int eventData::isCacheCorrupt = 0;
+eEPGDescriptorPool eventData::descriptors;
+eEPGAllocator eventData::eventMemory("events");
+eEPGAllocator eventData::descriptorMemory("descriptors");
+eEPGMappedFile eventData::mappedFile;
+eEPGTitleIndex eventData::titleIndex;
+eEPGTextCache eventData::texts;
+eEPGCompressor eventData::compressor;
+std::vector<eventData::deferredBlock> eventData::deferredBlocks;
+int eventData::snapshots = 0;
+unsigned int eventData::changes = 0;
+__thread __u8 eventData::data[4108];
 extern const uint32_t crc32_table[256];
 
 const eServiceReference &handleGroup(const eServiceReference &ref)
@@ -50,12 +63,74 @@ const eServiceReference &handleGroup(const eServiceReference &ref)
 	return ref;
 }
 
+static const char *originNames[originCount] = { "private", "eit", "mhw", "freesat", "viasat", "netmed", "import" };
+
+static int eventOrigin(int source)
+{
+	if (source == (int)eEPGCache::EPG_IMPORT)
+		return originImport;
+	switch (source)
+	{
+	case eEPGCache::NOWNEXT:
+	case eEPGCache::SCHEDULE:
+	case eEPGCache::SCHEDULE_OTHER:
+		return originEIT;
+#ifdef ENABLE_MHW_EPG
+	case eEPGCache::MHW:
+		return originMHW;
+#endif
+#ifdef ENABLE_FREESAT
+	case eEPGCache::FREESAT_NOWNEXT:
+	case eEPGCache::FREESAT_SCHEDULE:
+	case eEPGCache::FREESAT_SCHEDULE_OTHER:
+		return originFreesat;
+#endif
+	case eEPGCache::VIASAT:
+		return originViasat;
+#ifdef ENABLE_NETMED
+	case eEPGCache::NETMED_SCHEDULE:
+	case eEPGCache::NETMED_SCHEDULE_OTHER:
+		return originNetmed;
+#endif
+	default:
+		return originPrivate;
+	}
+}
+
+// store a descriptor in the shared descriptor pool (or just reference it when it is already there)
+__u32 eventData::addDescriptor(const __u8 *descr, int len, int tsidonid)
+{
+	__u32 crc = 0;
+	for (int i = 0; i < len; ++i)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ descr[i]) & 0xFF];
+
+	eEPGDescriptorPool::entry *e = descriptors.find(crc);
+	if (e)
+		++e->refcount;
+	else
+	{
+		__u8 *d = compressor.compress(descr, descriptorMemory);
+		if (d)
+			len = d[1]+2;
+		else
+		{
+			d = (__u8*)descriptorMemory.alloc(len);
+			memcpy(d, descr, len);
+		}
+		descriptors.insert(crc, d);
+		titleIndex.add(crc, d, tsidonid);
+		CacheSize += len;
+	}
+	return crc;
+}
+
 eventData::eventData(const eit_event_struct* e, int size, int type, int tsidonid)
-	:ByteSize(size&0xFF), type(type&0xFF)
+	:ByteSize(size&0xFF), type(type&0xFF), origin(eventOrigin(type))
 {
 	if (!e)
 		return;
 
+	++changes;
 	__u32 descr[65];
 	__u32 *pdescr=descr;
 
@@ -78,120 +153,57 @@ eventData::eventData(const eit_event_struct* e, int size, int type, int tsidonid
 				case CONTENT_DESCRIPTOR:
 				case PARENTAL_RATING_DESCRIPTOR:
 				{
-					__u32 crc = 0;
-					int cnt=0;
-					while(cnt++ < descr_len)
-						crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ data[ptr++]) & 0xFF];
-
-					descriptorMap::iterator it = descriptors.find(crc);
-					if ( it == descriptors.end() )
-					{
-						CacheSize+=descr_len;
-						__u8 *d = new __u8[descr_len];
-						memcpy(d, descr, descr_len);
-						descriptors[crc] = descriptorPair(1, d);
-					}
-					else
-						++it->second.first;
-					*pdescr++=crc;
+					*pdescr++ = addDescriptor(descr, descr_len, tsidonid);
+					ptr += descr_len;
 					break;
 				}
 				case SHORT_EVENT_DESCRIPTOR:
 				{
-					//parse the data out from the short event descriptor
-					//get the country code, which will be used for converting to UTF8
-					std::string cc( (const char*)&descr[2], 3);
-					std::transform(cc.begin(), cc.end(), cc.begin(), tolower);
-					int table = encodingHandler.getCountryCodeDefaultMapping(cc);
-
+					// split into the title and the text, so events with the same title share it.
+					// both are stored as received, the conversion to UTF-8 is done when an event is
+					// looked up (see eEPGTextCache), so descriptors are shared by their raw bytes
 					int eventNameLen = descr[5];
-					int eventTextLen = descr[6 + eventNameLen];
-
-					//convert our strings to UTF8
-					std::string eventNameUTF8 = convertDVBUTF8((const unsigned char*)&descr[6], eventNameLen, table, tsidonid);
-					std::string textUTF8 = convertDVBUTF8((const unsigned char*)&descr[7 + eventNameLen], eventTextLen, table, tsidonid);
-					unsigned int eventNameUTF8len = eventNameUTF8.length();
-					unsigned int textUTF8len = textUTF8.length();
-
-					//Rebuild the short event descriptor with UTF-8 strings
+					int eventTextLen = 0;
+					if (6 + eventNameLen < descr_len)
+					{
+						eventTextLen = descr[6 + eventNameLen];
+						if (7 + eventNameLen + eventTextLen > descr_len)
+							eventTextLen = descr_len - 7 - eventNameLen;
+					}
+					else
+						eventNameLen = descr_len > 6 ? descr_len - 6 : 0;
+					// the title gets a text length byte, it has to fit into 257 bytes as well
+					if (eventNameLen > 250)
+						eventNameLen = 250;
 
-					//Save the title first
-					if( eventNameUTF8len > 0 ) //only store the data if there is something to store
+					if (eventNameLen > 0)
 					{
-						/*this will actually cause us to save some memory
-						 previously some descriptors didnt match because there text was different and titles the same.
-						 Now that we store them seperatly we can save some space on title data some rough calculation show anywhere from 20 - 40% savings
-						*/
-						eventNameUTF8len = truncateUTF8(eventNameUTF8, 255 - 6);
-						int title_len = 6 + eventNameUTF8len;
-						__u8 *title_data = new __u8[title_len + 2];
+						__u8 title_data[257];
 						title_data[0] = SHORT_EVENT_DESCRIPTOR;
-						title_data[1] = title_len;
+						title_data[1] = eventNameLen + 5;
 						title_data[2] = descr[2];
 						title_data[3] = descr[3];
 						title_data[4] = descr[4];
-						title_data[5] = eventNameUTF8len + 1;
-						title_data[6] = 0x15; //identify event name as UTF-8
-						memcpy(&title_data[7], eventNameUTF8.data(), eventNameUTF8len);
-						title_data[7 + eventNameUTF8len] = 0;
-
-						//Calculate the CRC, based on our new data
-						__u32 title_crc = 0;
-						int cnt=0;
-						int tmpPtr = 0;
-						title_len += 2; //add 2 the length to include the 2 bytes in the header
-						while(cnt++ < title_len)
-							title_crc = (title_crc << 8) ^ crc32_table[((title_crc >> 24) ^ title_data[tmpPtr++]) & 0xFF];
-
-						descriptorMap::iterator it = descriptors.find(title_crc);
-						if ( it == descriptors.end() )
-						{
-							CacheSize+=title_len;
-							descriptors[title_crc] = descriptorPair(1, title_data);
-						}
-						else
-						{
-							++it->second.first;
-							delete [] title_data;
-						}
-						*pdescr++=title_crc;
+						title_data[5] = eventNameLen;
+						memcpy(&title_data[6], &descr[6], eventNameLen);
+						title_data[6 + eventNameLen] = 0;
+
+						*pdescr++ = addDescriptor(title_data, eventNameLen + 7, tsidonid);
 					}
 
-					//save the text
-					if( textUTF8len > 0 ) //only store the data if there is something to store
+					if (eventTextLen > 0)
 					{
-						textUTF8len = truncateUTF8(textUTF8, 255 - 6);
-						int text_len = 6 + textUTF8len;
-						__u8 *text_data = new __u8[text_len + 2];
+						__u8 text_data[257];
 						text_data[0] = SHORT_EVENT_DESCRIPTOR;
-						text_data[1] = text_len;
+						text_data[1] = eventTextLen + 5;
 						text_data[2] = descr[2];
 						text_data[3] = descr[3];
 						text_data[4] = descr[4];
 						text_data[5] = 0;
-						text_data[6] = textUTF8len + 1; //identify text as UTF-8
-						text_data[7] = 0x15; //identify text as UTF-8
-						memcpy(&text_data[8], textUTF8.data(), textUTF8len);
-
-						__u32 text_crc = 0;
-						int cnt=0;
-						int tmpPtr = 0;
-						text_len += 2; //add 2 the length to include the 2 bytes in the header
-						while(cnt++ < text_len)
-							text_crc = (text_crc << 8) ^ crc32_table[((text_crc >> 24) ^ text_data[tmpPtr++]) & 0xFF];
-
-						descriptorMap::iterator it = descriptors.find(text_crc);
-						if ( it == descriptors.end() )
-						{
-							CacheSize+=text_len;
-							descriptors[text_crc] = descriptorPair(1, text_data);
-						}
-						else
-						{
-							++it->second.first;
-							delete [] text_data;
-						}
-						*pdescr++=text_crc;
+						text_data[6] = eventTextLen;
+						memcpy(&text_data[7], &descr[7 + eventNameLen], eventTextLen);
+
+						*pdescr++ = addDescriptor(text_data, eventTextLen + 7, tsidonid);
 					}
 
 					ptr += descr_len;
@@ -208,38 +220,95 @@ eventData::eventData(const eit_event_struct* e, int size, int type, int tsidonid
 	}
 	ASSERT(pdescr <= &descr[65]);
 	ByteSize = 10+((pdescr-descr)*4);
-	EITdata = new __u8[ByteSize];
+	EITdata = (__u8*)eventMemory.alloc(ByteSize);
 	CacheSize+=ByteSize;
 	memcpy(EITdata, (__u8*) e, 10);
 	memcpy(EITdata+10, descr, ByteSize-10);
 }
 
-const eit_event_struct* eventData::get() const
+const eit_event_struct* eventData::get(__u8 *buffer, int tsidonid) const
 {
 	int pos = 12;
-	int tmp = ByteSize-10;
-	memcpy(data, EITdata, 10);
+	memcpy(buffer, EITdata, 10);
 	int descriptors_length=0;
-	__u32 *p = (__u32*)(EITdata+10);
-	while(tmp>3)
+	std::string utf8;
+	for (descriptorIterator it(descriptorsBegin()); it != descriptorsEnd(); ++it)
 	{
-		descriptorMap::iterator it =
-			descriptors.find(*p++);
-		if ( it != descriptors.end() )
+		const __u8 *d = *it;
+		if ( d )
 		{
-			int b = it->second.second[1]+2;
-			memcpy(data+pos, it->second.second, b );
+			// the users of plain eit events (e.g. the .eit file of a recording) expect UTF-8 texts
+			if (d[0] == SHORT_EVENT_DESCRIPTOR && eEPGTextCache::needsConversion(d))
+			{
+				texts.get(it.crc(), d, tsidonid, utf8);
+				d = (const __u8*)utf8.data();
+			}
+			int b = d[1]+2;
+			if (pos + b > 4108) // the converted texts are longer
+				break;
+			memcpy(buffer+pos, d, b );
 			pos += b;
 			descriptors_length += b;
 		}
-		else
-			cacheCorrupt("eventData::get");
-		tmp-=4;
 	}
-	ASSERT(pos <= 4108);
-	data[10] = (descriptors_length >> 8) & 0x0F;
-	data[11] = descriptors_length & 0xFF;
-	return (eit_event_struct*)data;
+	buffer[10] = (descriptors_length >> 8) & 0x0F;
+	buffer[11] = descriptors_length & 0xFF;
+	return (eit_event_struct*)buffer;
+}
+
+const eit_event_struct* eventData::get(int tsidonid) const
+{
+	return get(data, tsidonid);
+}
+
+// indexes the titles of an event loaded from epg.dat, the descriptors were loaded without their events
+void eventData::indexTitles(const eventData *ev, int tsidonid)
+{
+	for (descriptorIterator it(ev->descriptorsBegin()); it != ev->descriptorsEnd(); ++it)
+	{
+		eEPGDescriptorPool::entry *e = descriptors.find(it.crc());
+		if (e)
+			titleIndex.add(e->crc, e->data, tsidonid);
+	}
+}
+
+/* feeds the pooled descriptors of a cached event directly to the descriptor parsers,
+   so no complete eit event needs to be rebuilt and parsed again */
+class eventDescriptors: public DescriptorContainer
+{
+public:
+	// tag 0 feeds all descriptors, otherwise only the ones with this tag
+	eventDescriptors(const eventData *ev, int tsidonid, int tag=0)
+	{
+		std::string utf8;
+		for (eventData::descriptorIterator it(ev->descriptorsBegin()); it != ev->descriptorsEnd(); ++it)
+		{
+			const __u8 *d = *it;
+			if (!d || (tag && d[0] != tag))
+				continue;
+			if (d[0] == SHORT_EVENT_DESCRIPTOR && eEPGTextCache::needsConversion(d))
+			{
+				eventData::texts.get(it.crc(), d, tsidonid, utf8);
+				descriptor((const __u8*)utf8.data(), SCOPE_SI);
+			}
+			else
+				descriptor(d, SCOPE_SI);
+		}
+	}
+};
+
+static inline int tsidOnid(const eServiceReference &service)
+{
+	const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
+	return (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get();
+}
+
+static RESULT parseEvent(eServiceEvent &result, const eventData *ev, int tsidonid, bool withDescriptors=true)
+{
+	if (!withDescriptors)
+		return result.parseFrom(ev->getStartTime(), ev->getDuration(), ev->getEventID(), 0, tsidonid);
+	eventDescriptors descr(ev, tsidonid);
+	return result.parseFrom(ev->getStartTime(), ev->getDuration(), ev->getEventID(), descr.getDescriptors(), tsidonid);
 }
 
 eventData::~eventData()
@@ -247,104 +316,189 @@ eventData::~eventData()
 	if ( ByteSize )
 	{
 		CacheSize -= ByteSize;
-		__u32 *d = (__u32*)(EITdata+10);
-		ByteSize -= 10;
-		while(ByteSize>3)
+		for (descriptorIterator it(descriptorsBegin()); it != descriptorsEnd(); ++it)
 		{
-			descriptorMap::iterator it =
-				descriptors.find(*d++);
-			if ( it != descriptors.end() )
+			eEPGDescriptorPool::entry *e = descriptors.find(it.crc());
+			if ( e )
 			{
-				descriptorPair &p = it->second;
-				if (!--p.first) // no more used descriptor
+				if (!--e->refcount) // no more used descriptor
 				{
-					CacheSize -= it->second.second[1];
-					delete [] it->second.second;  	// free descriptor memory
-					descriptors.erase(it);	// remove entry from descriptor map
+					int len = e->data[1]+2;
+					CacheSize -= len;
+					titleIndex.remove(e->crc);
+					releaseBlock(e->data, len, true);  	// free descriptor memory
+					descriptors.erase(e);	// remove entry from descriptor pool
 				}
 			}
 			else
 			{
 				cacheCorrupt("eventData::~eventData");
 			}
-			ByteSize -= 4;
 		}
-		delete [] EITdata;
+		releaseBlock(EITdata, ByteSize, false);
+		++changes;
+	}
+}
+
+void eventData::releaseBlock(__u8 *data, int len, bool descriptor)
+{
+	if (snapshots)
+	{
+		deferredBlock b = { data, len, descriptor };
+		deferredBlocks.push_back(b);
 	}
+	else if (mappedFile.contains(data))
+		mappedFile.unref();
+	else if (descriptor)
+		descriptorMemory.free(data, len);
+	else
+		eventMemory.free(data, len);
+}
+
+void eventData::releaseSnapshot()
+{
+	if (--snapshots)
+		return;
+	for (std::vector<deferredBlock>::iterator it(deferredBlocks.begin()); it != deferredBlocks.end(); ++it)
+		releaseBlock(it->data, it->len, it->descriptor);
+	std::vector<deferredBlock>().swap(deferredBlocks);
 }
 
 void eventData::load(FILE *f)
 {
 	int size=0;
-	int id=0;
+	__u32 id=0;
+	int refcount=0;
 	__u8 header[2];
-	descriptorPair p;
 	fread(&size, sizeof(int), 1, f);
 	while(size)
 	{
 		fread(&id, sizeof(__u32), 1, f);
-		fread(&p.first, sizeof(int), 1, f);
+		fread(&refcount, sizeof(int), 1, f);
 		fread(header, 2, 1, f);
 		int bytes = header[1]+2;
-		p.second = new __u8[bytes];
-		p.second[0] = header[0];
-		p.second[1] = header[1];
-		fread(p.second+2, bytes-2, 1, f);
-		descriptors[id]=p;
+		__u8 *d = (__u8*)descriptorMemory.alloc(bytes);
+		d[0] = header[0];
+		d[1] = header[1];
+		fread(d+2, bytes-2, 1, f);
+		__u8 *c = compressor.compress(d, descriptorMemory);
+		if (c)
+		{
+			descriptorMemory.free(d, bytes);
+			d = c;
+			bytes = d[1]+2;
+		}
+		eEPGDescriptorPool::entry *e = descriptors.find(id);
+		if (e) // should not happen.. but don't leak the old one
+		{
+			CacheSize -= e->data[1]+2;
+			titleIndex.remove(id);
+			descriptorMemory.free(e->data, e->data[1]+2);
+			e->data = d;
+		}
+		else
+			e = descriptors.insert(id, d);
+		e->refcount = refcount;
 		--size;
 		CacheSize+=bytes;
 	}
 }
 
-void eventData::save(FILE *f)
+// the descriptors of an epg.dat v8 are used directly from the mapping
+bool eventData::loadMapped(const epgFileHeader *header)
 {
-	if (isCacheCorrupt)
-		return;
-	int size=descriptors.size();
-	descriptorMap::iterator it(descriptors.begin());
-	fwrite(&size, sizeof(int), 1, f);
-	while(size)
+	const epgFileDescriptor *index = (const epgFileDescriptor*)
+		mappedFile.at(header->descriptorIndexOffset, (__u64)header->descriptorCount * sizeof(epgFileDescriptor));
+	const __u8 *blob = mappedFile.at(header->descriptorOffset, header->descriptorSize);
+	if (!index || !blob)
+		return false;
+	for (unsigned int i = 0; i < header->descriptorCount; ++i)
 	{
-		fwrite(&it->first, sizeof(__u32), 1, f);
-		fwrite(&it->second.first, sizeof(int), 1, f);
-		fwrite(it->second.second, it->second.second[1]+2, 1, f);
-		++it;
-		--size;
+		__u32 offset = index[i].offset;
+		if ((__u64)offset + 2 > header->descriptorSize || (__u64)offset + blob[offset+1] + 2 > header->descriptorSize)
+			return false;
 	}
+	for (unsigned int i = 0; i < header->descriptorCount; ++i)
+	{
+		__u8 *d = (__u8*)blob + index[i].offset;
+		eEPGDescriptorPool::entry *e = descriptors.find(index[i].crc);
+		if (e) // should not happen
+			e->refcount += index[i].refcount;
+		else
+		{
+			e = descriptors.insert(index[i].crc, d);
+			e->refcount = index[i].refcount;
+			mappedFile.ref();
+			CacheSize += d[1]+2;
+		}
+	}
+	return true;
 }
 
+void eventData::dumpStatistics()
+{
+	eDebug("[EPGC] cache size %d bytes, %u shared descriptors (hash table %u bytes), %u titles indexed (%u bytes)",
+		CacheSize, descriptors.size(), (unsigned int)descriptors.memoryUsage(),
+		titleIndex.size(), (unsigned int)titleIndex.memoryUsage());
+	eDebug("[EPGC] text cache %u hits, %u conversions (%u bytes)",
+		texts.hits(), texts.misses(), (unsigned int)texts.memoryUsage());
+	compressor.dumpStatistics();
+	eventMemory.dumpStatistics();
+	descriptorMemory.dumpStatistics();
+}
+
+// also called by readers, which run concurrently.. the files are removed by cleanLoop
 void eventData::cacheCorrupt(const char* context)
 {
 
 	eDebug("WARNING: EPG Cache is corrupt (%s), you should restart Enigma!", context);
-	if (!isCacheCorrupt)
-	{
-		isCacheCorrupt = true;
-		if (!eEPGCache::instance->m_filename.empty())
-			unlink(eEPGCache::instance->m_filename.c_str()); // Remove corrupt EPG data
-	}
+	__sync_bool_compare_and_swap(&isCacheCorrupt, 0, 1);
+}
+
+// removes the epg.dat and the journal of a corrupt cache, the caller holds the write lock
+void eEPGCache::removeCorruptFiles()
+{
+	if (!eventData::isCacheCorrupt || m_corruptRemoved)
+		return;
+	m_corruptRemoved = true;
+	if (!m_filename.empty())
+		unlink(m_filename.c_str()); // Remove corrupt EPG data
+	m_journal.remove();
 }
 
 
 eEPGCache* eEPGCache::instance;
-pthread_mutex_t eEPGCache::cache_lock=
-	PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+eEPGCacheLock eEPGCache::cache_lock;
 pthread_mutex_t eEPGCache::channel_map_lock=
 	PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 
 DEFINE_REF(eEPGCache)
 
 eEPGCache::eEPGCache()
-	:messages(this,1), cleanTimer(eTimer::create(this)), m_running(false) 
+	:messages(this,1), cleanTimer(eTimer::create(this)), m_running(false)
+	,m_saveThread(this), m_saving(false), m_savedChanges(0), saveTimer(eTimer::create(this))
+	,m_replaying(false), journalTimer(eTimer::create(this)), m_harvester(this)
 {
 	eDebug("[EPGC] Initialized EPGCache (wait for setCacheFile call now)");
 
 	enabledSources = 0;
 	historySeconds = 0;
+	memset(m_sourceStats, 0, sizeof(m_sourceStats));
+	m_statisticsInterval = 0;
+	m_lastStatistics = 0;
+	m_memoryLimit = 0;
+	memset(m_evictStep, 0, sizeof(m_evictStep));
+	m_lastEvict = 0;
+	m_reparse = false;
+	m_compressPass = false;
+	m_compressPos = 0;
+	m_corruptRemoved = false;
 
 	CONNECT(messages.recv_msg, eEPGCache::gotMessage);
 	CONNECT(eDVBLocalTimeHandler::getInstance()->m_timeUpdated, eEPGCache::timeUpdated);
 	CONNECT(cleanTimer->timeout, eEPGCache::cleanLoop);
+	CONNECT(saveTimer->timeout, eEPGCache::saveAsync);
+	CONNECT(journalTimer->timeout, eEPGCache::flushJournal);
 
 	std::ifstream onid_file;
 	onid_file.open("/etc/enigma2/blacklist.onid");
@@ -576,6 +730,11 @@ void eEPGCache::DVBChannelStateChanged(iDVBChannel *chan)
 	}
 }
 
+static unsigned int microseconds(const struct timespec &from, const struct timespec &to)
+{
+	return (to.tv_sec - from.tv_sec) * 1000000 + (to.tv_nsec - from.tv_nsec) / 1000;
+}
+
 bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t TM, int duration, const timeMap::iterator &tm_it, const uniqueEPGKey &service)
 {
 	bool ret = false;
@@ -594,7 +753,7 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 			__u16 event_id = tmp->second->getEventID();
 			servicemap.first.erase(event_id);
 #ifdef EPG_DEBUG
-			Event evt((uint8_t*)tmp->second->get());
+			Event evt((uint8_t*)tmp->second->get(service.tsid<<16|service.onid));
 			eServiceEvent event;
 			event.parseFrom(&evt, service.sid<<16|service.onid);
 			eDebug("(1)erase no more used event %04x %d\n%s %s\n%s",
@@ -604,14 +763,14 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 				event.getExtendedDescription().c_str());
 #endif
 			delete tmp->second;
+			ret = true;
 			if (tmp == servicemap.second.begin())
 			{
 				servicemap.second.erase(tmp);
 				break;
 			}
-			else
-				servicemap.second.erase(tmp--);
-			ret = true;
+			tmp = servicemap.second.erase(tmp);
+			--tmp;
 		}
 		else
 		{
@@ -621,7 +780,8 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 		}
 	}
 
-	tmp = tm_it;
+	// erasing moved the entries of the flat timemap, so tm_it is only valid when nothing was erased
+	tmp = ret ? servicemap.second.find(TM) : tm_it;
 	while(tmp->first < (TM+duration-300))
 	{
 		if (tmp->first != TM && tmp->second->type != PRIVATE)
@@ -629,7 +789,7 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 			__u16 event_id = tmp->second->getEventID();
 			servicemap.first.erase(event_id);
 #ifdef EPG_DEBUG  
-			Event evt((uint8_t*)tmp->second->get());
+			Event evt((uint8_t*)tmp->second->get(service.tsid<<16|service.onid));
 			eServiceEvent event;
 			event.parseFrom(&evt, service.sid<<16|service.onid);
 			eDebug("(2)erase no more used event %04x %d\n%s %s\n%s",
@@ -639,7 +799,7 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 				event.getExtendedDescription().c_str());
 #endif
 			delete tmp->second;
-			servicemap.second.erase(tmp++);
+			tmp = servicemap.second.erase(tmp);
 			ret = true;
 		}
 		else
@@ -647,9 +807,50 @@ bool eEPGCache::FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t T
 		if (tmp == servicemap.second.end())
 			break;
 	}
+	if (ret)
+		m_sectionCRCs.invalidate(service.sid);
 	return ret;
 }
 
+// an event is only kept back when it doesn't overlap the kept back ones, so fixing
+// their overlaps after inserting them all removes the same events as one by one
+bool eEPGCache::canDefer(const std::vector<newEvent> &pending, __u16 event_id, time_t TM, int duration)
+{
+	for (std::vector<newEvent>::const_iterator i = pending.begin(); i != pending.end(); ++i)
+	{
+		if (i->event_id == event_id || i->TM == TM || (TM < i->TM + i->duration && i->TM < TM + duration))
+			return false;
+	}
+	return true;
+}
+
+// one merge per table instead of moving the following entries for every event
+int eEPGCache::insertEvents(std::pair<eventMap,timeMap> &servicemap, std::vector<newEvent> &pending, const uniqueEPGKey &service)
+{
+	std::vector<eventMap::value_type> events;
+	std::vector<timeMap::value_type> times;
+	events.reserve(pending.size());
+	times.reserve(pending.size());
+	for (std::vector<newEvent>::iterator i = pending.begin(); i != pending.end(); ++i)
+	{
+		events.push_back(eventMap::value_type(i->event_id, i->evt));
+		times.push_back(timeMap::value_type(i->TM, i->evt));
+	}
+	std::sort(events.begin(), events.end());
+	std::sort(times.begin(), times.end());
+	servicemap.first.merge(events);
+	servicemap.second.merge(times);
+	int fixes = 0;
+	for (std::vector<newEvent>::iterator i = pending.begin(); i != pending.end(); ++i)
+	{
+		timeMap::iterator tm_it = servicemap.second.find(i->TM);
+		if (tm_it != servicemap.second.end() && FixOverlapping(servicemap, i->TM, i->duration, tm_it, service))
+			++fixes;
+	}
+	pending.clear();
+	return fixes;
+}
+
 void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 {
 	eit_t *eit = (eit_t*) data;
@@ -659,6 +860,12 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 	if ( ptr >= len )
 		return;
 
+	struct timespec start, locked, finished;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ingestStatistics counted;
+	memset(&counted, 0, sizeof(counted));
+	counted.parsed = 1;
+
         int onid = HILO(eit->original_network_id);
         int tsid  = HILO(eit->transport_stream_id);
 
@@ -704,12 +911,16 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 	if ( TM != 3599 && TM > -1 && channel)
 		channel->haveData |= source;
 
-	singleLock s(cache_lock);
+	eEPGWriteLocker s(cache_lock);
+	clock_gettime(CLOCK_MONOTONIC, &locked);
+	time_t limit = m_memoryLimit ? evictionLimit(service, now) : -1;
 	// hier wird immer eine eventMap zurck gegeben.. entweder eine vorhandene..
 	// oder eine durch [] erzeugte
 	std::pair<eventMap,timeMap> &servicemap = eventDB[service];
 	eventMap::iterator prevEventIt = servicemap.first.end();
 	timeMap::iterator prevTimeIt = servicemap.second.end();
+	time_t expires = 0;
+	std::vector<newEvent> pending;
 
 	while (ptr<len)
 	{
@@ -732,12 +943,15 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 		if ( (TM != 3599) &&		// NVOD Service
 		     (now <= (TM+duration)) &&	// skip old events
 		     (TM < (now+28*24*60*60)) &&	// no more than 4 weeks in future
+		     (limit < 0 || TM < limit) &&	// evicted to stay below the memory limit
 		     ( (onid != 1714) || (duration != (24*3600-1)) )	// PlatformaHD invalid event
 		   )
 		{
 			__u16 event_id = HILO(eit_event->event_id);
 			eventData *evt = 0;
 			int ev_erase_count = 0;
+			if (!expires || TM + duration < expires)
+				expires = TM + duration;
 			int tm_erase_count = 0;
 
 			if (event_id == 0) {
@@ -752,13 +966,37 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 			eventMap::iterator ev_it =
 				servicemap.first.find(event_id);
 
+			// completely new events are inserted together at the end of the section
+			if ( ev_it == servicemap.first.end() &&
+				servicemap.second.find(TM) == servicemap.second.end() &&
+				canDefer(pending, event_id, TM, duration) )
+			{
+				newEvent n = { event_id, TM, duration, new eventData(eit_event, eit_event_size, source, (tsid<<16)|onid) };
+				pending.push_back(n);
+				if (!m_replaying)
+					m_journal.addEvent(service.sid, service.onid, service.tsid, source, (const __u8*)eit_event, eit_event_size);
+				++counted.inserted;
+				++counted.overlapChecks;
+				goto next;
+			}
+			if ( !pending.empty() )
+			{
+				counted.overlapFixes += insertEvents(servicemap, pending, service);
+				prevEventIt = servicemap.first.end();
+				prevTimeIt = servicemap.second.end();
+				ev_it = servicemap.first.find(event_id);
+			}
+
 //			eDebug("event_id is %d sid is %04x", event_id, service.sid);
 
 			// entry with this event_id is already exist ?
 			if ( ev_it != servicemap.first.end() )
 			{
 				if ( source > ev_it->second->type )  // update needed ?
+				{
+					++counted.skipped;
 					goto next; // when not.. then skip this entry
+				}
 
 				// search this event in timemap
 				timeMap::iterator tm_it_tmp =
@@ -772,8 +1010,13 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 						eventData *tmp = ev_it->second;
 						ev_it->second = tm_it_tmp->second =
 							new eventData(eit_event, eit_event_size, source, (tsid<<16)|onid);
+						if (!m_replaying && !(*tmp == *ev_it->second)) // most updates are just repeated sections
+							m_journal.addEvent(service.sid, service.onid, service.tsid, source, (const __u8*)eit_event, eit_event_size);
+						++counted.replaced;
+						++counted.overlapChecks;
 						if (FixOverlapping(servicemap, TM, duration, tm_it_tmp, service))
 						{
+							++counted.overlapFixes;
 							prevEventIt = servicemap.first.end();
 							prevTimeIt = servicemap.second.end();
 						}
@@ -800,7 +1043,10 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 				// event with same start time but another event_id...
 				if ( source > tm_it->second->type &&
 					ev_it == servicemap.first.end() )
+				{
+					++counted.skipped;
 					goto next; // when not.. then skip this entry
+				}
 
 				// search this time in eventmap
 				eventMap::iterator ev_it_tmp =
@@ -810,14 +1056,23 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 				{
 					ev_erase_count++;
 					// delete the found record from eventmap
+					bool found = ev_it != servicemap.first.end();
 					servicemap.first.erase(ev_it_tmp);
+					// the erase moved the following entries
+					ev_it = found ? servicemap.first.find(event_id) : servicemap.first.end();
 					prevEventIt=servicemap.first.end();
 				}
 			}
 			evt = new eventData(eit_event, eit_event_size, source, (tsid<<16)|onid);
+			if (!m_replaying)
+				m_journal.addEvent(service.sid, service.onid, service.tsid, source, (const __u8*)eit_event, eit_event_size);
 #ifdef EPG_DEBUG
 			bool consistencyCheck=true;
 #endif
+			if (ev_erase_count > 0 || tm_erase_count > 0)
+				++counted.replaced;
+			else
+				++counted.inserted;
 			if (ev_erase_count > 0 && tm_erase_count > 0) // 2 different pairs have been removed
 			{
 				// exempt memory
@@ -830,14 +1085,14 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 			{
 				// exempt memory
 				delete ev_it->second;
-				tm_it=prevTimeIt=servicemap.second.insert( prevTimeIt, std::pair<const time_t, eventData*>( TM, evt ) );
+				tm_it=prevTimeIt=servicemap.second.insert( prevTimeIt, std::pair<time_t, eventData*>( TM, evt ) );
 				ev_it->second=evt;
 			}
 			else if (ev_erase_count > 0 && tm_erase_count == 0)
 			{
 				// exempt memory
 				delete tm_it->second;
-				ev_it=prevEventIt=servicemap.first.insert( prevEventIt, std::pair<const __u16, eventData*>( event_id, evt) );
+				ev_it=prevEventIt=servicemap.first.insert( prevEventIt, std::pair<__u16, eventData*>( event_id, evt) );
 				tm_it->second=evt;
 			}
 			else // added new eventData
@@ -845,8 +1100,8 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 #ifdef EPG_DEBUG
 				consistencyCheck=false;
 #endif
-				ev_it=prevEventIt=servicemap.first.insert( prevEventIt, std::pair<const __u16, eventData*>( event_id, evt) );
-				tm_it=prevTimeIt=servicemap.second.insert( prevTimeIt, std::pair<const time_t, eventData*>( TM, evt ) );
+				ev_it=prevEventIt=servicemap.first.insert( prevEventIt, std::pair<__u16, eventData*>( event_id, evt) );
+				tm_it=prevTimeIt=servicemap.second.insert( prevTimeIt, std::pair<time_t, eventData*>( TM, evt ) );
 			}
 
 #ifdef EPG_DEBUG
@@ -868,8 +1123,10 @@ void eEPGCache::sectionRead(const __u8 *data, int source, channel_data *channel)
 						ev_it->first, event_id );
 			}
 #endif
+			++counted.overlapChecks;
 			if (FixOverlapping(servicemap, TM, duration, tm_it, service))
 			{
+				++counted.overlapFixes;
 				prevEventIt = servicemap.first.end();
 				prevTimeIt = servicemap.second.end();
 			}
@@ -901,12 +1158,35 @@ next:
 		ptr += eit_event_size;
 		eit_event=(eit_event_struct*)(((__u8*)eit_event)+eit_event_size);
 	}
+	if (!pending.empty())
+		counted.overlapFixes += insertEvents(servicemap, pending, service);
+	if (expires)
+		scheduleExpiry(service, expires);
+	if (m_journal.batchFull())
+		m_journal.flush();
+	clock_gettime(CLOCK_MONOTONIC, &finished);
+	counted.lockWait = microseconds(start, locked);
+	counted.lockHold = microseconds(locked, finished);
+	counted.parseTime = microseconds(start, finished);
+	countIngest(channel, source, counted);
 }
 
 void eEPGCache::flushEPG(const uniqueEPGKey & s)
 {
 	eDebug("[EPGC] flushEPG %d", (int)(bool)s);
-	singleLock l(cache_lock);
+	eEPGWriteLocker l(cache_lock);
+	if (!m_replaying)
+	{
+		if (s)
+			m_journal.addFlush(s.sid, s.onid, s.tsid);
+		else
+			m_journal.addFlushAll();
+	}
+	// the flushed events must be parsed again
+	if (s)
+		m_sectionCRCs.invalidate(s.sid);
+	else
+		m_sectionCRCs.clear();
 	if (s)  // clear only this service
 	{
 		eventCache::iterator it = eventDB.find(s);
@@ -919,6 +1199,7 @@ void eEPGCache::flushEPG(const uniqueEPGKey & s)
 				delete i->second;
 			evMap.clear();
 			eventDB.erase(it);
+			m_expiryTimes.erase(s);
 
 			// TODO .. search corresponding channel for removed service and remove this channel from lastupdated map
 #ifdef ENABLE_PRIVATE_EPG
@@ -945,6 +1226,8 @@ void eEPGCache::flushEPG(const uniqueEPGKey & s)
 			tmMap.clear();
 		}
 		eventDB.clear();
+		m_expiryQueue = std::priority_queue<expiryEntry, std::vector<expiryEntry>, std::greater<expiryEntry> >();
+		m_expiryTimes.clear();
 #ifdef ENABLE_PRIVATE_EPG
 		content_time_tables.clear();
 #endif
@@ -955,75 +1238,449 @@ void eEPGCache::flushEPG(const uniqueEPGKey & s)
 	}
 }
 
-void eEPGCache::cleanLoop()
+void eEPGCache::scheduleExpiry(const uniqueEPGKey &service, time_t expires)
 {
-	singleLock s(cache_lock);
-	if (!eventDB.empty())
+	expiryMap::iterator it = m_expiryTimes.find(service);
+	if (it == m_expiryTimes.end())
+		m_expiryTimes[service] = expires;
+	else if (expires < it->second)
+		it->second = expires;  // the later entry in the queue is stale now
+	else
+		return;
+	m_expiryQueue.push(expiryEntry(expires, service));
+}
+
+// queues every service.. after loading the cache
+void eEPGCache::scheduleExpiry()
+{
+	m_expiryQueue = std::priority_queue<expiryEntry, std::vector<expiryEntry>, std::greater<expiryEntry> >();
+	m_expiryTimes.clear();
+	for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end(); ++DBIt)
 	{
-		time_t now = ::time(0) - historySeconds;
+		timeMap &tmMap = DBIt->second.second;
+		if (!tmMap.empty())
+			scheduleExpiry(DBIt->first, tmMap.begin()->first + tmMap.begin()->second->getDuration());
+	}
+}
 
-		for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end(); DBIt++)
+#ifdef ENABLE_PRIVATE_EPG
+// removes the content entries of events no longer in the time map
+void eEPGCache::cleanContentTimeTable(const uniqueEPGKey &service, const timeMap &tmMap)
+{
+	contentMaps::iterator x =
+		content_time_tables.find( service );
+	if ( x != content_time_tables.end() )
+	{
+		for ( contentMap::iterator i = x->second.begin(); i != x->second.end(); )
 		{
-			bool updated = false;
-			for (timeMap::iterator It = DBIt->second.second.begin(); It != DBIt->second.second.end() && It->first < now;)
+			for ( contentTimeMap::iterator it(i->second.begin());
+				it != i->second.end(); )
 			{
-				if ( now > (It->first+It->second->getDuration()) )  // outdated normal entry (nvod references to)
-				{
-					// remove entry from eventMap
-					eventMap::iterator b(DBIt->second.first.find(It->second->getEventID()));
-					if ( b != DBIt->second.first.end() )
-					{
-						// release Heap Memory for this entry   (new ....)
-//						eDebug("[EPGC] delete old event (evmap)");
-						DBIt->second.first.erase(b);
-					}
-
-					// remove entry from timeMap
-//					eDebug("[EPGC] release heap mem");
-					delete It->second;
-					DBIt->second.second.erase(It++);
-//					eDebug("[EPGC] delete old event (timeMap)");
-					updated = true;
-				}
+				if ( tmMap.find(it->second.first) == tmMap.end() )
+					i->second.erase(it++);
 				else
-					++It;
+					++it;
 			}
+			if ( i->second.size() )
+				++i;
+			else
+				x->second.erase(i++);
+		}
+	}
+}
+#endif
+
+// removes the expired events of one service and returns when the next one expires, 0 when the service is empty
+time_t eEPGCache::expireEvents(eventCache::iterator DBIt, time_t now)
+{
+	time_t expires = 0;
+	timeMap &tmMap = DBIt->second.second;
+	eventMap &evMap = DBIt->second.first;
+	std::vector<eventData*> removed;
+	// the kept entries are moved down over the removed ones and the rest is erased at once
+	timeMap::iterator kept = tmMap.begin();
+	timeMap::iterator It = tmMap.begin();
+	for (; It != tmMap.end() && It->first < now; ++It)
+	{
+		time_t end = It->first + It->second->getDuration();
+		if ( now > end )  // outdated normal entry (nvod references to)
+			removed.push_back(It->second);
+		else
+		{
+			if (!expires || end < expires)
+				expires = end;
+			*kept++ = *It;
+		}
+	}
+	tmMap.erase(kept, It);
+	// the following events start later.. only overlapping ones can end before the first of them,
+	// those just stay a little longer
+	if (It != tmMap.end())
+	{
+		time_t end = It->first + It->second->getDuration();
+		if (!expires || end < expires)
+			expires = end;
+	}
+	if (removed.empty())
+		return expires;
+	// one pass over the eventmap instead of an erase (which moves the rest) per event
+	std::sort(removed.begin(), removed.end());
+	std::vector<__u16> ids;
+	eventMap::iterator evKept = evMap.begin();
+	for (eventMap::iterator i = evMap.begin(); i != evMap.end(); ++i)
+	{
+		if (!std::binary_search(removed.begin(), removed.end(), i->second))
+			*evKept++ = *i;
+		else
+			ids.push_back(i->first);
+	}
+	evMap.erase(evKept, evMap.end());
+	if (!m_replaying)
+		m_journal.addRemove(DBIt->first.sid, DBIt->first.onid, DBIt->first.tsid, ids);
+	m_sectionCRCs.invalidate(DBIt->first.sid);
+	for (std::vector<eventData*>::iterator i = removed.begin(); i != removed.end(); ++i)
+		delete *i;
+#ifdef ENABLE_PRIVATE_EPG
+	cleanContentTimeTable(DBIt->first, tmMap);
+#endif
+	return expires;
+}
+
+void eEPGCache::cleanLoop()
+{
+	{
+		eEPGWriteLocker s(cache_lock);
+		removeCorruptFiles();
+		// the removed titles are dropped from the index here and not in the destructor
+		// of the event, then all titles are indexed again like the new ones
+		if (eventData::titleIndex.needsCompact())
+			eventData::titleIndex.compact();
+	}
+	// index the titles added since the last run, a few per lock
+	bool more;
+	do
+	{
+		eEPGWriteLocker s(cache_lock);
+		more = eventData::titleIndex.update(INDEX_TITLES);
+	}
+	while (more);
+	time_t now = ::time(0) - historySeconds;
+	int visited, expired = 0, queued = 0;
+	do
+	{
+		// only a few services per lock, so the lookups get in between
+		eEPGWriteLocker s(cache_lock);
+		for (visited = 0; visited < CLEAN_SERVICES && !m_expiryQueue.empty() && m_expiryQueue.top().first < now; ++visited)
+		{
+			expiryEntry entry = m_expiryQueue.top();
+			m_expiryQueue.pop();
+			expiryMap::iterator t = m_expiryTimes.find(entry.second);
+			if (t == m_expiryTimes.end() || t->second != entry.first)
+				continue;  // flushed or queued again for an earlier time
+			m_expiryTimes.erase(t);
+			eventCache::iterator DBIt = eventDB.find(entry.second);
+			if (DBIt == eventDB.end())
+				continue;
+			time_t expires = expireEvents(DBIt, now);
+			if (expires)
+				scheduleExpiry(entry.second, expires);
+			++expired;
+		}
+		queued = m_expiryQueue.size();
+	}
+	while (visited == CLEAN_SERVICES);
+	if (expired)
+		eDebug("[EPGC] cleaned %d services, %d queued", expired, queued);
+	enforceMemoryLimit();
+	compressDescriptors();
+	if (m_statisticsInterval && ::time(0) - m_lastStatistics >= m_statisticsInterval)
+	{
+		m_lastStatistics = ::time(0);
+		dumpIngestStatistics();
+	}
+	cleanTimer->start(CLEAN_INTERVAL,true);
+}
+
+// how far the events are kept when the memory gets short, per step
+static const time_t evictHorizons[] = { 7*24*3600, 3*24*3600, 24*3600, 6*3600, 0 };
+// the preferred services keep at least six hours, the others at least the running event
+static const int evictSteps[3] = { 5, 5, 4 };
+
+size_t eEPGCache::memoryUsage() const
+{
+	eEPGAllocator::statistics events, descriptors;
+	eventData::eventMemory.getStatistics(events);
+	eventData::descriptorMemory.getStatistics(descriptors);
+	// the used bytes, the slabs only go back to the system when they are completely free
+	return events.bytesUsed + descriptors.bytesUsed + eventData::descriptors.memoryUsage() + eventData::titleIndex.memoryUsage() +
+		eventData::compressor.memoryUsage();
+}
+
+int eEPGCache::servicePriority(const uniqueEPGKey &service) const
+{
+	if (m_preferredServices.find(service) != m_preferredServices.end())
+		return 2;
+	if (m_viewedServices.find(service) != m_viewedServices.end())
+		return 1;
+	return 0;
+}
+
+// the events of the service starting at or after the returned time are not cached, -1 = no limit
+time_t eEPGCache::evictionLimit(const uniqueEPGKey &service, time_t now) const
+{
+	int step = m_evictStep[servicePriority(service)];
+	return step ? now + evictHorizons[step - 1] : -1;
+}
+
+// removes the events of one service starting at or after limit, returns how many
+int eEPGCache::evictEvents(eventCache::iterator DBIt, time_t limit)
+{
+	eventMap &evMap = DBIt->second.first;
+	timeMap &tmMap = DBIt->second.second;
+	timeMap::iterator first = tmMap.lower_bound(limit);
+	if (first == tmMap.end())
+		return 0;
+	std::vector<eventData*> removed;
+	removed.reserve(tmMap.end() - first);
+	for (timeMap::iterator It = first; It != tmMap.end(); ++It)
+		removed.push_back(It->second);
+	std::sort(removed.begin(), removed.end());
+	std::vector<__u16> ids;
+	eventMap::iterator kept = evMap.begin();
+	for (eventMap::iterator It = evMap.begin(); It != evMap.end(); ++It)
+	{
+		if (!std::binary_search(removed.begin(), removed.end(), It->second))
+			*kept++ = *It;
+		else
+			ids.push_back(It->first);
+	}
+	evMap.erase(kept, evMap.end());
+	if (!m_replaying)
+		m_journal.addRemove(DBIt->first.sid, DBIt->first.onid, DBIt->first.tsid, ids);
+	m_sectionCRCs.invalidate(DBIt->first.sid);
+	tmMap.erase(first, tmMap.end());
+	for (std::vector<eventData*>::iterator It = removed.begin(); It != removed.end(); ++It)
+		delete *It;
 #ifdef ENABLE_PRIVATE_EPG
-			if ( updated )
+	cleanContentTimeTable(DBIt->first, tmMap);
+#endif
+	return removed.size();
+}
+
+/*
+ * Cuts the future events of the lowest priority services, step by step, until
+ * the cache is 1/8 below the limit. sectionRead skips the events beyond the
+ * horizon of their service from then on. When the cache shrank to 3/4 of the
+ * limit (the events expire) the last step is taken back, but at most once per
+ * UPDATE_INTERVAL, and the sections are parsed again.
+ */
+void eEPGCache::enforceMemoryLimit()
+{
+	eEPGWriteLocker s(cache_lock);
+	if (m_reparse)
+	{
+		m_sectionCRCs.clear();
+		m_reparse = false;
+	}
+	// the freed blocks are deferred while a snapshot is written, the usage wouldn't go down
+	if (!m_memoryLimit || eventData::snapshots)
+		return;
+	size_t used = memoryUsage();
+	time_t now = ::time(0);
+	if (used > m_memoryLimit)
+	{
+		size_t target = m_memoryLimit - m_memoryLimit / 8;
+		int evicted = 0;
+		for (int priority = 0; priority < 3 && used > target; ++priority)
+		{
+			while (used > target && m_evictStep[priority] < evictSteps[priority])
 			{
-				contentMaps::iterator x =
-					content_time_tables.find( DBIt->first );
-				if ( x != content_time_tables.end() )
+				time_t limit = now + evictHorizons[m_evictStep[priority]++];
+				for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end();)
 				{
-					timeMap &tmMap = DBIt->second.second;
-					for ( contentMap::iterator i = x->second.begin(); i != x->second.end(); )
+					if (servicePriority(DBIt->first) == priority)
 					{
-						for ( contentTimeMap::iterator it(i->second.begin());
-							it != i->second.end(); )
+						evicted += evictEvents(DBIt, limit);
+						if (DBIt->second.second.empty())
 						{
-							if ( tmMap.find(it->second.first) == tmMap.end() )
-								i->second.erase(it++);
-							else
-								++it;
+							m_expiryTimes.erase(DBIt->first);
+							eventDB.erase(DBIt++);
+							continue;
 						}
-						if ( i->second.size() )
-							++i;
-						else
-							x->second.erase(i++);
 					}
+					++DBIt;
 				}
+				used = memoryUsage();
 			}
-#endif
 		}
+		eDebug("[EPGC] memory limit %u kB, %d events evicted, %u kB used, eviction steps %d %d %d",
+			(unsigned int)(m_memoryLimit / 1024), evicted, (unsigned int)(used / 1024),
+			m_evictStep[0], m_evictStep[1], m_evictStep[2]);
+		if (used > m_memoryLimit)
+			eDebug("[EPGC] memory limit too small for the preferred services");
+		m_lastEvict = now;
+	}
+	else if (used < m_memoryLimit / 4 * 3 && now - m_lastEvict > UPDATE_INTERVAL / 1000)
+	{
+		for (int priority = 2; priority >= 0; --priority)
+		{
+			if (m_evictStep[priority])
+			{
+				--m_evictStep[priority];
+				eDebug("[EPGC] %u kB used, eviction steps %d %d %d", (unsigned int)(used / 1024),
+					m_evictStep[0], m_evictStep[1], m_evictStep[2]);
+				m_sectionCRCs.clear();
+				m_lastEvict = now;
+				break;
+			}
+		}
+	}
+}
+
+void eEPGCache::serviceViewed(eDVBServicePMTHandler *pmthandler)
+{
+	eServiceReferenceDVB ref;
+	if (pmthandler->getServiceReference(ref))
+		return;
+	// called on the main thread, the cache is locked by the epg thread
+	messages.send(Message(Message::viewedService, ref));
+}
+
+void eEPGCache::setMemoryLimit(int kbytes)
+{
+	eEPGWriteLocker s(cache_lock);
+	m_memoryLimit = kbytes > 0 ? (size_t)kbytes * 1024 : 0;
+	if (!m_memoryLimit && (m_evictStep[0] || m_evictStep[1] || m_evictStep[2]))
+	{
+		memset(m_evictStep, 0, sizeof(m_evictStep));
+		m_reparse = true;
+	}
+	m_lastEvict = 0;
+}
+
+void eEPGCache::setCompression(bool enabled)
+{
+	eEPGWriteLocker s(cache_lock);
+	if (eventData::compressor.enabled() == enabled)
+		return;
+	eventData::compressor.setEnabled(enabled);
+	m_compressPass = true;
+	m_compressPos = 0;
+}
+
+void eEPGCache::countIngest(channel_data *channel, int source, const ingestStatistics &counted)
+{
+	eSingleLocker l(m_statsLock);
+	m_sourceStats[eventOrigin(source)] += counted;
+	if (channel)
+	{
+		channel->stats += counted;
+		channel->runStats += counted;
 	}
-	cleanTimer->start(CLEAN_INTERVAL,true);
+}
+
+void eEPGCache::dumpIngest(const char *name, const ingestStatistics &st)
+{
+	eDebug("[EPGC] %s: %u sections, %u duplicates, %u unchanged, %u parsed in %llu us, events %u inserted, %u replaced, %u skipped, "
+		"%u overlap checks (%u fixed), lock waited %llu us, held %llu us",
+		name, st.sections, st.duplicates, st.unchanged, st.parsed, st.parseTime, st.inserted, st.replaced, st.skipped,
+		st.overlapChecks, st.overlapFixes, st.lockWait, st.lockHold);
+}
+
+void eEPGCache::dumpIngestStatistics()
+{
+	{
+		singleLock s(channel_map_lock);
+		eSingleLocker l(m_statsLock);
+		for (int i = 0; i < originCount; ++i)
+		{
+			if (m_sourceStats[i].sections || m_sourceStats[i].parsed)
+				dumpIngest(originNames[i], m_sourceStats[i]);
+		}
+		for (channelMapIterator it(m_knownChannels.begin()); it != m_knownChannels.end(); ++it)
+		{
+			eDVBChannelID chid = ((eDVBChannel*)it->first)->getChannelID();
+			char name[32];
+			snprintf(name, sizeof(name), "channel %04x:%04x", chid.transport_stream_id.get(), chid.original_network_id.get());
+			dumpIngest(name, it->second->stats);
+		}
+	}
+	cache_lock.dumpStatistics();
+	eEPGReadLocker s(cache_lock);
+	eventData::dumpStatistics();
+}
+
+void eEPGCache::resetIngestStatistics()
+{
+	singleLock s(channel_map_lock);
+	eSingleLocker l(m_statsLock);
+	memset(m_sourceStats, 0, sizeof(m_sourceStats));
+	for (channelMapIterator it(m_knownChannels.begin()); it != m_knownChannels.end(); ++it)
+		memset(&it->second->stats, 0, sizeof(it->second->stats));
+}
+
+void eEPGCache::setStatisticsInterval(int minutes)
+{
+	m_statisticsInterval = minutes > 0 ? minutes * 60 : 0;
+	m_lastStatistics = ::time(0);
+}
+
+// compresses or expands the descriptors stored before the compression was switched
+void eEPGCache::compressDescriptors()
+{
+	unsigned int converted = 0;
+	while (m_compressPass)
+	{
+		eEPGWriteLocker s(cache_lock);
+		bool enabled = eventData::compressor.enabled();
+		if (enabled && !eventData::compressor.trained())
+			break;  // try again when the dictionary is complete
+		eEPGDescriptorPool &pool = eventData::descriptors;
+		unsigned int end = std::min(m_compressPos + COMPRESS_SLOTS, pool.capacity());
+		for (; m_compressPos < end; ++m_compressPos)
+		{
+			eEPGDescriptorPool::entry *e = pool.slot(m_compressPos);
+			// the descriptors of a mapped epg.dat are page cache, not heap
+			if (!e || eventData::mappedFile.contains(e->data) || eEPGCompressor::isCompressed(e->data) == enabled)
+				continue;
+			int len = e->data[1]+2;
+			__u8 *d;
+			if (enabled)
+				d = eventData::compressor.compress(e->data, eventData::descriptorMemory);
+			else
+			{
+				d = (__u8*)eventData::descriptorMemory.alloc(eEPGCompressor::length(e->data));
+				if (d && !eventData::compressor.expand(e->data, d))
+				{
+					eventData::descriptorMemory.free(d, eEPGCompressor::length(e->data));
+					d = 0;
+				}
+			}
+			if (!d)
+				continue;
+			eventData::releaseBlock(e->data, len, true);
+			e->data = d;
+			eventData::CacheSize += d[1]+2 - len;
+			++converted;
+		}
+		if (m_compressPos >= pool.capacity())
+		{
+			m_compressPass = false;
+			m_compressPos = 0;
+			if (!enabled)
+				eventData::compressor.clear();
+		}
+	}
+	if (converted)
+		eDebug("[EPGC] %s %u descriptors", eventData::compressor.enabled() ? "compressed" : "expanded", converted);
 }
 
 eEPGCache::~eEPGCache()
 {
 	messages.send(Message::quit);
 	kill(); // waiting for thread shutdown
-	singleLock s(cache_lock);
+	waitSave();
+	eEPGWriteLocker s(cache_lock);
 	for (eventCache::iterator evIt = eventDB.begin(); evIt != eventDB.end(); evIt++)
 		for (eventMap::iterator It = evIt->second.first.begin(); It != evIt->second.first.end(); It++)
 			delete It->second;
@@ -1150,6 +1807,14 @@ void eEPGCache::gotMessage( const Message &msg )
 		case Message::timeChanged:
 			cleanLoop();
 			break;
+		case Message::viewedService:
+		{
+			eEPGWriteLocker s(cache_lock);
+			// the viewed services may keep more events now
+			if (m_viewedServices.insert(msg.service).second && m_evictStep[0] > m_evictStep[1])
+				m_reparse = true;
+			break;
+		}
 		default:
 			eDebug("unhandled EPGCache Message!!");
 			break;
@@ -1162,8 +1827,20 @@ void eEPGCache::thread()
 	m_running = true;
 	nice(4);
 	load();
+	{
+		eEPGWriteLocker s(cache_lock);
+		m_savedChanges = eventData::changes; // nothing to save yet
+		scheduleExpiry();
+	}
+	replayJournal();
 	cleanLoop();
+	saveTimer->start(SAVE_INTERVAL);
+	journalTimer->start(JOURNAL_INTERVAL);
 	runLoop();
+	journalTimer->stop();
+	saveTimer->stop();
+	flushJournal();
+	// the periodic saves keep epg.dat recent.. only write what changed since the last one
 	save();
 	m_running = false;
 }
@@ -1172,6 +1849,7 @@ void eEPGCache::load()
 {
 	if (m_filename.empty())
 		m_filename = "/hdd/epg.dat";
+	m_journal.setFilename(m_filename + ".journal");
 	std::string filenamex = m_filename + ".loading";
 	const char* EPGDATX = filenamex.c_str();
 	const char* EPGDAT = m_filename.c_str();
@@ -1196,9 +1874,27 @@ void eEPGCache::load()
 			}
 			char text1[13];
 			fread( text1, 13, 1, f);
-			if ( !memcmp( text1, "ENIGMA_EPG_V7", 13) )
+			if ( !memcmp( text1, "ENIGMA_EPG_V8", 13) )
 			{
-				singleLock s(cache_lock);
+				if (loadMapped(f, cnt))
+				{
+					{
+						eEPGWriteLocker s(cache_lock);
+						indexTitles();
+					}
+					eDebug("[EPGC] %d events mapped from %s", cnt, EPGDAT);
+					eventData::dumpStatistics();
+				}
+				else
+				{
+					eDebug("[EPGC] epg file is corrupt.. dont read it");
+					fclose(f);
+					return;
+				}
+			}
+			else if ( !memcmp( text1, "ENIGMA_EPG_V7", 13) )
+			{
+				eEPGWriteLocker s(cache_lock);
 				fread( &size, sizeof(int), 1, f);
 				while(size--)
 				{
@@ -1216,7 +1912,7 @@ void eEPGCache::load()
 						fread( &type, sizeof(__u8), 1, f);
 						fread( &len, sizeof(__u8), 1, f);
 						event = new eventData(0, len, type);
-						event->EITdata = new __u8[len];
+						event->EITdata = (__u8*)eventData::eventMemory.alloc(len);
 						eventData::CacheSize+=len;
 						fread( event->EITdata, len, 1, f);
 						evMap[ event->getEventID() ]=event;
@@ -1226,48 +1922,16 @@ void eEPGCache::load()
 					eventDB[key]=std::pair<eventMap,timeMap>(evMap,tmMap);
 				}
 				eventData::load(f);
+				indexTitles();
 				eDebug("[EPGC] %d events read from %s", cnt, EPGDAT);
+				eventData::dumpStatistics();
 #ifdef ENABLE_PRIVATE_EPG
-				char text2[11];
-				fread( text2, 11, 1, f);
-				if ( !memcmp( text2, "PRIVATE_EPG", 11) )
-				{
-					size=0;
-					fread( &size, sizeof(int), 1, f);
-					while(size--)
-					{
-						int size=0;
-						uniqueEPGKey key;
-						fread( &key, sizeof(uniqueEPGKey), 1, f);
-						eventMap &evMap=eventDB[key].first;
-						fread( &size, sizeof(int), 1, f);
-						while(size--)
-						{
-							int size;
-							int content_id;
-							fread( &content_id, sizeof(int), 1, f);
-							fread( &size, sizeof(int), 1, f);
-							while(size--)
-							{
-								time_t time1, time2;
-								__u16 event_id;
-								fread( &time1, sizeof(time_t), 1, f);
-								fread( &time2, sizeof(time_t), 1, f);
-								fread( &event_id, sizeof(__u16), 1, f);
-								content_time_tables[key][content_id][time1]=std::pair<time_t, __u16>(time2, event_id);
-								eventMap::iterator it =
-									evMap.find(event_id);
-								if (it != evMap.end())
-									it->second->type = PRIVATE;
-							}
-						}
-					}
-				}
-#endif // ENABLE_PRIVATE_EPG
+				loadPrivateEPG(f);
+#endif
+				posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
 			}
 			else
 				eDebug("[EPGC] don't read old epg database");
-			posix_fadvise(fileno(f), 0, 0, POSIX_FADV_DONTNEED);
 			fclose(f);
 			// We got this far, so the EPG file is okay.
 			if (renameResult == 0)
@@ -1279,110 +1943,395 @@ void eEPGCache::load()
 	}
 }
 
-void eEPGCache::save()
+// the titles of the loaded descriptors get the tsid/onid of the first service using them
+void eEPGCache::indexTitles()
 {
-	const char* EPGDAT = m_filename.c_str();
-	if (eventData::isCacheCorrupt)
-		return;
-	// only save epg.dat if it's worth the trouble...
-	if (eventData::CacheSize < 10240)
-		return;
-
-	/* create empty file */
-	FILE *f = fopen(EPGDAT, "w");
-	if (!f)
+	for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end(); ++DBIt)
 	{
-		eDebug("[EPGC] couldn't save epg data to '%s'(%m)", EPGDAT);
-		return;
+		int tsidonid = (DBIt->first.tsid << 16) | DBIt->first.onid;
+		timeMap &tmMap = DBIt->second.second;
+		for (timeMap::iterator It = tmMap.begin(); It != tmMap.end(); ++It)
+			eventData::indexTitles(It->second, tsidonid);
 	}
+}
 
-	char* buf = realpath(EPGDAT, NULL);
-	if (!buf)
+bool eEPGCache::loadMapped(FILE *f, int &cnt)
+{
+	eEPGMappedFile &file = eventData::mappedFile;
+	if (file.map(fileno(f)))
+		return false;
+	const epgFileHeader *header = (const epgFileHeader*)file.data();
+	const epgFileService *services = (const epgFileService*)
+		file.at(header->serviceIndexOffset, (__u64)header->serviceCount * sizeof(epgFileService));
+	const __u8 *events = file.at(header->eventOffset, header->eventSize);
+	if (header->headerSize != EPG_FILE_HEADER_SIZE || header->fileSize != file.size() || !services || !events)
 	{
-		eDebug("[EPGC] realpath to '%s' failed in save (%m)", EPGDAT);
-		fclose(f);
-		return;
+		file.unmap();
+		return false;
 	}
 
-	eDebug("[EPGC] store epg to realpath '%s'", buf);
+	// check all event records before anything is put into the cache
+	for (unsigned int i = 0; i < header->serviceCount; ++i)
+	{
+		__u64 pos = services[i].eventOffset;
+		for (unsigned int n = 0; n < services[i].eventCount; ++n)
+		{
+			if (pos + 2 > header->eventSize || events[pos+1] < 10 || pos + epgFileRecordSize(events[pos+1]) > header->eventSize)
+			{
+				file.unmap();
+				return false;
+			}
+			pos += epgFileRecordSize(events[pos+1]);
+		}
+	}
 
-	struct statfs s;
-	off64_t tmp;
-	if (statfs(buf, &s) < 0) {
-		eDebug("[EPGC] statfs '%s' failed in save (%m)", buf);
-		fclose(f);
-		free(buf);
-		return;
+	eEPGWriteLocker s(cache_lock);
+	if (!eventData::loadMapped(header))
+	{
+		file.unmap();
+		return false;
 	}
+	std::vector<std::pair<__u16, eventData*> > ids;
+	std::vector<std::pair<time_t, eventData*> > times;
+	for (unsigned int i = 0; i < header->serviceCount; ++i)
+	{
+		std::pair<eventMap,timeMap> &servicemap = eventDB[uniqueEPGKey(services[i].sid, services[i].onid, services[i].tsid)];
+		const __u8 *record = events + services[i].eventOffset;
+		ids.clear();
+		times.clear();
+		for (unsigned int n = 0; n < services[i].eventCount; ++n)
+		{
+			eventData *event = new eventData(0, record[1], record[0]);
+			event->EITdata = (__u8*)record + 2;
+			eventData::CacheSize += record[1];
+			file.ref();
+			ids.push_back(std::pair<__u16, eventData*>(event->getEventID(), event));
+			times.push_back(std::pair<time_t, eventData*>(event->getStartTime(), event));
+			record += epgFileRecordSize(record[1]);
+			++cnt;
+		}
+		// the records are written in time order, so sorting the times costs nothing
+		std::sort(ids.begin(), ids.end());
+		std::sort(times.begin(), times.end());
+		servicemap.first.merge(ids);
+		servicemap.second.merge(times);
+	}
+#ifdef ENABLE_PRIVATE_EPG
+	if (header->privateOffset && !fseeko(f, header->privateOffset, SEEK_SET))
+		loadPrivateEPG(f);
+#endif
+	if (!file.refcount())
+		file.unmap();
+	return true;
+}
 
-	free(buf);
+#ifdef ENABLE_PRIVATE_EPG
+void eEPGCache::loadPrivateEPG(FILE *f)
+{
+	char text2[11];
+	fread( text2, 11, 1, f);
+	if ( !memcmp( text2, "PRIVATE_EPG", 11) )
+	{
+		eEPGWriteLocker s(cache_lock);
+		int size=0;
+		fread( &size, sizeof(int), 1, f);
+		while(size--)
+		{
+			int size=0;
+			uniqueEPGKey key;
+			fread( &key, sizeof(uniqueEPGKey), 1, f);
+			eventMap &evMap=eventDB[key].first;
+			fread( &size, sizeof(int), 1, f);
+			while(size--)
+			{
+				int size;
+				int content_id;
+				fread( &content_id, sizeof(int), 1, f);
+				fread( &size, sizeof(int), 1, f);
+				while(size--)
+				{
+					time_t time1, time2;
+					__u16 event_id;
+					fread( &time1, sizeof(time_t), 1, f);
+					fread( &time2, sizeof(time_t), 1, f);
+					fread( &event_id, sizeof(__u16), 1, f);
+					content_time_tables[key][content_id][time1]=std::pair<time_t, __u16>(time2, event_id);
+					eventMap::iterator it =
+						evMap.find(event_id);
+					if (it != evMap.end())
+						it->second->type = PRIVATE;
+				}
+			}
+		}
+	}
+}
+#endif
 
-	// check for enough free space on storage
-	tmp=s.f_bfree;
-	tmp*=s.f_bsize;
-	if ( tmp < (eventData::CacheSize*12)/10 ) // 20% overhead
+#define SET_HILO(x, val) {x##_hi = ((val) >> 8); x##_lo = (val) & 0xff; }
+// the journaled events are fed to sectionRead again, so updates and overlaps are handled like on air
+// removes the events with the given ids of one service
+void eEPGCache::removeEvents(const uniqueEPGKey &service, const std::vector<__u16> &ids)
+{
+	eEPGWriteLocker s(cache_lock);
+	eventCache::iterator DBIt = eventDB.find(service);
+	if (DBIt == eventDB.end())
+		return;
+	eventMap &evMap = DBIt->second.first;
+	timeMap &tmMap = DBIt->second.second;
+	for (std::vector<__u16>::const_iterator it(ids.begin()); it != ids.end(); ++it)
+	{
+		eventMap::iterator ev_it = evMap.find(*it);
+		if (ev_it == evMap.end())
+			continue;
+		eventData *evt = ev_it->second;
+		timeMap::iterator tm_it = tmMap.find(evt->getStartTime());
+		if (tm_it != tmMap.end() && tm_it->second == evt)
+			tmMap.erase(tm_it);
+		evMap.erase(ev_it);
+		delete evt;
+	}
+	m_sectionCRCs.invalidate(service.sid);
+#ifdef ENABLE_PRIVATE_EPG
+	cleanContentTimeTable(service, tmMap);
+#endif
+	if (tmMap.empty() && evMap.empty())
 	{
-		eDebug("[EPGC] not enough free space at path '%s' %lld bytes availd but %d needed", buf, tmp, (eventData::CacheSize*12)/10);
-		fclose(f);
+		m_expiryTimes.erase(service);
+		eventDB.erase(DBIt);
+	}
+}
+
+void eEPGCache::replayJournal()
+{
+	std::vector<__u8> records;
+	int batches = m_journal.read(records);
+	if (!batches)
 		return;
+	int events = 0;
+	__u8 data[EIT_SIZE + 4108 + 4];
+	eit_t *packet = (eit_t *) data;
+	memset(data, 0, EIT_SIZE);
+	packet->table_id = 0x50;
+	packet->section_syntax_indicator = 1;
+	packet->segment_last_table_id = 0x50;
+	m_replaying = true;
+	size_t pos = 0;
+	while (pos < records.size())
+	{
+		__u16 hdr[4];
+		if (records[pos] == eEPGJournal::recordEvent && pos + 10 <= records.size())
+		{
+			int source = records[pos+1];
+			memcpy(hdr, &records[pos+2], sizeof(hdr));
+			pos += 10;
+			if (hdr[3] > 4108 || pos + hdr[3] > records.size())
+				break;
+			SET_HILO(packet->service_id, hdr[0]);
+			SET_HILO(packet->original_network_id, hdr[1]);
+			SET_HILO(packet->transport_stream_id, hdr[2]);
+			SET_HILO(packet->section_length, EIT_SIZE + hdr[3] + 1);
+			memcpy(data + EIT_SIZE, &records[pos], hdr[3]);
+			sectionRead(data, source, 0);
+			pos += hdr[3];
+			++events;
+		}
+		else if (records[pos] == eEPGJournal::recordFlush && pos + 7 <= records.size())
+		{
+			memcpy(hdr, &records[pos+1], 3 * sizeof(__u16));
+			pos += 7;
+			flushEPG(uniqueEPGKey(hdr[0], hdr[1], hdr[2]));
+		}
+		else if (records[pos] == eEPGJournal::recordFlushAll)
+		{
+			++pos;
+			// service by service, flushEPG() of everything would restart the running channels
+			eEPGWriteLocker s(cache_lock);
+			std::vector<uniqueEPGKey> services;
+			for (eventCache::iterator it(eventDB.begin()); it != eventDB.end(); ++it)
+				services.push_back(it->first);
+			for (std::vector<uniqueEPGKey>::iterator it(services.begin()); it != services.end(); ++it)
+				flushEPG(*it);
+		}
+		else if (records[pos] == eEPGJournal::recordRemove && pos + 9 <= records.size())
+		{
+			memcpy(hdr, &records[pos+1], sizeof(hdr));
+			pos += 9;
+			if (pos + hdr[3] * sizeof(__u16) > records.size())
+				break;
+			std::vector<__u16> ids(hdr[3]);
+			if (hdr[3])
+				memcpy(&ids[0], &records[pos], hdr[3] * sizeof(__u16));
+			pos += hdr[3] * sizeof(__u16);
+			removeEvents(uniqueEPGKey(hdr[0], hdr[1], hdr[2]), ids);
+		}
+		else
+			break;
 	}
+	m_replaying = false;
+	eDebug("[EPGC] %d events replayed from %d journal batches", events, batches);
+}
+#undef SET_HILO
 
-	int cnt=0;
-	unsigned int magic = 0x98765432;
-	fwrite( &magic, sizeof(int), 1, f);
-	const char *text = "UNFINISHED_V7";
-	fwrite( text, 13, 1, f );
-	int size = eventDB.size();
-	fwrite( &size, sizeof(int), 1, f );
+void eEPGCache::flushJournal()
+{
+	m_journal.flush();
+}
+
+#ifdef ENABLE_PRIVATE_EPG
+static void appendData(std::vector<__u8> &v, const void *data, int len)
+{
+	v.insert(v.end(), (const __u8*)data, (const __u8*)data + len);
+}
+#endif
+
+// called with the cache lock held.. only collects pointers, the blocks are kept until the snapshot is released
+void eEPGCache::takeSnapshot(eEPGSnapshot &snapshot)
+{
+	snapshot.cacheSize = eventData::CacheSize;
+	snapshot.services.reserve(eventDB.size());
 	for (eventCache::iterator service_it(eventDB.begin()); service_it != eventDB.end(); ++service_it)
 	{
 		timeMap &timemap = service_it->second.second;
-		fwrite( &service_it->first, sizeof(uniqueEPGKey), 1, f);
-		size = timemap.size();
-		fwrite( &size, sizeof(int), 1, f);
+		eEPGSnapshot::service service;
+		service.sid = service_it->first.sid;
+		service.onid = service_it->first.onid;
+		service.tsid = service_it->first.tsid;
+		service.eventCount = timemap.size();
+		snapshot.services.push_back(service);
 		for (timeMap::iterator time_it(timemap.begin()); time_it != timemap.end(); ++time_it)
 		{
-			__u8 len = time_it->second->ByteSize;
-			fwrite( &time_it->second->type, sizeof(__u8), 1, f );
-			fwrite( &len, sizeof(__u8), 1, f);
-			fwrite( time_it->second->EITdata, len, 1, f);
-			++cnt;
+			eEPGSnapshot::event event;
+			event.data = time_it->second->EITdata;
+			event.len = time_it->second->ByteSize;
+			event.type = time_it->second->type;
+			snapshot.events.push_back(event);
+		}
+	}
+	snapshot.descriptors.reserve(eventData::descriptors.size());
+	size_t expanded = 0;
+	for (eEPGDescriptorPool::iterator it(eventData::descriptors.begin()); it != eventData::descriptors.end(); ++it)
+		if (eEPGCompressor::isCompressed(it->data))
+			expanded += eEPGCompressor::length(it->data);
+	snapshot.expanded.resize(expanded);  // the pointers into it must not move
+	expanded = 0;
+	for (eEPGDescriptorPool::iterator it(eventData::descriptors.begin()); it != eventData::descriptors.end(); ++it)
+	{
+		eEPGSnapshot::descriptor descr;
+		descr.crc = it->crc;
+		descr.refcount = it->refcount;
+		descr.data = it->data;
+		if (eEPGCompressor::isCompressed(it->data))
+		{
+			__u8 *d = &snapshot.expanded[expanded];
+			if (!eventData::compressor.expand(it->data, d))
+			{
+				eventData::cacheCorrupt("eEPGCache::takeSnapshot");
+				continue;
+			}
+			expanded += eEPGCompressor::length(it->data);
+			descr.data = d;
 		}
+		snapshot.descriptors.push_back(descr);
 	}
-	eDebug("[EPGC] %d events written to %s", cnt, EPGDAT);
-	eventData::save(f);
 #ifdef ENABLE_PRIVATE_EPG
-	const char* text3 = "PRIVATE_EPG";
-	fwrite( text3, 11, 1, f );
-	size = content_time_tables.size();
-	fwrite( &size, sizeof(int), 1, f);
+	std::vector<__u8> &v = snapshot.privateData;
+	appendData(v, "PRIVATE_EPG", 11);
+	int size = content_time_tables.size();
+	appendData(v, &size, sizeof(int));
 	for (contentMaps::iterator a = content_time_tables.begin(); a != content_time_tables.end(); ++a)
 	{
 		contentMap &content_time_table = a->second;
-		fwrite( &a->first, sizeof(uniqueEPGKey), 1, f);
+		appendData(v, &a->first, sizeof(uniqueEPGKey));
 		int size = content_time_table.size();
-		fwrite( &size, sizeof(int), 1, f);
+		appendData(v, &size, sizeof(int));
 		for (contentMap::iterator i = content_time_table.begin(); i != content_time_table.end(); ++i )
 		{
 			int size = i->second.size();
-			fwrite( &i->first, sizeof(int), 1, f);
-			fwrite( &size, sizeof(int), 1, f);
+			appendData(v, &i->first, sizeof(int));
+			appendData(v, &size, sizeof(int));
 			for ( contentTimeMap::iterator it(i->second.begin());
 				it != i->second.end(); ++it )
 			{
-				fwrite( &it->first, sizeof(time_t), 1, f);
-				fwrite( &it->second.first, sizeof(time_t), 1, f);
-				fwrite( &it->second.second, sizeof(__u16), 1, f);
+				appendData(v, &it->first, sizeof(time_t));
+				appendData(v, &it->second.first, sizeof(time_t));
+				appendData(v, &it->second.second, sizeof(__u16));
 			}
 		}
 	}
 #endif
-	// write version string after binary data
-	// has been written to disk.
-	fsync(fileno(f));
-	fseek(f, sizeof(int), SEEK_SET);
-	fwrite("ENIGMA_EPG_V7", 13, 1, f);
-	fclose(f);
+	++eventData::snapshots;
+	m_savedChanges = eventData::changes;
+}
+
+void eEPGCache::writeSnapshot()
+{
+	if (!m_snapshot.write(m_saveFilename.c_str()))
+		m_journal.removeRotated();
+	eEPGWriteLocker s(cache_lock);
+	eventData::releaseSnapshot();
+	m_snapshot.clear();
+	m_saving = false;
+	cache_lock.dumpStatistics();
+}
+
+void eEPGCache::saveThread::thread()
+{
+	hasStarted();
+	nice(10);
+	setIoPrio(IOPRIO_CLASS_IDLE);
+	cache->writeSnapshot();
+}
+
+// starts a background save.. returns false when there is nothing to do or a save is still running
+bool eEPGCache::startSave()
+{
+	eEPGWriteLocker s(cache_lock);
+	if (m_saving || eventData::isCacheCorrupt)
+		return false;
+	// only save epg.dat if it's worth the trouble...
+	if (eventData::CacheSize < 10240 || eventData::changes == m_savedChanges)
+		return false;
+	m_saveThread.kill(); // join the last one.. it is finished already
+	m_saveFilename = m_filename;
+	takeSnapshot(m_snapshot);
+	// everything journaled so far is in the snapshot now
+	m_journal.flush();
+	m_journal.rotate();
+	m_saving = true;
+	eDebug("[EPGC] %u events in snapshot, writing in background", (unsigned int)m_snapshot.events.size());
+	m_saveThread.runAsync();
+	return true;
+}
+
+// waits until a running background save is finished
+void eEPGCache::waitSave()
+{
+	while (1)
+	{
+		{
+			eEPGWriteLocker s(cache_lock);
+			if (!m_saving)
+			{
+				m_saveThread.kill(); // just joins, it is done
+				return;
+			}
+		}
+		usleep(50000);
+	}
+}
+
+// writes epg.dat and returns when it is written.. a running background save is finished first
+void eEPGCache::save()
+{
+	waitSave();
+	if (startSave())
+		waitSave();
+}
+
+// writes epg.dat in the background, when it is worth it
+void eEPGCache::saveAsync()
+{
+	startSave();
 }
 
 eEPGCache::channel_data::channel_data(eEPGCache *ml)
@@ -1405,6 +2354,8 @@ eEPGCache::channel_data::channel_data(eEPGCache *ml)
 	CONNECT(startPrivateTimer->timeout, eEPGCache::channel_data::startPrivateReader);
 #endif
 	pthread_mutex_init(&channel_active, 0);
+	memset(&stats, 0, sizeof(stats));
+	memset(&runStats, 0, sizeof(runStats));
 }
 
 bool eEPGCache::channel_data::finishEPG()
@@ -1412,20 +2363,24 @@ bool eEPGCache::channel_data::finishEPG()
 	if (!isRunning)  // epg ready
 	{
 		eDebug("[EPGC] stop caching events(%ld)", ::time(0));
-		zapTimer->start(UPDATE_INTERVAL, 1);
-		eDebug("[EPGC] next update in %i min", UPDATE_INTERVAL / 60000);
-		for (unsigned int i=0; i < sizeof(seenSections)/sizeof(tidMap); ++i)
+		ingestStatistics run;
 		{
-			seenSections[i].clear();
-			calcedSections[i].clear();
+			eSingleLocker l(cache->m_statsLock);
+			run = runStats;
 		}
+		eDebug("[EPGC] %u sections received, %u duplicates, %u unchanged, %u parsed (%u section crcs)",
+			run.sections, run.duplicates, run.unchanged, run.parsed, cache->m_sectionCRCs.size());
+		zapTimer->start(UPDATE_INTERVAL, 1);
+		eDebug("[EPGC] next update in %i min", UPDATE_INTERVAL / 60000);
+		for (unsigned int i=0; i < sizeof(sections)/sizeof(eEPGSectionMap); ++i)
+			sections[i].clear();
 #ifdef ENABLE_MHW_EPG
 		cleanupMHW();
 #endif
 #ifdef ENABLE_FREESAT
 		cleanupFreeSat();
 #endif
-		singleLock l(cache->cache_lock);
+		eEPGWriteLocker l(cache->cache_lock);
 		cache->channelLastUpdated[channel->getChannelID()] = ::time(0);
 		return true;
 	}
@@ -1437,11 +2392,12 @@ void eEPGCache::channel_data::startEPG()
 	eDebug("[EPGC] start caching events(%ld)", ::time(0));
 	state=0;
 	haveData=0;
-	for (unsigned int i=0; i < sizeof(seenSections)/sizeof(tidMap); ++i)
 	{
-		seenSections[i].clear();
-		calcedSections[i].clear();
+		eSingleLocker l(cache->m_statsLock);
+		memset(&runStats, 0, sizeof(runStats));
 	}
+	for (unsigned int i=0; i < sizeof(sections)/sizeof(eEPGSectionMap); ++i)
+		sections[i].clear();
 #ifdef ENABLE_MHW_EPG
 		cleanupMHW();
 #endif
@@ -1642,11 +2598,8 @@ void eEPGCache::channel_data::abortNonAvail()
 		else
 		{
 			++state;
-			for (unsigned int i=0; i < sizeof(seenSections)/sizeof(tidMap); ++i)
-			{
-				seenSections[i].clear();
-				calcedSections[i].clear();
-			}
+			for (unsigned int i=0; i < sizeof(sections)/sizeof(eEPGSectionMap); ++i)
+				sections[i].clear();
 #ifdef ENABLE_MHW_EPG
 			cleanupMHW();
 #endif
@@ -1677,11 +2630,8 @@ void eEPGCache::channel_data::startChannel()
 
 void eEPGCache::channel_data::abortEPG()
 {
-	for (unsigned int i=0; i < sizeof(seenSections)/sizeof(tidMap); ++i)
-	{
-		seenSections[i].clear();
-		calcedSections[i].clear();
-	}
+	for (unsigned int i=0; i < sizeof(sections)/sizeof(eEPGSectionMap); ++i)
+		sections[i].clear();
 #ifdef ENABLE_MHW_EPG
 	cleanupMHW();
 #endif
@@ -1797,9 +2747,8 @@ void eEPGCache::channel_data::readData( const __u8 *data, int source)
 			eDebug("[EPGC] unknown source");
 			return;
 	}
-	tidMap &seenSections = this->seenSections[map];
-	tidMap &calcedSections = this->calcedSections[map];
-	if ( (state == 1 && calcedSections == seenSections) || state > 1 )
+	eEPGSectionMap &sections = this->sections[map];
+	if ( (state == 1 && sections.complete()) || state > 1 )
 	{
 		eDebugNoNewLine("[EPGC] ");
 		switch (source)
@@ -1842,32 +2791,38 @@ void eEPGCache::channel_data::readData( const __u8 *data, int source)
 	else
 	{
 		eit_t *eit = (eit_t*) data;
-		__u32 sectionNo = data[0] << 24;
-		sectionNo |= data[3] << 16;
-		sectionNo |= data[4] << 8;
-		sectionNo |= eit->section_number;
-
-		tidMap::iterator it =
-			seenSections.find(sectionNo);
+		int tid = data[0];
+		int sid = (data[3] << 8) | data[4];
 
-		if ( it == seenSections.end() )
+		ingestStatistics counted;
+		memset(&counted, 0, sizeof(counted));
+		counted.sections = 1;
+		if ( sections.markSeen(tid, sid, eit->section_number) )
 		{
-			seenSections.insert(sectionNo);
-			calcedSections.insert(sectionNo);
-			__u32 tmpval = sectionNo & 0xFFFFFF00;
 			__u8 incr = source == NOWNEXT ? 1 : 8;
 			for ( int i = 0; i <= eit->last_section_number; i+=incr )
 			{
 				if ( i == eit->section_number )
 				{
 					for (int x=i; x <= eit->segment_last_section_number; ++x)
-						calcedSections.insert(tmpval|(x&0xFF));
+						sections.markExpected(tid, sid, x);
 				}
 				else
-					calcedSections.insert(tmpval|(i&0xFF));
+					sections.markExpected(tid, sid, i);
 			}
-			cache->sectionRead(data, source, this);
+			eDVBChannelID chid = channel->getChannelID();
+			if ( cache->m_sectionCRCs.unchanged(data, (chid.transport_stream_id.get() << 16) | chid.original_network_id.get()) )
+			{
+				// parsed before the reader was restarted.. the events are in the cache
+				counted.unchanged = 1;
+				haveData |= source;
+			}
+			else
+				cache->sectionRead(data, source, this);
 		}
+		else
+			counted.duplicates = 1;
+		cache->countIngest(this, source, counted);
 	}
 }
 
@@ -1945,6 +2900,9 @@ void eEPGCache::channel_data::readFreeSatScheduleOtherData( const __u8 *data)
 	__u32 subtableNo = data[0] << 24; // Table ID
 	subtableNo |= data[3] << 16; // Service ID Hi
 	subtableNo |= data[4] << 8; // Service ID Lo
+	ingestStatistics counted;
+	memset(&counted, 0, sizeof(counted));
+	counted.sections = 1;
 
 	// Check for sub-table version in map
 	std::map<__u32, freesatEITSubtableStatus> &freeSatSubTableStatus = this->m_FreeSatSubTableStatus;
@@ -1974,6 +2932,8 @@ void eEPGCache::channel_data::readFreeSatScheduleOtherData( const __u8 *data)
 			if ( fsstatus->isSectionPresent(eit->section_number) )
 			{
 //				eDebug("[EPGC] DUP FS sub/sec/ver (%x/%d/%d)", subtableNo, eit->section_number, eit->version_number);
+				counted.duplicates = 1;
+				cache->countIngest(this, FREESAT_SCHEDULE_OTHER, counted);
 				return;
 			}
 		}
@@ -1985,6 +2945,7 @@ void eEPGCache::channel_data::readFreeSatScheduleOtherData( const __u8 *data)
 	{
 		m_FreesatTablesToComplete--;
 	}
+	cache->countIngest(this, FREESAT_SCHEDULE_OTHER, counted);
 	cache->sectionRead(data, FREESAT_SCHEDULE_OTHER, this);
 }
 #endif
@@ -2006,10 +2967,9 @@ RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, co
 		{
 			if ( direction < 0 || (direction == 0 && i->first > t) )
 			{
-				timeMap::iterator x = i;
-				--x;
-				if ( x != It->second.second.end() )
+				if ( i != It->second.second.begin() )
 				{
+					timeMap::iterator x = i - 1;
 					time_t start_time = x->first;
 					if (direction >= 0)
 					{
@@ -2032,36 +2992,38 @@ RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, co
 
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, const eit_event_struct *&result, int direction)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventTime(service, t, data, direction);
 	if ( !ret && data )
-		result = data->get();
+		result = data->get(tsidOnid(service));
 	return ret;
 }
 
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, Event *& result, int direction)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventTime(service, t, data, direction);
 	if ( !ret && data )
-		result = new Event((uint8_t*)data->get());
+	{
+		__u8 buffer[4108];
+		result = new Event((uint8_t*)data->get(buffer, tsidOnid(service)));
+	}
 	return ret;
 }
 
 RESULT eEPGCache::lookupEventTime(const eServiceReference &service, time_t t, ePtr<eServiceEvent> &result, int direction)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventTime(service, t, data, direction);
 	result = NULL;
 	if ( !ret && data )
 	{
-		Event ev((uint8_t*)data->get());
 		result = new eServiceEvent();
 		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
-		ret = result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get());
+		ret = parseEvent(*result, data, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get());
 	}
 	return ret;
 }
@@ -2090,91 +3052,133 @@ RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id,
 
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, const eit_event_struct *&result)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventId(service, event_id, data);
 	if ( !ret && data )
-		result = data->get();
+		result = data->get(tsidOnid(service));
 	return ret;
 }
 
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, Event *& result)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventId(service, event_id, data);
 	if ( !ret && data )
-		result = new Event((uint8_t*)data->get());
+	{
+		__u8 buffer[4108];
+		result = new Event((uint8_t*)data->get(buffer, tsidOnid(service)));
+	}
 	return ret;
 }
 
 RESULT eEPGCache::lookupEventId(const eServiceReference &service, int event_id, ePtr<eServiceEvent> &result)
 {
-	singleLock s(cache_lock);
+	eEPGReadLocker s(cache_lock);
 	const eventData *data=0;
 	RESULT ret = lookupEventId(service, event_id, data);
 	result = NULL;
 	if ( !ret && data )
 	{
-		Event ev((uint8_t*)data->get());
 		result = new eServiceEvent();
 		const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)service;
-		ret = result->parseFrom(&ev, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get());
+		ret = parseEvent(*result, data, (ref.getTransportStreamID().get()<<16)|ref.getOriginalNetworkID().get());
 	}
 	return ret;
 }
 
-RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin, int minutes)
+// the entries of a time query, the caller holds the lock
+RESULT eEPGCache::timeQueryRange(const eServiceReference &service, time_t begin, int minutes, timeMap::iterator &first, timeMap::iterator &last, int &tsidonid)
 {
-	singleLock s(cache_lock);
 	const eServiceReferenceDVB &ref = (const eServiceReferenceDVB&)handleGroup(service);
 	if (begin == -1)
 		begin = ::time(0);
 	eventCache::iterator It = eventDB.find(ref);
 	if ( It != eventDB.end() && It->second.second.size() )
 	{
-		m_timemap_cursor = It->second.second.lower_bound(begin);
-		if ( m_timemap_cursor != It->second.second.end() )
+		first = It->second.second.lower_bound(begin);
+		if ( first != It->second.second.end() )
 		{
-			if ( m_timemap_cursor->first != begin )
+			if ( first->first != begin )
 			{
-				timeMap::iterator x = m_timemap_cursor;
-				--x;
-				if ( x != It->second.second.end() )
+				if ( first != It->second.second.begin() )
 				{
+					timeMap::iterator x = first - 1;
 					time_t start_time = x->first;
 					if ( begin > start_time && begin < (start_time+x->second->getDuration()))
-						m_timemap_cursor = x;
+						first = x;
 				}
 			}
 		}
 
 		if (minutes != -1)
-			m_timemap_end = It->second.second.lower_bound(begin+minutes*60);
+			last = It->second.second.lower_bound(begin+minutes*60);
 		else
-			m_timemap_end = It->second.second.end();
+			last = It->second.second.end();
 
-		currentQueryTsidOnid = (ref.getTransportStreamID().get()<<16) | ref.getOriginalNetworkID().get();
-		return m_timemap_cursor == m_timemap_end ? -1 : 0;
+		tsidonid = (ref.getTransportStreamID().get()<<16) | ref.getOriginalNetworkID().get();
+		return first == last ? -1 : 0;
+	}
+	return -1;
+}
+
+RESULT eEPGCache::startTimeQuery(const eServiceReference &service, time_t begin, int minutes)
+{
+	eEPGReadLocker s(cache_lock);
+	timeMap::iterator first, last;
+	timeQuery &q = m_timeQuery;
+	q.active = false;
+	if (begin == -1)
+		begin = ::time(0);
+	if (timeQueryRange(service, begin, minutes, first, last, q.tsidonid))
+		return -1;
+	uniqueEPGKey key(handleGroup(service));
+	q.sid = key.sid;
+	q.onid = key.onid;
+	q.tsid = key.tsid;
+	q.next = first->first;
+	q.end = minutes != -1 ? begin + minutes * 60 : -1;
+	q.active = true;
+	return 0;
+}
+
+// the entry following the last returned one, the caller holds the lock
+const eventData *eEPGCache::nextTimeEntry()
+{
+	timeQuery &q = m_timeQuery;
+	if (!q.active)
+		return 0;
+	eventCache::iterator It = eventDB.find(uniqueEPGKey(q.sid, q.onid, q.tsid));
+	if (It != eventDB.end())
+	{
+		timeMap::iterator tm_it = It->second.second.lower_bound(q.next);
+		if (tm_it != It->second.second.end() && (q.end == -1 || tm_it->first < q.end))
+		{
+			q.next = tm_it->first + 1;
+			return tm_it->second;
+		}
 	}
-	return -1;
+	q.active = false;
+	return 0;
 }
 
+__thread eEPGCache::timeQuery eEPGCache::m_timeQuery;
+
 RESULT eEPGCache::getNextTimeEntry(const eventData *& result)
 {
-	if ( m_timemap_cursor != m_timemap_end )
-	{
-		result = m_timemap_cursor++->second;
-		return 0;
-	}
-	return -1;
+	eEPGReadLocker s(cache_lock);
+	result = nextTimeEntry();
+	return result ? 0 : -1;
 }
 
 RESULT eEPGCache::getNextTimeEntry(const eit_event_struct *&result)
 {
-	if ( m_timemap_cursor != m_timemap_end )
+	eEPGReadLocker s(cache_lock);
+	const eventData *ev = nextTimeEntry();
+	if ( ev )
 	{
-		result = m_timemap_cursor++->second->get();
+		result = ev->get(m_timeQuery.tsidonid);
 		return 0;
 	}
 	return -1;
@@ -2182,9 +3186,12 @@ RESULT eEPGCache::getNextTimeEntry(const eit_event_struct *&result)
 
 RESULT eEPGCache::getNextTimeEntry(Event *&result)
 {
-	if ( m_timemap_cursor != m_timemap_end )
+	eEPGReadLocker s(cache_lock);
+	const eventData *ev = nextTimeEntry();
+	if ( ev )
 	{
-		result = new Event((uint8_t*)m_timemap_cursor++->second->get());
+		__u8 buffer[4108];
+		result = new Event((uint8_t*)ev->get(buffer, m_timeQuery.tsidonid));
 		return 0;
 	}
 	return -1;
@@ -2192,16 +3199,17 @@ RESULT eEPGCache::getNextTimeEntry(Event *&result)
 
 RESULT eEPGCache::getNextTimeEntry(ePtr<eServiceEvent> &result)
 {
-	if ( m_timemap_cursor != m_timemap_end )
+	eEPGReadLocker s(cache_lock);
+	const eventData *ev = nextTimeEntry();
+	if ( ev )
 	{
-		Event ev((uint8_t*)m_timemap_cursor++->second->get());
 		result = new eServiceEvent();
-		return result->parseFrom(&ev, currentQueryTsidOnid);
+		return parseEvent(*result, ev, m_timeQuery.tsidonid);
 	}
 	return -1;
 }
 
-void fillTuple(ePyObject tuple, const char *argstring, int argcount, ePyObject service_reference, eServiceEvent *ptr, ePyObject service_name, ePyObject nowTime, eventData *evData )
+void fillTuple(ePyObject tuple, const char *argstring, int argcount, ePyObject service_reference, eServiceEvent *ptr, ePyObject service_name, ePyObject nowTime, const eventData *evData )
 {
 	// eDebug("[EPGC] fillTuple arg=%s argcnt=%d, ptr=%d evData=%d", argstring, argcount, ptr ? 1 : 0, evData ? 1 : 0);
 	ePyObject tmp;
@@ -2389,6 +3397,9 @@ PyObject *eEPGCache::lookupEvent(ePyObject list, ePyObject convertFunc)
 
 	int must_get_service_name = strchr(argstring, 'N') ? 1 : strchr(argstring, 'n') ? 2 : 0;
 
+	// the descriptors are only parsed when one of the text / rating / genre columns is requested
+	bool need_descriptors = strpbrk(argstring, "TSEPW") ? true : false;
+
 	// create dest list
 	ePyObject dest_list=PyList_New(0);
 	while(listSize > listIt)
@@ -2501,14 +3512,15 @@ PyObject *eEPGCache::lookupEvent(ePyObject list, ePyObject convertFunc)
 			}
 			if (minutes)
 			{
-				singleLock s(cache_lock);
-				if (!startTimeQuery(ref, stime, minutes))
+				eEPGReadLocker s(cache_lock);
+				timeMap::iterator It, end;
+				int tsidonid;
+				if (!timeQueryRange(ref, stime, minutes, It, end, tsidonid))
 				{
-					while ( m_timemap_cursor != m_timemap_end )
+					while ( It != end )
 					{
-						Event ev((uint8_t*)m_timemap_cursor++->second->get());
 						eServiceEvent evt;
-						evt.parseFrom(&ev, currentQueryTsidOnid);
+						parseEvent(evt, It++->second, tsidonid, need_descriptors);
 						if (handleEvent(&evt, dest_list, argstring, argcount, service, nowTime, service_name, convertFunc, convertFuncArgs))
 							return 0;  // error
 					}
@@ -2522,7 +3534,7 @@ PyObject *eEPGCache::lookupEvent(ePyObject list, ePyObject convertFunc)
 				const eventData *ev_data=0;
 				if (stime)
 				{
-					singleLock s(cache_lock);
+					eEPGReadLocker s(cache_lock);
 					if (type == 2)
 						lookupEventId(ref, event_id, ev_data);
 					else
@@ -2530,8 +3542,7 @@ PyObject *eEPGCache::lookupEvent(ePyObject list, ePyObject convertFunc)
 					if (ev_data)
 					{
 						const eServiceReferenceDVB &dref = (const eServiceReferenceDVB&)ref;
-						Event ev((uint8_t*)ev_data->get());
-						evt.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get());
+						parseEvent(evt, ev_data, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get(), need_descriptors);
 					}
 				}
 				if (ev_data)
@@ -2557,6 +3568,114 @@ skip_entry:
 	return dest_list;
 }
 
+// batch query for epg grids and channel lists.. all services are handled with
+// one lock and the result is one string, so no python object is built per event
+//   services   list of service reference strings, the result keeps this order
+//   begin      start of the time window (-1 = now)
+//   minutes    events starting before begin+minutes are returned (0 = no limit)
+//   count      maximum number of events per service (0 = no limit)
+// the first event of each service is the one running at begin, so the
+// defaults (minutes 0, count 2) return now/next.
+// the string is a sequence of rows in host byte order without padding
+//   __u16 index of the service in the list
+//   __u16 event id
+//   __u32 begin time
+//   __u32 duration
+//   __u8  length of the title
+//   title (UTF-8, not terminated)
+// services without events have no rows. Tools.EventRows decodes them.
+PyObject *eEPGCache::lookupEventRows(ePyObject services, time_t begin, int minutes, int count)
+{
+	if (!PyList_Check(services))
+	{
+		PyErr_SetString(PyExc_StandardError,
+			"type error");
+		eDebug("no list");
+		return NULL;
+	}
+	if (begin == -1)
+		begin = ::time(0);
+	time_t end = minutes > 0 ? begin + minutes * 60 : 0;
+
+	/* parse the service references before the cache is locked */
+	int listSize = PyList_Size(services);
+	if (listSize > 0x10000) // the index in the rows is 16 bit
+	{
+		PyErr_SetString(PyExc_StandardError,
+			"too many services");
+		eDebug("lookupEventRows: %d services, at most 65536 allowed", listSize);
+		return NULL;
+	}
+	std::vector<uniqueEPGKey> keys;
+	keys.reserve(listSize);
+	for (int i = 0; i < listSize; ++i)
+	{
+		ePyObject item = PyList_GET_ITEM(services, i); // borrowed reference!
+		if (!PyString_Check(item))
+		{
+			keys.push_back(uniqueEPGKey());
+			continue;
+		}
+		eServiceReference ref(handleGroup(eServiceReference(PyString_AS_STRING(item))));
+		eServiceReferenceDVB &dvb_ref = (eServiceReferenceDVB&)ref;
+		if (ref.type == eServiceReference::idDVB && dvb_ref.getParentTransportStreamID().get()) // linkage subservice
+		{
+			dvb_ref.setTransportStreamID( dvb_ref.getParentTransportStreamID() );
+			dvb_ref.setServiceID( dvb_ref.getParentServiceID() );
+		}
+		if (ref.type != eServiceReference::idDVB && ref.type != eServiceReference::idServiceMP3)
+			keys.push_back(uniqueEPGKey());
+		else
+			keys.push_back(uniqueEPGKey(ref));
+	}
+
+	std::string rows;
+	{
+		eEPGReadLocker s(cache_lock);
+		for (unsigned int i = 0; i < keys.size(); ++i)
+		{
+			if (!keys[i])
+				continue;
+			eventCache::iterator It = eventDB.find(keys[i]);
+			if (It == eventDB.end())
+				continue;
+			timeMap &tmMap = It->second.second;
+			timeMap::iterator ev = tmMap.upper_bound(begin);
+			if (ev != tmMap.begin())
+			{
+				timeMap::iterator x = ev - 1;
+				if (begin < x->first + x->second->getDuration())
+					ev = x;
+			}
+			int tsidonid = (keys[i].tsid << 16) | keys[i].onid;
+			for (int n = 0; ev != tmMap.end() && (!count || n < count) && (!end || ev->first < end); ++ev, ++n)
+			{
+				const eventData *data = ev->second;
+				eServiceEvent evt;
+				eventDescriptors descr(data, tsidonid, SHORT_EVENT_DESCRIPTOR);
+				evt.parseFrom(data->getStartTime(), data->getDuration(), data->getEventID(), descr.getDescriptors(), tsidonid);
+				std::string title = evt.getEventName();
+				if (title.length() > 255)
+					truncateUTF8(title, 255); // no UTF-8 sequence is cut in two
+				__u8 len = title.length();
+				__u8 row[13];
+				__u16 service = i;
+				__u16 event_id = data->getEventID();
+				__u32 start = data->getStartTime();
+				__u32 duration = data->getDuration();
+				memcpy(row, &service, 2);
+				memcpy(row + 2, &event_id, 2);
+				memcpy(row + 4, &start, 4);
+				memcpy(row + 8, &duration, 4);
+				row[12] = len;
+				rows.append((const char*)row, sizeof(row));
+				rows.append(title);
+			}
+		}
+	}
+	return PyString_FromStringAndSize(rows.data(), rows.length());
+}
+
 static void fill_eit_start(eit_event_struct *evt, time_t t)
 {
     tm *time = gmtime(&t);
@@ -2587,31 +3706,13 @@ static void fill_eit_duration(eit_event_struct *evt, int time)
 static inline __u8 HI(int x) { return (__u8) ((x >> 8) & 0xFF); }
 static inline __u8 LO(int x) { return (__u8) (x & 0xFF); }
 #define SET_HILO(x, val) {x##_hi = ((val) >> 8); x##_lo = (val) & 0xff; }
-// convert from set of strings to DVB format (EIT)
-void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& serviceRefs, long start, 
-	long duration, const char* title, const char* short_summary, 
-	const char* long_description, char event_type)
+// builds the eit event of an imported event.. the lengths are already limited by the caller
+// (name 246, short description 246 - name, long description 4108), returns the size of the event
+static int fillImportEvent(eit_event_t *evt_struct, long start, long duration,
+	const char *title, int nameLength, const char *short_summary, int descLength,
+	const char *long_description, int textLength, char event_type)
 {
-	if (!title)
-		return;
-	static const int EIT_LENGTH = 4108;
 	static const __u8 codePage = 0x15; // UTF-8 encoding
-	__u8 data[EIT_LENGTH];
-
-	eit_t *packet = (eit_t *) data;
-	packet->table_id = 0x50;
-	packet->section_syntax_indicator = 1;
-
-	packet->version_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
-	packet->current_next_indicator = 0;
-	packet->section_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
-	packet->last_section_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
-	
-	packet->segment_last_section_number = 0; // eEPGCache::sectionRead() will dig this for the moment
-	packet->segment_last_table_id = 0x50;
-
-	eit_event_t *evt_struct = (eit_event_t*) (data + EIT_SIZE);
-
 	__u16 eventId = start & 0xFFFF;
 	SET_HILO(evt_struct->event_id, eventId);
 
@@ -2626,8 +3727,6 @@ void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& service
 	//TODO: convert text to correct character set (data is probably passed in as UTF-8)
 	__u8 *x = (__u8 *) evt_struct;
 	x += EIT_LOOP_SIZE;
-	int nameLength = strnlen(title, 246);
-	int descLength = short_summary ? strnlen(short_summary, 246 - nameLength) : 0;
 	
 	eit_short_event_descriptor_struct *short_evt = (eit_short_event_descriptor_struct*) x;
 	short_evt->descriptor_tag = SHORT_EVENT_DESCRIPTOR;
@@ -2674,12 +3773,11 @@ void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& service
 	static const int overheadPerDescriptor = 9; //increase if codepages are added!!!
 	static const int MAX_LEN = 256 - overheadPerDescriptor; 
 
-	int textLength = long_description ? strnlen(long_description, EIT_LENGTH) : 0;//EIT_LENGTH is a bit too much, but it's only here as a reasonable end point
 	int lastDescriptorNumber = (textLength + MAX_LEN-1) / MAX_LEN - 1;
 	int remainingTextLength = textLength - lastDescriptorNumber * MAX_LEN;
 
 	//if long description is too long, just try to fill as many descriptors as possible
-	while ( (lastDescriptorNumber+1) * 256 + currentLoopLength > EIT_LENGTH - EIT_LOOP_SIZE)
+	while ( (lastDescriptorNumber+1) * 256 + currentLoopLength > 4108 - EIT_LOOP_SIZE)
 	{
 		lastDescriptorNumber--;
 		remainingTextLength = MAX_LEN;
@@ -2711,6 +3809,37 @@ void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& service
 	//TODO: add age and more 
 	int desc_loop_length = x - ((__u8*)evt_struct + EIT_LOOP_SIZE);
 	SET_HILO(evt_struct->descriptors_loop_length, desc_loop_length);
+	return x - (__u8*)evt_struct;
+}
+
+// convert from set of strings to DVB format (EIT)
+void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& serviceRefs, long start, 
+	long duration, const char* title, const char* short_summary, 
+	const char* long_description, char event_type)
+{
+	if (!title)
+		return;
+	static const int EIT_LENGTH = 4108;
+	__u8 data[EIT_LENGTH];
+
+	eit_t *packet = (eit_t *) data;
+	packet->table_id = 0x50;
+	packet->section_syntax_indicator = 1;
+
+	packet->version_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
+	packet->current_next_indicator = 0;
+	packet->section_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
+	packet->last_section_number = 0;	// eEPGCache::sectionRead() will dig this for the moment
+	
+	packet->segment_last_section_number = 0; // eEPGCache::sectionRead() will dig this for the moment
+	packet->segment_last_table_id = 0x50;
+
+	int nameLength = strnlen(title, 246);
+	int descLength = short_summary ? strnlen(short_summary, 246 - nameLength) : 0;
+	int textLength = long_description ? strnlen(long_description, EIT_LENGTH) : 0;//EIT_LENGTH is a bit too much, but it's only here as a reasonable end point
+	__u8 *x = data + EIT_SIZE;
+	x += fillImportEvent((eit_event_t*)x, start, duration, title, nameLength, short_summary, descLength,
+		long_description, textLength, event_type);
 
 	int packet_length = (x - data) - 3; //should add 1 for crc....
 	SET_HILO(packet->section_length, packet_length);
@@ -2727,6 +3856,247 @@ void eEPGCache::submitEventData(const std::vector<eServiceReferenceDVB>& service
 		sectionRead(data, EPG_IMPORT, 0);
 	}
 }
+
+struct importRecord
+{
+	int service;
+	time_t start;
+	int duration;
+	size_t offset;  // of the eit event in the event buffer
+	int size;
+	bool operator<(const importRecord &o) const
+	{
+		return service < o.service || (service == o.service && start < o.start);
+	}
+};
+
+/*
+ * Imports many events of many services at once. The events are built before
+ * the cache is locked, then they are sorted per service and every service is
+ * updated in one pass under one lock. An imported event replaces the cached
+ * events it overlaps. The shared descriptors are deduplicated by the pool.
+ * events is a packed string, one record per event in native byte order:
+ *   __u16 service (index into the list of service references), __u32 start,
+ *   __u32 duration, __u8 event type, __u8 title length,
+ *   __u16 short description length, __u16 long description length,
+ *   followed by the UTF-8 texts.
+ * Returns (events imported, milliseconds).
+ */
+PyObject *eEPGCache::importEventsBulk(ePyObject services, ePyObject events)
+{
+	char *buffer;
+	Py_ssize_t length;
+	if (!PyList_Check(services) || !PyString_Check(events) || PyString_AsStringAndSize(events, &buffer, &length))
+	{
+		eDebug("[EPG:import] importEventsBulk needs a list of service references and a string");
+		Py_RETURN_NONE;
+	}
+	struct timespec begin;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+
+	std::vector<uniqueEPGKey> keys;
+	int serviceCount = PyList_Size(services);
+	keys.reserve(serviceCount);
+	for (int i = 0; i < serviceCount; ++i)
+	{
+		ePyObject item = PyList_GET_ITEM(services, i);
+		if (PyString_Check(item))
+			keys.push_back(uniqueEPGKey(eServiceReference(PyString_AS_STRING(item))));
+		else
+			keys.push_back(uniqueEPGKey());
+	}
+
+	static const int recordSize = 16;
+	std::vector<importRecord> records;
+	std::vector<__u8> data;
+	records.reserve(length / recordSize);
+	data.reserve(length + length / recordSize * 32);
+	time_t now = ::time(0);
+	const __u8 *pos = (const __u8*)buffer, *end = pos + length;
+	while (pos + recordSize <= end)
+	{
+		__u16 service, descLength, textLength;
+		__u32 start, duration;
+		memcpy(&service, pos, 2);
+		memcpy(&start, pos + 2, 4);
+		memcpy(&duration, pos + 6, 4);
+		char event_type = pos[10];
+		int nameLength = pos[11];
+		memcpy(&descLength, pos + 12, 2);
+		memcpy(&textLength, pos + 14, 2);
+		if (end - pos < recordSize + nameLength + descLength + textLength)
+			break;
+		const char *title = (const char*)pos + recordSize;
+		const char *short_summary = title + nameLength;
+		const char *long_description = short_summary + descLength;
+		pos = (const __u8*)long_description + textLength;
+		if (service >= keys.size() || !keys[service] ||
+			now > (time_t)(start + duration) || (time_t)start > now + 28*24*60*60)
+			continue;
+		importRecord r;
+		r.service = service;
+		r.start = start;
+		r.duration = duration;
+		r.offset = data.size();
+		data.resize(r.offset + 4108 + EIT_LOOP_SIZE);
+		nameLength = std::min(nameLength, 246);
+		r.size = fillImportEvent((eit_event_t*)&data[r.offset], start, duration, title, nameLength,
+			short_summary, std::min((int)descLength, 246 - nameLength), long_description, textLength, event_type);
+		data.resize(r.offset + r.size);
+		records.push_back(r);
+	}
+	// the last record of a service and start time wins
+	std::stable_sort(records.begin(), records.end());
+
+	int imported = 0, replaced = 0, overlaps = 0, dropped = 0;
+	{
+		eEPGWriteLocker s(cache_lock);
+		std::vector<bool> used(65536);
+		std::vector<eventData*> removed;
+		std::vector<time_t> maxEnd;
+		std::vector<std::pair<__u16, eventData*> > ids;
+		std::vector<std::pair<time_t, eventData*> > times;
+		std::vector<__u32> durations;
+		for (std::vector<importRecord>::iterator first = records.begin(); first != records.end();)
+		{
+			const uniqueEPGKey &service = keys[first->service];
+			std::vector<importRecord>::iterator last = first;
+			while (last != records.end() && last->service == first->service)
+				++last;
+			// drop the duplicates and the events beyond the eviction horizon
+			time_t limit = m_memoryLimit ? evictionLimit(service, now) : -1;
+			std::vector<importRecord>::iterator kept = first;
+			for (std::vector<importRecord>::iterator it = first; it != last; ++it)
+			{
+				if (limit >= 0 && it->start >= limit)
+					continue;
+				if (kept != first && (kept - 1)->start == it->start)
+					*(kept - 1) = *it;
+				else
+					*kept++ = *it;
+			}
+			if (kept == first)
+			{
+				first = last;
+				continue;
+			}
+			maxEnd.clear();
+			for (std::vector<importRecord>::iterator it = first; it != kept; ++it)
+				maxEnd.push_back(std::max(maxEnd.empty() ? 0 : maxEnd.back(), it->start + it->duration));
+
+			std::pair<eventMap,timeMap> &servicemap = eventDB[service];
+			eventMap &evMap = servicemap.first;
+			timeMap &tmMap = servicemap.second;
+
+			// the cached events overlapped by an imported one are replaced
+			removed.clear();
+			timeMap::iterator tkept = tmMap.begin();
+			for (timeMap::iterator It = tmMap.begin(); It != tmMap.end(); ++It)
+			{
+				time_t evEnd = It->first + It->second->getDuration();
+				importRecord key;
+				key.service = first->service;
+				key.start = std::max(evEnd, It->first + 1);
+				int n = std::lower_bound(first, kept, key) - first;  // the imported events starting before the end
+				key.start = It->first;
+				if ((n && maxEnd[n - 1] > It->first) || std::binary_search(first, kept, key))
+					removed.push_back(It->second);
+				else
+					*tkept++ = *It;
+			}
+			tmMap.erase(tkept, tmMap.end());
+			if (!removed.empty())
+			{
+				std::sort(removed.begin(), removed.end());
+				eventMap::iterator ekept = evMap.begin();
+				for (eventMap::iterator It = evMap.begin(); It != evMap.end(); ++It)
+				{
+					if (!std::binary_search(removed.begin(), removed.end(), It->second))
+						*ekept++ = *It;
+				}
+				evMap.erase(ekept, evMap.end());
+				for (std::vector<eventData*>::iterator It = removed.begin(); It != removed.end(); ++It)
+					delete *It;
+				replaced += removed.size();
+				m_sectionCRCs.invalidate(service.sid);
+			}
+
+			for (eventMap::iterator It = evMap.begin(); It != evMap.end(); ++It)
+				used[It->first] = true;
+			ids.clear();
+			times.clear();
+			durations.clear();
+			time_t expires = 0;
+			for (std::vector<importRecord>::iterator it = first; it != kept; ++it)
+			{
+				// the event id is the start time, the next free one when that is taken
+				__u16 event_id = it->start & 0xFFFF;
+				int tries = 0;
+				while (used[event_id] && ++tries < 65536)
+					++event_id;
+				if (used[event_id])
+				{
+					++dropped;
+					continue;  // all ids of the service are taken
+				}
+				used[event_id] = true;
+				eit_event_struct *event = (eit_event_struct*)&data[it->offset];
+				event->event_id_hi = event_id >> 8;
+				event->event_id_lo = event_id & 0xFF;
+				eventData *evt = new eventData(event, it->size, EPG_IMPORT, (service.tsid << 16) | service.onid);
+				if (!m_replaying)
+					m_journal.addEvent(service.sid, service.onid, service.tsid, EPG_IMPORT, (const __u8*)event, it->size);
+				if (m_journal.batchFull())
+					m_journal.flush();
+				ids.push_back(std::pair<__u16, eventData*>(event_id, evt));
+				times.push_back(std::pair<time_t, eventData*>(it->start, evt));
+				durations.push_back(it->duration);
+				if (!expires || it->start + it->duration < expires)
+					expires = it->start + it->duration;
+			}
+			for (std::vector<std::pair<__u16, eventData*> >::iterator It = ids.begin(); It != ids.end(); ++It)
+				used[It->first] = false;
+			for (eventMap::iterator It = evMap.begin(); It != evMap.end(); ++It)
+				used[It->first] = false;
+			std::sort(ids.begin(), ids.end());
+			evMap.reserve(evMap.size() + ids.size());
+			tmMap.reserve(tmMap.size() + times.size());
+			evMap.merge(ids);
+			tmMap.merge(times);
+			// the imported events overlapping each other, in the order of their start like
+			// the journal replays them.. a removed event is no longer found by its start
+			int fixed = 0;
+			for (unsigned int i = 0; i < times.size(); ++i)
+			{
+				timeMap::iterator tm_it = tmMap.find(times[i].first);
+				if (tm_it != tmMap.end() && tm_it->second == times[i].second &&
+					FixOverlapping(servicemap, times[i].first, durations[i], tm_it, service))
+					++fixed;
+			}
+			overlaps += fixed;
+#ifdef ENABLE_PRIVATE_EPG
+			if (!removed.empty() || fixed)
+				cleanContentTimeTable(service, tmMap);
+#endif
+			scheduleExpiry(service, expires);
+			imported += ids.size();
+			first = last;
+		}
+		ingestStatistics counted;
+		memset(&counted, 0, sizeof(counted));
+		counted.inserted = imported;
+		counted.replaced = replaced;
+		countIngest(0, EPG_IMPORT, counted);
+	}
+
+	struct timespec finished;
+	clock_gettime(CLOCK_MONOTONIC, &finished);
+	int ms = (finished.tv_sec - begin.tv_sec) * 1000 + (finished.tv_nsec - begin.tv_nsec) / 1000000;
+	eDebug("[EPG:import] %d events imported in %d ms, %d cached events replaced, %d overlapping imported events fixed", imported, ms, replaced, overlaps);
+	if (dropped)
+		eDebug("[EPG:import] %d events dropped, no free event id", dropped);
+	return Py_BuildValue("(ii)", imported, ms);
+}
 #undef SET_HILO
 
 
@@ -2745,6 +4115,231 @@ unsigned int eEPGCache::getEpgSources()
 	return enabledSources;
 }
 
+// a list of service reference strings.. the favourites and bouquets, evicted last
+void eEPGCache::setPreferredServices(ePyObject services)
+{
+	if (!PyList_Check(services))
+	{
+		eDebug("[EPGC] setPreferredServices: no list given");
+		return;
+	}
+	serviceSet preferred;
+	int size = PyList_Size(services);
+	for (int i = 0; i < size; ++i)
+	{
+		ePyObject item = PyList_GET_ITEM(services, i);
+		if (PyString_Check(item))
+			preferred.insert(uniqueEPGKey(eServiceReference(PyString_AS_STRING(item))));
+	}
+	eEPGWriteLocker s(cache_lock);
+	m_preferredServices.swap(preferred);
+	if (m_evictStep[0] || m_evictStep[1] || m_evictStep[2])
+		m_reparse = true;
+	eDebug("[EPGC] %d preferred services", (int)m_preferredServices.size());
+}
+
+void eEPGCache::setHarvester(int tuners, ePyObject services)
+{
+	std::vector<eDVBChannelID> channels;
+	if (PyList_Check(services))
+	{
+		std::set<eDVBChannelID> unique;
+		int size = PyList_Size(services);
+		for (int i = 0; i < size; ++i)
+		{
+			ePyObject item = PyList_GET_ITEM(services, i);
+			if (!PyString_Check(item))
+				continue;
+			eServiceReferenceDVB ref(PyString_AS_STRING(item));
+			if (ref.type != eServiceReference::idDVB)
+				continue;
+			eDVBChannelID chid;
+			ref.getChannelID(chid);
+			if (unique.insert(chid).second)
+				channels.push_back(chid);
+		}
+	}
+	m_harvester.setChannels(channels);
+	m_harvester.setTuners(tuners);
+}
+
+static ePyObject memoryTuple(unsigned int events, size_t bytes)
+{
+	ePyObject tuple = PyTuple_New(2);
+	PyTuple_SET_ITEM(tuple, 0, PyInt_FromLong(events));
+	PyTuple_SET_ITEM(tuple, 1, PyLong_FromUnsignedLong(bytes));
+	return tuple;
+}
+
+static void putToDict(ePyObject &dict, const char *key, ePyObject item)
+{
+	PyDict_SetItemString(dict, key, item);
+	Py_DECREF(item);
+}
+
+// the shared descriptors are split between the events using them
+size_t eEPGCache::eventSize(const eventData *ev)
+{
+	size_t size = sizeof(eventData) + ev->ByteSize;
+	for (eventData::descriptorIterator d(ev->descriptorsBegin()); d != ev->descriptorsEnd(); ++d)
+	{
+		eEPGDescriptorPool::entry *e = eventData::descriptors.find(d.crc());
+		if (e && e->refcount > 0)
+			size += (e->data[1] + 2) / e->refcount;
+	}
+	return size;
+}
+
+PyObject *eEPGCache::getMemoryUsage()
+{
+	unsigned int originEvents[originCount];
+	size_t originBytes[originCount];
+	memset(originEvents, 0, sizeof(originEvents));
+	memset(originBytes, 0, sizeof(originBytes));
+	ePyObject result = PyDict_New();
+	ePyObject services = PyList_New(0);
+
+	eEPGReadLocker s(cache_lock);
+	for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end(); ++DBIt)
+	{
+		size_t bytes = 0;
+		timeMap &tmMap = DBIt->second.second;
+		for (timeMap::iterator It = tmMap.begin(); It != tmMap.end(); ++It)
+		{
+			const eventData *ev = It->second;
+			size_t size = eventSize(ev);
+			++originEvents[ev->origin];
+			originBytes[ev->origin] += size;
+			bytes += size;
+		}
+		ePyObject service = PyTuple_New(5);
+		PyTuple_SET_ITEM(service, 0, PyInt_FromLong(DBIt->first.sid));
+		PyTuple_SET_ITEM(service, 1, PyInt_FromLong(DBIt->first.tsid));
+		PyTuple_SET_ITEM(service, 2, PyInt_FromLong(DBIt->first.onid));
+		PyTuple_SET_ITEM(service, 3, PyInt_FromLong(tmMap.size()));
+		PyTuple_SET_ITEM(service, 4, PyLong_FromUnsignedLong(bytes));
+		PyList_Append(services, service);
+		Py_DECREF(service);
+	}
+
+	ePyObject sources = PyDict_New();
+	for (int i = 0; i < originCount; ++i)
+		putToDict(sources, originNames[i], memoryTuple(originEvents[i], originBytes[i]));
+	eEPGAllocator::statistics events, descriptors;
+	eventData::eventMemory.getStatistics(events);
+	eventData::descriptorMemory.getStatistics(descriptors);
+	putToDict(result, "limit", PyLong_FromUnsignedLong(m_memoryLimit));
+	putToDict(result, "used", PyLong_FromUnsignedLong(memoryUsage()));
+	putToDict(result, "allocated", PyLong_FromUnsignedLong(events.bytesAllocated + descriptors.bytesAllocated));
+	putToDict(result, "evictionSteps", Py_BuildValue("(iii)", m_evictStep[0], m_evictStep[1], m_evictStep[2]));
+	eEPGCompressor::statistics compression;
+	eventData::compressor.getStatistics(compression);
+	ePyObject compressionDict = PyDict_New();
+	putToDict(compressionDict, "enabled", PyBool_FromLong(eventData::compressor.enabled()));
+	putToDict(compressionDict, "compressed", PyInt_FromLong(compression.compressed));
+	putToDict(compressionDict, "rejected", PyInt_FromLong(compression.rejected));
+	putToDict(compressionDict, "bytesIn", PyLong_FromUnsignedLong(compression.bytesIn));
+	putToDict(compressionDict, "bytesOut", PyLong_FromUnsignedLong(compression.bytesOut));
+	putToDict(compressionDict, "compressTime", PyLong_FromUnsignedLong(compression.compressTime));
+	putToDict(compressionDict, "expanded", PyInt_FromLong(compression.expanded));
+	putToDict(compressionDict, "hits", PyInt_FromLong(compression.hits));
+	putToDict(compressionDict, "expandTime", PyLong_FromUnsignedLong(compression.expandTime));
+	putToDict(result, "compression", compressionDict);
+	putToDict(result, "sources", sources);
+	putToDict(result, "services", services);
+	return result;
+}
+
+PyObject *eEPGCache::ingestDict(const ingestStatistics &st)
+{
+	ePyObject dict = PyDict_New();
+	putToDict(dict, "sections", PyLong_FromUnsignedLong(st.sections));
+	putToDict(dict, "duplicates", PyLong_FromUnsignedLong(st.duplicates));
+	putToDict(dict, "unchanged", PyLong_FromUnsignedLong(st.unchanged));
+	putToDict(dict, "parsed", PyLong_FromUnsignedLong(st.parsed));
+	putToDict(dict, "parseTime", PyLong_FromUnsignedLongLong(st.parseTime));
+	putToDict(dict, "inserted", PyLong_FromUnsignedLong(st.inserted));
+	putToDict(dict, "replaced", PyLong_FromUnsignedLong(st.replaced));
+	putToDict(dict, "skipped", PyLong_FromUnsignedLong(st.skipped));
+	putToDict(dict, "overlapChecks", PyLong_FromUnsignedLong(st.overlapChecks));
+	putToDict(dict, "overlapFixes", PyLong_FromUnsignedLong(st.overlapFixes));
+	putToDict(dict, "lockWait", PyLong_FromUnsignedLongLong(st.lockWait));
+	putToDict(dict, "lockHold", PyLong_FromUnsignedLongLong(st.lockHold));
+	return dict;
+}
+
+PyObject *eEPGCache::getIngestStatistics()
+{
+	unsigned int originEvents[originCount];
+	size_t originBytes[originCount];
+	memset(originEvents, 0, sizeof(originEvents));
+	memset(originBytes, 0, sizeof(originBytes));
+	ePyObject result = PyDict_New();
+	ePyObject sources = PyDict_New();
+	ePyObject channels = PyList_New(0);
+	eEPGCacheLock::statistics lock;
+	{
+		eEPGReadLocker s(cache_lock);
+		for (eventCache::iterator DBIt = eventDB.begin(); DBIt != eventDB.end(); ++DBIt)
+		{
+			timeMap &tmMap = DBIt->second.second;
+			for (timeMap::iterator It = tmMap.begin(); It != tmMap.end(); ++It)
+			{
+				++originEvents[It->second->origin];
+				originBytes[It->second->origin] += eventSize(It->second);
+			}
+		}
+		cache_lock.getStatistics(lock);
+	}
+	ingestStatistics sourceStats[originCount];
+	{
+		eSingleLocker l(m_statsLock);
+		memcpy(sourceStats, m_sourceStats, sizeof(sourceStats));
+	}
+	for (int i = 0; i < originCount; ++i)
+	{
+		ePyObject source = ingestDict(sourceStats[i]);
+		putToDict(source, "events", PyInt_FromLong(originEvents[i]));
+		putToDict(source, "bytes", PyLong_FromUnsignedLong(originBytes[i]));
+		putToDict(sources, originNames[i], source);
+	}
+	{
+		singleLock s(channel_map_lock);
+		for (channelMapIterator it(m_knownChannels.begin()); it != m_knownChannels.end(); ++it)
+		{
+			eDVBChannelID chid = ((eDVBChannel*)it->first)->getChannelID();
+			ingestStatistics stats;
+			{
+				eSingleLocker l(m_statsLock);
+				stats = it->second->stats;
+			}
+			ePyObject channel = ingestDict(stats);
+			putToDict(channel, "namespace", PyLong_FromUnsignedLong(chid.dvbnamespace.get()));
+			putToDict(channel, "tsid", PyInt_FromLong(chid.transport_stream_id.get()));
+			putToDict(channel, "onid", PyInt_FromLong(chid.original_network_id.get()));
+			putToDict(channel, "running", PyInt_FromLong(it->second->isRunning));
+			putToDict(channel, "haveData", PyInt_FromLong(it->second->haveData));
+			PyList_Append(channels, channel);
+			Py_DECREF(channel);
+		}
+	}
+	ePyObject lockDict = PyDict_New();
+	putToDict(lockDict, "reads", PyLong_FromUnsignedLong(lock.reads));
+	putToDict(lockDict, "readWaits", PyLong_FromUnsignedLong(lock.readWaits));
+	putToDict(lockDict, "readWaitTime", PyLong_FromUnsignedLongLong(lock.readWaitTime));
+	putToDict(lockDict, "maxReadWait", PyLong_FromUnsignedLong(lock.maxReadWait));
+	putToDict(lockDict, "writes", PyLong_FromUnsignedLong(lock.writes));
+	putToDict(lockDict, "writeWaits", PyLong_FromUnsignedLong(lock.writeWaits));
+	putToDict(lockDict, "writeWaitTime", PyLong_FromUnsignedLongLong(lock.writeWaitTime));
+	putToDict(lockDict, "maxWriteWait", PyLong_FromUnsignedLong(lock.maxWriteWait));
+	putToDict(lockDict, "writeHoldTime", PyLong_FromUnsignedLongLong(lock.writeHoldTime));
+	putToDict(lockDict, "maxWriteHold", PyLong_FromUnsignedLong(lock.maxWriteHold));
+	putToDict(result, "sources", sources);
+	putToDict(result, "channels", channels);
+	putToDict(result, "lock", lockDict);
+	return result;
+}
+
 static const char* getStringFromPython(ePyObject obj)
 {
 	char *result = 0;
@@ -2872,6 +4467,38 @@ void eEPGCache::importEvents(ePyObject serviceReferences, ePyObject list)
 //     0 = case sensitive (CASE_CHECK)
 //     1 = case insensitive (NO_CASECHECK)
 
+// querytype 1 = exact title, 2 = title contains text, 3 = title starts with text
+static bool titleMatches(const __u8 *data, int tsidonid, const char *str, int textlen, int querytype, int casetype)
+{
+	const char *titleptr;
+	int title_len;
+	std::string title;
+	if (!eEPGTitleIndex::getTitle(data, tsidonid, titleptr, title_len, title))
+		return false;
+	if (title_len < textlen)
+		/*Doesn't fit, so cannot match anything */
+		return false;
+	if (querytype == 1)
+	{
+		/* require exact title match */
+		if (title_len != textlen)
+			return false;
+	}
+	else if (querytype == 3)
+	{
+		/* Do a "startswith" match by pretending the text isn't that long */
+		title_len = textlen;
+	}
+	while (title_len >= textlen)
+	{
+		if (casetype ? !strncasecmp(titleptr, str, textlen) : !memcmp(titleptr, str, textlen))
+			return true;
+		title_len--;
+		titleptr++;
+	}
+	return false;
+}
+
 PyObject *eEPGCache::search(ePyObject arg)
 {
 	ePyObject ret;
@@ -2947,32 +4574,25 @@ PyObject *eEPGCache::search(ePyObject arg)
 					if (ref.valid())
 					{
 						eventid = PyLong_AsLong(PyTuple_GET_ITEM(arg, 4));
-						singleLock s(cache_lock);
+						eEPGReadLocker s(cache_lock);
 						const eventData *evData = 0;
 						lookupEventId(ref, eventid, evData);
 						if (evData)
 						{
-							__u8 *data = evData->EITdata;
-							int tmp = evData->ByteSize-10;
-							__u32 *p = (__u32*)(data+10);
 							// search short and extended event descriptors
-							while(tmp>3)
+							for (eventData::descriptorIterator it(evData->descriptorsBegin()); it != evData->descriptorsEnd(); ++it)
 							{
-								__u32 crc = *p++;
-								descriptorMap::iterator it =
-									eventData::descriptors.find(crc);
-								if (it != eventData::descriptors.end())
+								const __u8 *descr_data = *it;
+								if (descr_data)
 								{
-									__u8 *descr_data = it->second.second;
 									switch(descr_data[0])
 									{
 									case 0x4D ... 0x4E:
-										descr[++descridx]=crc;
+										descr[++descridx]=it.crc();
 									default:
 										break;
 									}
 								}
-								tmp-=4;
 							}
 						}
 						if (descridx<0)
@@ -3016,64 +4636,21 @@ PyObject *eEPGCache::search(ePyObject arg)
 							eDebug("lookup events, title starting with '%s' (%s)", str, casetype?"ignore case":"case sensitive");
 							break;
 					}
-					singleLock s(cache_lock);
-					std::string title;
-					for (descriptorMap::iterator it(eventData::descriptors.begin());
-						it != eventData::descriptors.end() && descridx < 511; ++it)
+					// the raw titles are copied, their conversion to UTF-8 is done without the lock
+					std::vector<eEPGTitleIndex::copiedTitle> titles;
+					std::vector<__u8> titleData;
 					{
-						__u8 *data = it->second.second;
-						if ( data[0] == 0x4D ) // short event descriptor
-						{
-							const char *titleptr = (const char*)&data[6];
-							int title_len = data[5];
-							if (data[6] < 0x20)
-							{
-								/* custom encoding */
-								title = convertDVBUTF8((unsigned char*)titleptr, title_len, 0x40, 0);
-								titleptr = title.data();
-								title_len = title.length();
-							}
-							if (title_len < textlen)
-								/*Doesn't fit, so cannot match anything */
-								continue;
-							if (querytype == 1)
-							{
-								/* require exact title match */
-								if (title_len != textlen)
-									continue;
-							}
-							else if (querytype == 3)
-							{
-								/* Do a "startswith" match by pretending the text isn't that long */
-								title_len = textlen;
-							}
-							if (casetype)
-							{
-								while (title_len >= textlen)
-								{
-									if (!strncasecmp(titleptr, str, textlen))
-									{
-										descr[++descridx] = it->first;
-										break;
-									}
-									title_len--;
-									titleptr++;
-								}
-							}
-							else
-							{
-								while (title_len >= textlen)
-								{
-									if (!memcmp(titleptr, str, textlen))
-									{
-										descr[++descridx] = it->first;
-										break;
-									}
-									title_len--;
-									titleptr++;
-								}
-							}
-						}
+						eEPGReadLocker s(cache_lock);
+						std::vector<__u32> candidates;
+						if (eventData::titleIndex.candidates(str, textlen, candidates))
+							eventData::titleIndex.copyTitles(&candidates, titles, titleData);
+						else // too short for the title index
+							eventData::titleIndex.copyTitles(0, titles, titleData);
+					}
+					for (std::vector<eEPGTitleIndex::copiedTitle>::iterator it(titles.begin()); it != titles.end() && descridx < 511; ++it)
+					{
+						if (titleMatches(&titleData[it->offset], it->tsidonid, str, textlen, querytype, casetype))
+							descr[++descridx] = it->crc;
 					}
 				}
 				else
@@ -3111,11 +4688,14 @@ PyObject *eEPGCache::search(ePyObject arg)
 	if (descridx > -1)
 	{
 		int maxcount=maxmatches;
+		// the descriptors are checked for every cached event
+		std::sort(descr, descr + descridx + 1);
+		descridx = std::unique(descr, descr + descridx + 1) - descr - 1;
 		eServiceReferenceDVB ref(refstr?(const eServiceReferenceDVB&)handleGroup(eServiceReference(refstr)):eServiceReferenceDVB(""));
 		// ref is only valid in SIMILAR_BROADCASTING_SEARCH
 		// in this case we start searching with the base service
 		bool first = ref.valid() ? true : false;
-		singleLock s(cache_lock);
+		eEPGReadLocker s(cache_lock);
 		eventCache::iterator cit(ref.valid() ? eventDB.find(ref) : eventDB.begin());
 		while(cit != eventDB.end() && maxcount)
 		{
@@ -3135,33 +4715,27 @@ PyObject *eEPGCache::search(ePyObject arg)
 					if (evit->second->getEventID() == eventid)
 						continue;
 				}
-				__u8 *data = evit->second->EITdata;
-				int tmp = evit->second->ByteSize-10;
-				__u32 *p = (__u32*)(data+10);
+				const eventData *ev_data = evit->second;
 				// check if any of our descriptor used by this event
 				int cnt=-1;
-				while(tmp>3)
+				for (eventData::descriptorIterator it(ev_data->descriptorsBegin()); it != ev_data->descriptorsEnd(); ++it)
 				{
-					__u32 crc32 = *p++;
-					for ( int i=0; i <= descridx; ++i)
+					if (std::binary_search(descr, descr + descridx + 1, it.crc()))  // found...
 					{
-						if (descr[i] == crc32)  // found...
-						{
-							++cnt;
-							if (querytype)
-							{
-								/* we need only one match, when we're not looking for similar broadcasting events */
-								tmp = 0;
-								break;
-							}
-						}
+						++cnt;
+						/* we need only one match, when we're not looking for similar broadcasting events */
+						if (querytype)
+							break;
 					}
-					tmp-=4;
 				}
 				if ( (querytype == 0 && cnt == descridx) ||
 					 ((querytype > 0) && cnt != -1) )
 				{
 					const uniqueEPGKey &service = cit->first;
+					// create service event.. the same for all references of this service
+					eServiceEvent ptr;
+					if (needServiceEvent)
+						parseEvent(ptr, ev_data, (service.tsid<<16)|service.onid);
 					std::vector<eServiceReference> refs;
 					eDVBDB::getInstance()->searchAllReferences(refs, service.tsid, service.onid, service.sid);
 					for (unsigned int i = 0; i < refs.size(); i++)
@@ -3171,20 +4745,6 @@ PyObject *eEPGCache::search(ePyObject arg)
 						{
 							ePyObject service_name;
 							ePyObject service_reference;
-						// create servive event
-							eServiceEvent ptr;
-							const eventData *ev_data=0;
-							if (needServiceEvent)
-							{
-								if (lookupEventId(ref, evit->second->getEventID(), ev_data))
-									eDebug("event not found !!!!!!!!!!!");
-								else
-								{
-									const eServiceReferenceDVB &dref = (const eServiceReferenceDVB&)ref;
-									Event ev((uint8_t*)ev_data->get());
-									ptr.parseFrom(&ev, (dref.getTransportStreamID().get()<<16)|dref.getOriginalNetworkID().get());
-								}
-							}
 						// create service name
 							if (must_get_service_name && !service_name)
 							{
@@ -3228,7 +4788,7 @@ PyObject *eEPGCache::search(ePyObject arg)
 							ePyObject tuple = PyTuple_New(argcount);
 						// fill tuple
 							ePyObject tmp = ePyObject();
-							fillTuple(tuple, argstring, argcount, service_reference, ev_data ? &ptr : 0, service_name, tmp, evit->second);
+							fillTuple(tuple, argstring, argcount, service_reference, needServiceEvent ? &ptr : 0, service_name, tmp, evit->second);
 							PyList_Append(ret, tuple);
 							Py_DECREF(tuple);
 							if (service_name)
@@ -3264,6 +4824,7 @@ PyObject *eEPGCache::search(ePyObject arg)
 
 void eEPGCache::PMTready(eDVBServicePMTHandler *pmthandler)
 {
+	serviceViewed(pmthandler);
 	ePtr<eTable<ProgramMapSection> > ptr;
 	if (!pmthandler->getPMT(ptr) && ptr)
 	{
@@ -3403,7 +4964,7 @@ struct less_datetime
 void eEPGCache::privateSectionRead(const uniqueEPGKey &current_service, const __u8 *data)
 {
 	contentMap &content_time_table = content_time_tables[current_service];
-	singleLock s(cache_lock);
+	eEPGWriteLocker s(cache_lock);
 	std::map< date_time, std::list<uniqueEPGKey>, less_datetime > start_times;
 	eventMap &evMap = eventDB[current_service].first;
 	timeMap &tmMap = eventDB[current_service].second;
@@ -3559,6 +5120,8 @@ void eEPGCache::privateSectionRead(const uniqueEPGKey &current_service, const __
 		tmMap[stime] = d;
 		ASSERT(bptr <= 4098);
 	}
+	if (!tmMap.empty())
+		scheduleExpiry(current_service, tmMap.begin()->first + tmMap.begin()->second->getDuration());
 }
 
 void eEPGCache::channel_data::startPrivateReader()
@@ -10,6 +10,7 @@
 
 #include <vector>
 #include <list>
+#include <queue>
 // unordered_map unordered_set aren't there yet?
 #if 0
 #include <unordered_map>
@@ -29,6 +30,15 @@
 #include <lib/dvb/idvb.h>
 #include <lib/dvb/demux.h>
 #include <lib/dvb/dvbtime.h>
+#include <lib/dvb/epgpool.h>
+#include <lib/dvb/epgfile.h>
+#include <lib/dvb/epgharvester.h>
+#include <lib/dvb/epgindex.h>
+#include <lib/dvb/epgsections.h>
+#include <lib/dvb/epgtext.h>
+#include <lib/dvb/epgcompress.h>
+#include <lib/dvb/epglock.h>
+#include <lib/dvb/epgmap.h>
 #include <lib/base/ebase.h>
 #include <lib/base/thread.h>
 #include <lib/base/message.h>
@@ -36,8 +46,13 @@
 #include <lib/python/python.h>
 
 #define CLEAN_INTERVAL 60000    //  1 min
+#define CLEAN_SERVICES 64       //  per cache lock
+#define COMPRESS_SLOTS 4096     //  descriptor pool slots per cache lock
+#define INDEX_TITLES 256        //  titles converted for the title index per cache lock
 #define UPDATE_INTERVAL 3600000  // 60 min
 #define ZAP_DELAY 2000          // 2 sek
+#define SAVE_INTERVAL 1800000   // 30 min
+#define JOURNAL_INTERVAL 60000  // 1 min
 
 #define HILO(x) (x##_hi << 8 | x##_lo)
 
@@ -92,9 +107,9 @@ struct uniqueEPGKey
 };
 
 //eventMap is sorted by event_id
-#define eventMap std::map<__u16, eventData*>
+#define eventMap eEPGFlatMap<__u16, eventData*>
 //timeMap is sorted by beginTime
-#define timeMap std::map<time_t, eventData*>
+#define timeMap eEPGFlatMap<time_t, eventData*>
 
 #define channelMapIterator std::map<iDVBChannel*, channel_data*>::iterator
 #define updateMap std::map<eDVBChannelID, time_t>
@@ -103,13 +118,20 @@ struct hash_uniqueEPGKey
 {
 	inline size_t operator()( const uniqueEPGKey &x) const
 	{
-		return (x.onid << 16) | x.tsid;
+		// all services of a transponder share onid and tsid.. so the sid must be mixed in
+		__u32 h = ((x.onid & 0xFFFF) << 16) | (x.tsid & 0xFFFF);
+		h ^= (x.sid & 0xFFFF) * 0x9E3779B1;
+		h ^= h >> 15;
+		h *= 0x85EBCA6B;
+		h ^= h >> 13;
+		return h;
 	}
 };
 
-#define tidMap std::set<__u32>
 #if 0 
 	typedef std::unordered_map<uniqueEPGKey, std::pair<eventMap, timeMap>, hash_uniqueEPGKey, uniqueEPGKey::equal> eventCache;
+	typedef std::unordered_map<uniqueEPGKey, time_t, hash_uniqueEPGKey, uniqueEPGKey::equal> expiryMap;
+	typedef std::unordered_set<uniqueEPGKey, hash_uniqueEPGKey, uniqueEPGKey::equal> serviceSet;
 	#ifdef ENABLE_PRIVATE_EPG
 		typedef std::unordered_map<time_t, std::pair<time_t, __u16> > contentTimeMap;
 		typedef std::unordered_map<int, contentTimeMap > contentMap;
@@ -117,6 +139,8 @@ struct hash_uniqueEPGKey
 	#endif
 #else
 	typedef __gnu_cxx::hash_map<uniqueEPGKey, std::pair<eventMap, timeMap>, hash_uniqueEPGKey, uniqueEPGKey::equal> eventCache;
+	typedef __gnu_cxx::hash_map<uniqueEPGKey, time_t, hash_uniqueEPGKey, uniqueEPGKey::equal> expiryMap;
+	typedef __gnu_cxx::hash_set<uniqueEPGKey, hash_uniqueEPGKey, uniqueEPGKey::equal> serviceSet;
 	#ifdef ENABLE_PRIVATE_EPG
 		typedef __gnu_cxx::hash_map<time_t, std::pair<time_t, __u16> > contentTimeMap;
 		typedef __gnu_cxx::hash_map<int, contentTimeMap > contentMap;
@@ -124,43 +148,100 @@ struct hash_uniqueEPGKey
 	#endif
 #endif
 
-#define descriptorPair std::pair<int,__u8*>
-#define descriptorMap std::map<__u32, descriptorPair >
+// where a cached event came from.. for the statistics, the type can't tell all sources apart
+enum { originPrivate, originEIT, originMHW, originFreesat, originViasat, originNetmed, originImport, originCount };
 
 class eventData
 {
 	friend class eEPGCache;
+	friend class eventDescriptors;
 private:
 	__u8* EITdata;
 	__u8 ByteSize;
 	__u8 type;
-	static descriptorMap descriptors;
-	static __u8 data[4108];
+	__u8 origin;  // where the event came from, only for the statistics.. type can't tell all sources apart
+	static eEPGDescriptorPool descriptors;
+	static eEPGAllocator eventMemory, descriptorMemory;
+	static __thread __u8 data[4108];  // one buffer per thread for get(), readers run concurrently
 	static int CacheSize;
-	static bool isCacheCorrupt;
+	static int isCacheCorrupt;  // set by readers too, so only flagged.. see eEPGCache::removeCorruptFiles
+	static eEPGMappedFile mappedFile;
+	static eEPGTitleIndex titleIndex;
+	static eEPGTextCache texts;
+	static eEPGCompressor compressor;
+	struct deferredBlock
+	{
+		__u8 *data;
+		int len;
+		bool descriptor;
+	};
+	// blocks freed while a snapshot is written are released afterwards
+	static std::vector<deferredBlock> deferredBlocks;
+	static int snapshots;
+	static unsigned int changes;  // counts inserted and removed events
+	static void releaseBlock(__u8 *data, int len, bool descriptor);
+	static void releaseSnapshot();
 	static void load(FILE *);
-	static void save(FILE *);
+	static bool loadMapped(const epgFileHeader *header);
 	static void cacheCorrupt(const char* context);
+	static __u32 addDescriptor(const __u8 *descr, int len, int tsidonid);
+	static void indexTitles(const eventData *ev, int tsidonid);
+	static void dumpStatistics();
 public:
 	eventData(const eit_event_struct* e = NULL, int size = 0, int type = 0, int tsidonid = 0);
 	~eventData();
-	const eit_event_struct* get() const;
-	operator const eit_event_struct*() const
+	static void *operator new(size_t size) { return eventMemory.alloc(size); }
+	static void operator delete(void *ptr, size_t size) { eventMemory.free(ptr, size); }
+
+	// walks the descriptors of a cached event in place, without rebuilding the eit event
+	// the descriptor data is only valid as long as the cache is locked
+	class descriptorIterator
 	{
-		return get();
-	}
-	int getEventID()
+		const __u8 *m_pos;
+	public:
+		descriptorIterator(const __u8 *pos): m_pos(pos) { }
+		__u32 crc() const
+		{
+			__u32 crc;
+			memcpy(&crc, m_pos, sizeof(crc));
+			return crc;
+		}
+		// returns 0 when the descriptor is missing in the pool
+		// a compressed descriptor is only valid until the next one is expanded by this thread
+		const __u8 *operator*() const
+		{
+			eEPGDescriptorPool::entry *e = descriptors.find(crc());
+			if (!e)
+				cacheCorrupt("eventData::descriptorIterator");
+			return e ? compressor.expand(e->crc, e->data) : 0;
+		}
+		descriptorIterator &operator++() { m_pos += sizeof(__u32); return *this; }
+		bool operator==(const descriptorIterator &o) const { return m_pos == o.m_pos; }
+		bool operator!=(const descriptorIterator &o) const { return m_pos != o.m_pos; }
+	};
+	descriptorIterator descriptorsBegin() const { return descriptorIterator(EITdata+10); }
+	descriptorIterator descriptorsEnd() const { return descriptorIterator(EITdata+10+((ByteSize-10)&~3)); }
+
+	// rebuilds the complete eit event in the given buffer (4108 bytes), the texts converted to UTF-8
+	const eit_event_struct* get(__u8 *buffer, int tsidonid) const;
+	// same in a static buffer.. not reentrant, only valid until the next call of this thread
+	const eit_event_struct* get(int tsidonid) const;
+	int getEventID() const
 	{
 		return (EITdata[0] << 8) | EITdata[1];
 	}
-	time_t getStartTime()
+	time_t getStartTime() const
 	{
 		return parseDVBtime(EITdata[2], EITdata[3], EITdata[4], EITdata[5], EITdata[6]);
 	}
-	int getDuration()
+	int getDuration() const
 	{
 		return fromBCD(EITdata[7])*3600+fromBCD(EITdata[8])*60+fromBCD(EITdata[9]);
 	}
+	bool operator==(const eventData &o) const
+	{
+		return type == o.type && ByteSize == o.ByteSize && !memcmp(EITdata, o.EITdata, ByteSize);
+	}
 };
 #endif
 
@@ -187,6 +268,27 @@ class eEPGCache: public eMainloop, private eThread, public Object
 {
 #ifndef SWIG
 	DECLARE_REF(eEPGCache)
+	// counters of the epg ingestion, per channel and per source.. changed by the epg thread and the imports,
+	// always under m_statsLock
+	struct ingestStatistics
+	{
+		unsigned int sections;                  // received
+		unsigned int duplicates, unchanged;     // received before by this reader run, parsed before with the same crc
+		unsigned int parsed;
+		unsigned long long parseTime;           // us, including the lock wait
+		unsigned int inserted, replaced, skipped;  // events.. skipped when a better source has the event
+		unsigned int overlapChecks, overlapFixes;  // FixOverlapping calls, and the ones which removed events
+		unsigned long long lockWait, lockHold;  // us
+		ingestStatistics &operator+=(const ingestStatistics &o)
+		{
+			sections += o.sections; duplicates += o.duplicates; unchanged += o.unchanged;
+			parsed += o.parsed; parseTime += o.parseTime;
+			inserted += o.inserted; replaced += o.replaced; skipped += o.skipped;
+			overlapChecks += o.overlapChecks; overlapFixes += o.overlapFixes;
+			lockWait += o.lockWait; lockHold += o.lockHold;
+			return *this;
+		}
+	};
 	struct channel_data: public Object
 	{
 		pthread_mutex_t channel_active;
@@ -199,7 +301,8 @@ class eEPGCache: public eMainloop, private eThread, public Object
 		ePtr<eDVBChannel> channel;
 		ePtr<eConnection> m_stateChangedConn, m_NowNextConn, m_ScheduleConn, m_ScheduleOtherConn, m_ViasatConn;
 		ePtr<iDVBSectionReader> m_NowNextReader, m_ScheduleReader, m_ScheduleOtherReader, m_ViasatReader;
-		tidMap seenSections[4], calcedSections[4];
+		eEPGSectionMap sections[4];
+		ingestStatistics stats, runStats;  // since the reset, since startEPG
 #ifdef ENABLE_NETMED
 		ePtr<eConnection> m_NetmedScheduleConn, m_NetmedScheduleOtherConn;
 		ePtr<iDVBSectionReader> m_NetmedScheduleReader, m_NetmedScheduleOtherReader;
@@ -256,6 +359,16 @@ class eEPGCache: public eMainloop, private eThread, public Object
 		void abortNonAvail();
 	};
 	bool FixOverlapping(std::pair<eventMap,timeMap> &servicemap, time_t TM, int duration, const timeMap::iterator &tm_it, const uniqueEPGKey &service);
+	// new events of a section, inserted together so the tables are shifted once per section
+	struct newEvent
+	{
+		__u16 event_id;
+		time_t TM;
+		int duration;
+		eventData *evt;
+	};
+	static bool canDefer(const std::vector<newEvent> &pending, __u16 event_id, time_t TM, int duration);
+	int insertEvents(std::pair<eventMap,timeMap> &servicemap, std::vector<newEvent> &pending, const uniqueEPGKey &service);
 public:
 	struct Message
 	{
@@ -269,7 +382,8 @@ public:
 			got_mhw2_channel_pid,
 			got_mhw2_title_pid,
 			got_mhw2_summary_pid,
-			timeChanged
+			timeChanged,
+			viewedService
 		};
 		int type;
 		iDVBChannel *channel;
@@ -297,6 +411,7 @@ public:
 private:
 	friend class channel_data;
 	friend class eventData;
+	friend class eEPGHarvester;
 	static eEPGCache *instance;
 
 	ePtr<eTimer> cleanTimer;
@@ -309,7 +424,27 @@ private:
 	std::vector<int> onid_blacklist;
 	eventCache eventDB;
 	updateMap channelLastUpdated;
-	static pthread_mutex_t cache_lock, channel_map_lock;
+	eEPGSectionCRCCache m_sectionCRCs;
+	ingestStatistics m_sourceStats[originCount];
+	eSingleLock m_statsLock;
+	int m_statisticsInterval;  // seconds between the dumps of the statistics, 0 = off
+	time_t m_lastStatistics;
+	// the services ordered by the end of their next event, so cleanLoop only visits the expired ones..
+	// a service can be queued more than once, only the entry matching m_expiryTimes is valid
+	typedef std::pair<time_t, uniqueEPGKey> expiryEntry;
+	std::priority_queue<expiryEntry, std::vector<expiryEntry>, std::greater<expiryEntry> > m_expiryQueue;
+	expiryMap m_expiryTimes;
+	// memory ceiling.. the services are evicted by priority: never viewed, viewed, preferred (bouquets)
+	size_t m_memoryLimit;
+	int m_evictStep[3];  // how far each priority is cut down, 0 = not at all
+	time_t m_lastEvict;
+	bool m_reparse;  // the sections skipped by the eviction must be parsed again
+	serviceSet m_preferredServices, m_viewedServices;
+	// the descriptors already in the pool are converted in the clean loop when the compression is switched
+	bool m_compressPass;
+	unsigned int m_compressPos;
+	static eEPGCacheLock cache_lock;
+	static pthread_mutex_t channel_map_lock;
 	std::string m_filename;
 	bool m_running;
 
@@ -318,14 +453,62 @@ private:
 #endif
 
 	void thread();  // thread function
+	bool loadMapped(FILE *f, int &cnt);
+	void indexTitles();
+
+	class saveThread: public eThread
+	{
+		eEPGCache *cache;
+	public:
+		saveThread(eEPGCache *cache): cache(cache) { }
+		void thread();
+	};
+	friend class saveThread;
+	saveThread m_saveThread;
+	eEPGSnapshot m_snapshot;  // only valid while m_saving is set
+	std::string m_saveFilename;
+	bool m_saving;
+	unsigned int m_savedChanges;
+	ePtr<eTimer> saveTimer;
+	eEPGJournal m_journal;
+	bool m_replaying;
+	ePtr<eTimer> journalTimer;
+	eEPGHarvester m_harvester;
+	void replayJournal();
+	void removeEvents(const uniqueEPGKey &service, const std::vector<__u16> &ids);
+	void flushJournal();
+	void takeSnapshot(eEPGSnapshot &snapshot);
+	void writeSnapshot();
+	bool startSave();
+	void waitSave();
 
 #ifdef ENABLE_PRIVATE_EPG
+	void loadPrivateEPG(FILE *f);
 	void privateSectionRead(const uniqueEPGKey &, const __u8 *);
 #endif
 	void sectionRead(const __u8 *data, int source, channel_data *channel);
 	void gotMessage(const Message &message);
 	void flushEPG(const uniqueEPGKey & s=uniqueEPGKey());
 	void cleanLoop();
+	void scheduleExpiry(const uniqueEPGKey &service, time_t expires);
+	void scheduleExpiry();
+	time_t expireEvents(eventCache::iterator DBIt, time_t now);
+#ifdef ENABLE_PRIVATE_EPG
+	void cleanContentTimeTable(const uniqueEPGKey &service, const timeMap &tmMap);
+#endif
+	size_t memoryUsage() const;
+	int servicePriority(const uniqueEPGKey &service) const;
+	time_t evictionLimit(const uniqueEPGKey &service, time_t now) const;
+	int evictEvents(eventCache::iterator DBIt, time_t limit);
+	void enforceMemoryLimit();
+	void compressDescriptors();
+	bool m_corruptRemoved;
+	void removeCorruptFiles();
+	void countIngest(channel_data *channel, int source, const ingestStatistics &counted);
+	void dumpIngestStatistics();
+	static void dumpIngest(const char *name, const ingestStatistics &st);
+	static PyObject *ingestDict(const ingestStatistics &st);
+	static size_t eventSize(const eventData *ev);
 
 // called from main thread
 	void timeUpdated();
@@ -333,8 +516,19 @@ private:
 	void DVBChannelStateChanged(iDVBChannel*);
 	void DVBChannelRunning(iDVBChannel *);
 
-	timeMap::iterator m_timemap_cursor, m_timemap_end;
-	int currentQueryTsidOnid; // needed for getNextTimeEntry.. only valid until next startTimeQuery call
+	// state of startTimeQuery/getNextTimeEntry, one per thread as the queries only hold the read lock..
+	// the flat timemap may change between the calls, so the next entry is searched again by its start
+	// time instead of keeping an iterator
+	struct timeQuery
+	{
+		int sid, onid, tsid;
+		time_t next, end;  // end -1 = no limit
+		int tsidonid;
+		bool active;
+	};
+	static __thread timeQuery m_timeQuery;
+	RESULT timeQueryRange(const eServiceReference &service, time_t begin, int minutes, timeMap::iterator &first, timeMap::iterator &last, int &tsidonid);
+	const eventData *nextTimeEntry();
 #else
 	eEPGCache();
 	~eEPGCache();
@@ -343,6 +537,7 @@ public:
 	static eEPGCache *getInstance() { return instance; }
 
 	void save();
+	void saveAsync();
 	void load();
 #ifndef SWIG
 	eEPGCache();
@@ -351,8 +546,9 @@ public:
 #ifdef ENABLE_PRIVATE_EPG
 	void PMTready(eDVBServicePMTHandler *pmthandler);
 #else
-	void PMTready(eDVBServicePMTHandler *pmthandler) {}
+	void PMTready(eDVBServicePMTHandler *pmthandler) { serviceViewed(pmthandler); }
 #endif
+	void serviceViewed(eDVBServicePMTHandler *pmthandler);
 
 #endif
 	// must be called once!
@@ -398,6 +594,7 @@ public:
 	};
 	PyObject *lookupEvent(SWIG_PYOBJECT(ePyObject) list, SWIG_PYOBJECT(ePyObject) convertFunc=(PyObject*)0);
 	PyObject *search(SWIG_PYOBJECT(ePyObject));
+	PyObject *lookupEventRows(SWIG_PYOBJECT(ePyObject) services, time_t begin=-1, int minutes=0, int count=2);
 
 	// eServiceEvent are parsed epg events.. it's safe to use them after cache unlock
 	// for use from python ( members: m_start_time, m_duration, m_short_description, m_extended_description )
@@ -424,22 +621,38 @@ public:
 	void setEpgHistorySeconds(time_t seconds);
 	void setEpgSources(unsigned int mask);
 	unsigned int getEpgSources();
+	// 0 = no limit.. the far future events and the services not in the preferred list are evicted first
+	void setMemoryLimit(int kbytes);
+	// stores the long texts (extended event descriptors) deflated, the statistics are in getMemoryUsage()
+	void setCompression(bool enabled);
+	void setPreferredServices(SWIG_PYOBJECT(ePyObject) services);
+	// dict with the limit, the memory used and (events, bytes) per source and per service (sid, tsid, onid)
+	PyObject *getMemoryUsage();
+	// dict with the ingestion counters per source and per channel, the memory per source and the cache lock times
+	PyObject *getIngestStatistics();
+	void resetIngestStatistics();
+	// dumps the statistics to the debug log every minutes, 0 = never
+	void setStatisticsInterval(int minutes);
+	// tunes up to tuners idle tuners to the transponders of the services (service reference strings), 0 = off
+	void setHarvester(int tuners, SWIG_PYOBJECT(ePyObject) services);
 
 	void submitEventData(const std::vector<eServiceReferenceDVB>& serviceRefs, long start, long duration, const char* title, const char* short_summary, const char* long_description, char event_type);
 
 	void importEvents(SWIG_PYOBJECT(ePyObject) serviceReferences, SWIG_PYOBJECT(ePyObject) list);
 	void importEvent(SWIG_PYOBJECT(ePyObject) serviceReference, SWIG_PYOBJECT(ePyObject) list);
+	// many events of many services in one packed string, see epgcache.cpp.. returns (events imported, milliseconds)
+	PyObject *importEventsBulk(SWIG_PYOBJECT(ePyObject) services, SWIG_PYOBJECT(ePyObject) events);
 };
 
 #ifndef SWIG
 inline void eEPGCache::Lock()
 {
-	pthread_mutex_lock(&cache_lock);
+	cache_lock.lockRead();
 }
 
 inline void eEPGCache::Unlock()
 {
-	pthread_mutex_unlock(&cache_lock);
+	cache_lock.unlock();
 }
 #endif
 
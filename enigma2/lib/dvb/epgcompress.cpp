@@ -0,0 +1,235 @@
+#include <lib/dvb/epgcompress.h>
+#include <lib/dvb/epgpool.h>
+#include <lib/base/eerror.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+// raw deflate with a 4k window.. the dictionary is all the history a descriptor needs
+#define COMPRESS_WINDOW_BITS 12
+#define COMPRESS_MEM_LEVEL 5
+
+__thread __u8 eEPGCompressor::m_buffer[257];
+
+// the inflate stream of each thread, freed when the thread ends
+static __thread z_stream *threadInflate;
+static pthread_key_t inflateKey;
+static pthread_once_t inflateOnce = PTHREAD_ONCE_INIT;
+static int inflateStreams;
+
+static void freeInflate(void *stream)
+{
+	inflateEnd((z_stream*)stream);
+	delete (z_stream*)stream;
+	__sync_fetch_and_sub(&inflateStreams, 1);
+}
+
+static void createInflateKey()
+{
+	pthread_key_create(&inflateKey, freeInflate);
+}
+
+static unsigned int elapsed(const struct timespec &start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+eEPGCompressor::eEPGCompressor()
+	:m_enabled(false), m_trained(false), m_dictionaryLength(0), m_deflateReady(false)
+{
+	memset(&m_deflate, 0, sizeof(m_deflate));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+eEPGCompressor::~eEPGCompressor()
+{
+	if (m_deflateReady)
+		deflateEnd(&m_deflate);
+}
+
+void eEPGCompressor::train(const __u8 *descr, int len)
+{
+	int n = len - 2;
+	if (n > dictionarySize - m_dictionaryLength)
+		n = dictionarySize - m_dictionaryLength;
+	memcpy(m_dictionary + m_dictionaryLength, descr + 2, n);
+	m_dictionaryLength += n;
+	if (m_dictionaryLength < dictionarySize)
+		return;
+	m_deflateReady = deflateInit2(&m_deflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -COMPRESS_WINDOW_BITS, COMPRESS_MEM_LEVEL, Z_DEFAULT_STRATEGY) == Z_OK;
+	m_trained = m_deflateReady;
+	if (!m_trained)
+		eDebug("[EPGC] could not initialize the descriptor compression");
+	else
+		eDebug("[EPGC] descriptor dictionary complete, compressing extended event descriptors");
+}
+
+__u8 *eEPGCompressor::compress(const __u8 *descr, eEPGAllocator &memory)
+{
+	if (!m_enabled || descr[0] != 0x4E)  // extended event descriptor
+		return 0;
+	int len = descr[1] + 2;
+	if (len < minSize)
+		return 0;
+	if (!m_trained)
+	{
+		if (m_dictionaryLength < dictionarySize)
+			train(descr, len);
+		return 0;
+	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	__u8 out[256];
+	deflateReset(&m_deflate);
+	deflateSetDictionary(&m_deflate, m_dictionary, m_dictionaryLength);
+	m_deflate.next_in = (Bytef*)descr + 2;
+	m_deflate.avail_in = len - 2;
+	m_deflate.next_out = out;
+	/* with the three bytes header it has to be smaller than the descriptor */
+	m_deflate.avail_out = len - 4;
+	int ret = deflate(&m_deflate, Z_FINISH);
+	m_stats.compressTime += elapsed(start);
+	if (ret != Z_STREAM_END)
+	{
+		++m_stats.rejected;
+		return 0;
+	}
+	int size = 3 + (len - 4 - m_deflate.avail_out);
+	__u8 *block = (__u8*)memory.alloc(size);
+	if (!block)
+		return 0;
+	block[0] = marker;
+	block[1] = size - 2;
+	block[2] = descr[1];
+	memcpy(block + 3, out, size - 3);
+	++m_stats.compressed;
+	m_stats.bytesIn += len;
+	m_stats.bytesOut += size;
+	return block;
+}
+
+z_stream *eEPGCompressor::inflateStream()
+{
+	if (threadInflate)
+		return threadInflate;
+	pthread_once(&inflateOnce, createInflateKey);
+	z_stream *stream = new z_stream;
+	memset(stream, 0, sizeof(*stream));
+	if (inflateInit2(stream, -COMPRESS_WINDOW_BITS) != Z_OK)
+	{
+		eDebug("[EPGC] could not initialize the descriptor decompression");
+		delete stream;
+		return 0;
+	}
+	pthread_setspecific(inflateKey, stream);
+	__sync_fetch_and_add(&inflateStreams, 1);
+	return threadInflate = stream;
+}
+
+// the dictionary doesn't change once it is complete, so no lock is needed
+bool eEPGCompressor::inflateBlock(const __u8 *data, __u8 *buffer)
+{
+	z_stream *stream = m_trained ? inflateStream() : 0;
+	if (!stream)
+		return false;
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	inflateReset(stream);
+	inflateSetDictionary(stream, m_dictionary, m_dictionaryLength);
+	stream->next_in = (Bytef*)data + 3;
+	stream->avail_in = data[1] - 1;
+	stream->next_out = buffer + 2;
+	stream->avail_out = data[2];
+	int ret = inflate(stream, Z_FINISH);
+	buffer[0] = 0x4E;
+	buffer[1] = data[2];
+	__sync_fetch_and_add(&m_stats.expanded, 1);
+	__sync_fetch_and_add(&m_stats.expandTime, elapsed(start));
+	if (ret != Z_STREAM_END || stream->avail_out)
+	{
+		eDebug("[EPGC] broken compressed descriptor");
+		return false;
+	}
+	return true;
+}
+
+const __u8 *eEPGCompressor::expand(__u32 crc, const __u8 *data)
+{
+	if (!isCompressed(data))
+		return data;
+	{
+		eSingleLocker l(m_lock);
+		hotMap::iterator it = m_hotIndex.find(crc);
+		if (it != m_hotIndex.end())
+		{
+			++m_stats.hits;
+			m_hot.splice(m_hot.begin(), m_hot, it->second);  // most recently used first
+			memcpy(m_buffer, it->second->data, length(data));
+			return m_buffer;
+		}
+	}
+	if (!inflateBlock(data, m_buffer))
+		return 0;
+	eSingleLocker l(m_lock);
+	if (m_hotIndex.find(crc) != m_hotIndex.end())  // another thread was faster
+		return m_buffer;
+	if (m_hot.size() >= hotEntries)
+	{
+		m_hotIndex.erase(m_hot.back().crc);
+		m_hot.pop_back();
+	}
+	m_hot.push_front(hotEntry());
+	m_hot.front().crc = crc;
+	memcpy(m_hot.front().data, m_buffer, length(data));
+	m_hotIndex[crc] = m_hot.begin();
+	return m_buffer;
+}
+
+bool eEPGCompressor::expand(const __u8 *data, __u8 *buffer)
+{
+	if (!isCompressed(data))
+	{
+		memcpy(buffer, data, data[1] + 2);
+		return true;
+	}
+	return inflateBlock(data, buffer);
+}
+
+void eEPGCompressor::clear()
+{
+	eSingleLocker l(m_lock);
+	m_hotIndex.clear();
+	m_hot.clear();
+}
+
+void eEPGCompressor::getStatistics(statistics &stats)
+{
+	eSingleLocker l(m_lock);
+	stats = m_stats;
+}
+
+void eEPGCompressor::dumpStatistics()
+{
+	statistics s;
+	getStatistics(s);
+	if (!m_enabled && !s.compressed)
+		return;
+	eDebug("[EPGC] descriptor compression %s: %u compressed %u -> %u bytes in %u us, %u rejected, %u inflated in %u us, %u from the LRU",
+		m_enabled ? (m_trained ? "on" : "training") : "off",
+		s.compressed, (unsigned int)s.bytesIn, (unsigned int)s.bytesOut, s.compressTime, s.rejected,
+		s.expanded, s.expandTime, s.hits);
+}
+
+size_t eEPGCompressor::memoryUsage()
+{
+	eSingleLocker l(m_lock);
+	size_t size = m_hot.size() * (sizeof(hotEntry) + 2 * sizeof(void*) + sizeof(hotMap::value_type) + sizeof(void*));
+	/* the zlib states, from the memory footprint in zconf.h */
+	if (m_deflateReady)
+		size += (1 << (COMPRESS_WINDOW_BITS + 2)) + (1 << (COMPRESS_MEM_LEVEL + 9));
+	size += inflateStreams * ((1 << COMPRESS_WINDOW_BITS) + 7168);
+	return size;
+}
@@ -0,0 +1,99 @@
+#ifndef __lib_dvb_epgcompress_h
+#define __lib_dvb_epgcompress_h
+
+#include <list>
+#include <stddef.h>
+#include <asm/types.h>
+#include <ext/hash_map>
+#include <zlib.h>
+#include <lib/base/elock.h>
+
+class eEPGAllocator;
+
+/*
+ * Optional compressed storage of the extended event descriptors in the
+ * descriptor pool. The long texts rarely share a crc, so they make up most
+ * of the pool, but one descriptor is too short for deflate on its own.
+ * The first dictionarySize bytes of extended descriptors seen are kept as
+ * preset dictionary, all later ones are deflated against it. The dictionary
+ * never changes afterwards, so every compressed block stays readable.
+ *
+ * A compressed block looks like a descriptor with the forbidden tag 0xFF,
+ * so data[1]+2 is still the size of the block:
+ *   0xFF, block length - 2, length byte of the original descriptor, raw deflate data
+ *
+ * Lookups expand the blocks into a per thread buffer with an inflate stream
+ * of the calling thread, the recently expanded ones are kept in a small LRU
+ * so the events shown over and over (now/next, the list of the current
+ * service) are not inflated again. Only the LRU is locked.
+ * compress() is only called by the writer of the epg cache, expand() is
+ * thread safe.
+ */
+class eEPGCompressor
+{
+public:
+	enum { marker = 0xFF, minSize = 64, dictionarySize = 4096, hotEntries = 256 };
+	struct statistics
+	{
+		unsigned int compressed;     // blocks compressed
+		unsigned int rejected;       // descriptors which didn't get smaller
+		size_t bytesIn, bytesOut;    // size of the compressed descriptors before and after
+		unsigned int compressTime;   // us
+		unsigned int expanded;       // blocks inflated
+		unsigned int hits;           // expanded from the LRU
+		unsigned int expandTime;     // us
+	};
+
+	eEPGCompressor();
+	~eEPGCompressor();
+
+	static bool isCompressed(const __u8 *data) { return data[0] == marker; }
+	/* length of the descriptor stored in data */
+	static int length(const __u8 *data) { return (isCompressed(data) ? data[2] : data[1]) + 2; }
+
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+	bool enabled() const { return m_enabled; }
+	bool trained() const { return m_trained; }
+
+	/* returns the compressed descriptor in a block of memory, or 0 when it is
+	   not compressed (disabled, no extended event descriptor, no gain) */
+	__u8 *compress(const __u8 *descr, eEPGAllocator &memory);
+	/* returns the descriptor stored in data.. compressed ones are expanded into
+	   a buffer of the calling thread, valid until its next call */
+	const __u8 *expand(__u32 crc, const __u8 *data);
+	/* expands the compressed block into buffer (at least length(data) bytes) */
+	bool expand(const __u8 *data, __u8 *buffer);
+	void clear();
+
+	void getStatistics(statistics &stats);
+	void dumpStatistics();
+	size_t memoryUsage();
+private:
+	struct hotEntry
+	{
+		__u32 crc;
+		__u8 data[257];
+	};
+	typedef std::list<hotEntry> hotList;
+	typedef __gnu_cxx::hash_map<__u32, hotList::iterator> hotMap;
+
+	bool m_enabled, m_trained;
+	__u8 m_dictionary[dictionarySize];
+	int m_dictionaryLength;
+	z_stream m_deflate;
+	bool m_deflateReady;
+	eSingleLock m_lock;  // the LRU and its hits
+	hotList m_hot;
+	hotMap m_hotIndex;
+	statistics m_stats;
+	static __thread __u8 m_buffer[257];
+
+	void train(const __u8 *descr, int len);
+	static z_stream *inflateStream();
+	bool inflateBlock(const __u8 *data, __u8 *buffer);
+
+	eEPGCompressor(const eEPGCompressor &);
+	eEPGCompressor &operator=(const eEPGCompressor &);
+};
+
+#endif
@@ -0,0 +1,526 @@
+#include <lib/dvb/epgfile.h>
+#include <lib/dvb/crc32.h>
+#include <lib/base/eerror.h>
+
+#include <string>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+eEPGMappedFile::eEPGMappedFile()
+	:m_data(0), m_size(0), m_refcount(0)
+{
+}
+
+eEPGMappedFile::~eEPGMappedFile()
+{
+	unmap();
+}
+
+int eEPGMappedFile::map(int fd)
+{
+	struct stat s;
+	if (m_data)
+	{
+		eDebug("[EPGC] previous epg file still mapped (%u references)", m_refcount);
+		return -1;
+	}
+	if (fstat(fd, &s) < 0 || s.st_size < EPG_FILE_HEADER_SIZE)
+		return -1;
+	void *data = mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+	{
+		eDebug("[EPGC] mmap epg file failed (%m)");
+		return -1;
+	}
+	/* all of it is touched while the cache is built */
+	madvise(data, s.st_size, MADV_WILLNEED);
+	m_data = (const __u8*)data;
+	m_size = s.st_size;
+	m_refcount = 0;
+	return 0;
+}
+
+void eEPGMappedFile::unmap()
+{
+	if (m_data)
+	{
+		munmap((void*)m_data, m_size);
+		m_data = 0;
+		m_size = 0;
+		m_refcount = 0;
+	}
+}
+
+static void writePadding(FILE *f, __u64 &pos)
+{
+	static const __u8 zero[8] = { 0 };
+	int pad = (8 - (pos & 7)) & 7;
+	if (pad)
+		fwrite(zero, pad, 1, f);
+	pos += pad;
+}
+
+int eEPGSnapshot::write(const char *filename) const
+{
+	/* never write into the old file.. it is still mapped when it was loaded at startup */
+	std::string filenamex = std::string(filename) + ".writing";
+	const char* EPGDATX = filenamex.c_str();
+
+	/* create empty file */
+	FILE *f = fopen(EPGDATX, "w");
+	if (!f)
+	{
+		eDebug("[EPGC] couldn't save epg data to '%s'(%m)", EPGDATX);
+		return -1;
+	}
+
+	char* buf = realpath(EPGDATX, NULL);
+	if (!buf)
+	{
+		eDebug("[EPGC] realpath to '%s' failed in save (%m)", EPGDATX);
+		fclose(f);
+		unlink(EPGDATX);
+		return -1;
+	}
+
+	eDebug("[EPGC] store epg to realpath '%s'", buf);
+
+	struct statfs s;
+	off64_t tmp;
+	if (statfs(buf, &s) < 0) {
+		eDebug("[EPGC] statfs '%s' failed in save (%m)", buf);
+		fclose(f);
+		unlink(EPGDATX);
+		free(buf);
+		return -1;
+	}
+
+	free(buf);
+
+	// check for enough free space on storage
+	tmp=s.f_bfree;
+	tmp*=s.f_bsize;
+	if ( tmp < (cacheSize*12)/10 ) // 20% overhead
+	{
+		eDebug("[EPGC] not enough free space at path '%s' %lld bytes availd but %d needed", EPGDATX, tmp, (cacheSize*12)/10);
+		fclose(f);
+		unlink(EPGDATX);
+		return -1;
+	}
+
+	epgFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = EPG_FILE_MAGIC;
+	memcpy(header.version, "UNFINISHED_V8", 13);
+	header.headerSize = EPG_FILE_HEADER_SIZE;
+	fwrite(&header, sizeof(header), 1, f);
+	__u64 pos = EPG_FILE_HEADER_SIZE;
+	fseeko(f, pos, SEEK_SET);
+
+	// service index
+	header.serviceCount = services.size();
+	header.serviceIndexOffset = pos;
+	__u64 offset = 0;
+	std::vector<event>::const_iterator ev(events.begin());
+	for (std::vector<service>::const_iterator it(services.begin()); it != services.end(); ++it)
+	{
+		epgFileService service;
+		memset(&service, 0, sizeof(service));
+		service.sid = it->sid;
+		service.onid = it->onid;
+		service.tsid = it->tsid;
+		service.eventCount = it->eventCount;
+		service.eventOffset = offset;
+		for (unsigned int i = 0; i < it->eventCount; ++i, ++ev)
+			offset += epgFileRecordSize(ev->len);
+		header.eventCount += service.eventCount;
+		fwrite(&service, sizeof(service), 1, f);
+	}
+	pos += (__u64)header.serviceCount * sizeof(epgFileService);
+	writePadding(f, pos);
+
+	// event records
+	header.eventOffset = pos;
+	header.eventSize = offset;
+	for (ev = events.begin(); ev != events.end(); ++ev)
+	{
+		__u8 record[2+255+3];
+		int size = epgFileRecordSize(ev->len);
+		record[0] = ev->type;
+		record[1] = ev->len;
+		memcpy(record+2, ev->data, ev->len);
+		memset(record+2+ev->len, 0, size-ev->len-2);
+		fwrite(record, size, 1, f);
+	}
+	pos += offset;
+	writePadding(f, pos);
+
+	// descriptor index and data
+	header.descriptorCount = descriptors.size();
+	header.descriptorIndexOffset = pos;
+	offset = 0;
+	for (std::vector<descriptor>::const_iterator it(descriptors.begin()); it != descriptors.end(); ++it)
+	{
+		epgFileDescriptor descr;
+		descr.crc = it->crc;
+		descr.refcount = it->refcount;
+		descr.offset = offset;
+		offset += it->data[1]+2;
+		fwrite(&descr, sizeof(descr), 1, f);
+	}
+	pos += (__u64)header.descriptorCount * sizeof(epgFileDescriptor);
+	writePadding(f, pos);
+	header.descriptorOffset = pos;
+	header.descriptorSize = offset;
+	for (std::vector<descriptor>::const_iterator it(descriptors.begin()); it != descriptors.end(); ++it)
+		fwrite(it->data, it->data[1]+2, 1, f);
+	pos += offset;
+	writePadding(f, pos);
+
+	if (!privateData.empty())
+	{
+		header.privateOffset = pos;
+		fwrite(&privateData[0], privateData.size(), 1, f);
+	}
+
+	fflush(f);
+	header.fileSize = ftello(f);
+	// write the complete header after the binary data
+	// has been written to disk.
+	fsync(fileno(f));
+	memcpy(header.version, "ENIGMA_EPG_V8", 13);
+	fseeko(f, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, f);
+	fflush(f);
+	fsync(fileno(f));
+	if (ferror(f))
+	{
+		eDebug("[EPGC] write to '%s' failed", EPGDATX);
+		fclose(f);
+		unlink(EPGDATX);
+		return -1;
+	}
+	fclose(f);
+	if (rename(EPGDATX, filename))
+	{
+		eDebug("[EPGC] rename '%s' to '%s' failed (%m)", EPGDATX, filename);
+		unlink(EPGDATX);
+		return -1;
+	}
+	eDebug("[EPGC] %u events written to %s", header.eventCount, filename);
+	return 0;
+}
+
+void eEPGSnapshot::clear()
+{
+	/* give the memory back.. a snapshot of a full cache is some MB big */
+	std::vector<service>().swap(services);
+	std::vector<event>().swap(events);
+	std::vector<descriptor>().swap(descriptors);
+	std::vector<__u8>().swap(privateData);
+	std::vector<__u8>().swap(expanded);
+	cacheSize = 0;
+}
+
+eEPGJournal::eEPGJournal()
+	:m_fd(-1)
+{
+}
+
+eEPGJournal::~eEPGJournal()
+{
+	close();
+}
+
+void eEPGJournal::setFilename(const std::string &filename)
+{
+	eSingleLocker l(m_lock);
+	close();
+	m_filename = filename;
+}
+
+void eEPGJournal::addEvent(int sid, int onid, int tsid, int source, const __u8 *event, int len)
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return;
+	reserve(9 + len);
+	m_batch.push_back(recordEvent);
+	m_batch.push_back(source);
+	put16(sid);
+	put16(onid);
+	put16(tsid);
+	put16(len);
+	put(event, len);
+}
+
+void eEPGJournal::addFlush(int sid, int onid, int tsid)
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return;
+	reserve(7);
+	m_batch.push_back(recordFlush);
+	put16(sid);
+	put16(onid);
+	put16(tsid);
+}
+
+void eEPGJournal::addFlushAll()
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return;
+	reserve(1);
+	m_batch.push_back(recordFlushAll);
+}
+
+void eEPGJournal::addRemove(int sid, int onid, int tsid, const std::vector<__u16> &event_ids)
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty() || event_ids.empty())
+		return;
+	// a record has to fit into one batch
+	const size_t maxIds = (maxBatchSize - 9) / sizeof(__u16);
+	for (size_t pos = 0; pos < event_ids.size(); pos += maxIds)
+	{
+		int count = std::min(event_ids.size() - pos, maxIds);
+		reserve(9 + count * sizeof(__u16));
+		m_batch.push_back(recordRemove);
+		put16(sid);
+		put16(onid);
+		put16(tsid);
+		put16(count);
+		put(&event_ids[pos], count * sizeof(__u16));
+	}
+}
+
+bool eEPGJournal::batchFull()
+{
+	eSingleLocker l(m_lock);
+	return m_batch.size() >= maxBatchSize;
+}
+
+// the batch is written first when the record wouldn't fit anymore, read() rejects bigger ones
+void eEPGJournal::reserve(size_t len)
+{
+	if (!m_batch.empty() && m_batch.size() + len > maxBatchSize)
+		write();
+}
+
+int eEPGJournal::open()
+{
+	if (m_fd >= 0)
+		return 0;
+	m_fd = ::open(m_filename.c_str(), O_WRONLY|O_CREAT|O_APPEND, 0644);
+	if (m_fd < 0)
+	{
+		eDebug("[EPGC] couldn't open epg journal '%s' (%m)", m_filename.c_str());
+		return -1;
+	}
+	/* a torn batch at the end (crash) would hide everything appended after it */
+	off_t valid = validSize(m_filename);
+	if (lseek(m_fd, 0, SEEK_END) != valid)
+	{
+		eDebug("[EPGC] epg journal '%s' truncated to %lld bytes", m_filename.c_str(), (long long)valid);
+		if (ftruncate(m_fd, valid))
+		{
+			eDebug("[EPGC] truncate epg journal failed (%m)");
+			close();
+			return -1;
+		}
+	}
+	if (valid == 0)
+	{
+		__u8 header[17];
+		unsigned int magic = EPG_FILE_MAGIC;
+		memcpy(header, &magic, 4);
+		memcpy(header + 4, "ENIGMA_EPG_J2", 13);
+		if (::write(m_fd, header, sizeof(header)) != sizeof(header))
+		{
+			close();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void eEPGJournal::close()
+{
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+void eEPGJournal::flush()
+{
+	eSingleLocker l(m_lock);
+	write();
+}
+
+// m_lock must be held
+void eEPGJournal::write()
+{
+	if (m_batch.empty())
+		return;
+	if (open())
+	{
+		m_batch.clear();
+		return;
+	}
+	__u32 frame[2];
+	frame[0] = m_batch.size();
+	frame[1] = crc32(0xFFFFFFFF, &m_batch[0], m_batch.size());
+	if (::write(m_fd, frame, sizeof(frame)) != sizeof(frame) ||
+		::write(m_fd, &m_batch[0], m_batch.size()) != (ssize_t)m_batch.size())
+	{
+		/* the batch is lost.. the next snapshot contains it anyway */
+		eDebug("[EPGC] write to epg journal failed (%m)");
+		close();
+	}
+	m_batch.clear();
+}
+
+void eEPGJournal::rotate()
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return;
+	close();
+	std::string prev = m_filename + ".prev";
+	if (access(prev.c_str(), F_OK))
+	{
+		if (rename(m_filename.c_str(), prev.c_str()) && errno != ENOENT)
+			eDebug("[EPGC] rename epg journal failed (%m)");
+	}
+	else
+	{
+		/* the last snapshot was not written.. keep all changes since the one before.
+		   the batches are appended after the last valid one of .prev, the torn end
+		   of either file is dropped */
+		off_t prevSize = validSize(prev);
+		off_t size = validSize(m_filename);
+		FILE *in = fopen(m_filename.c_str(), "r");
+		FILE *out = 0;
+		if (prevSize && !truncate(prev.c_str(), prevSize))
+			out = fopen(prev.c_str(), "a");
+		if (in && out)
+		{
+			char buf[4096];
+			size_t len;
+			off_t pos = 17;
+			fseek(in, pos, SEEK_SET);
+			while (pos < size && (len = fread(buf, 1, std::min((off_t)sizeof(buf), size - pos), in)) > 0)
+			{
+				fwrite(buf, len, 1, out);
+				pos += len;
+			}
+		}
+		else if (in)
+		{
+			/* .prev is unusable, the current journal replaces it */
+			fclose(in);
+			in = 0;
+			if (rename(m_filename.c_str(), prev.c_str()))
+				eDebug("[EPGC] rename epg journal failed (%m)");
+		}
+		if (in)
+			fclose(in);
+		if (out)
+			fclose(out);
+		unlink(m_filename.c_str());
+	}
+	m_batch.clear();
+}
+
+void eEPGJournal::removeRotated()
+{
+	eSingleLocker l(m_lock);
+	if (!m_filename.empty())
+		unlink((m_filename + ".prev").c_str());
+}
+
+void eEPGJournal::remove()
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return;
+	close();
+	m_batch.clear();
+	unlink(m_filename.c_str());
+	unlink((m_filename + ".prev").c_str());
+}
+
+// the size of the header and the complete batches, 0 when the file is missing or unknown
+off_t eEPGJournal::validSize(const std::string &filename)
+{
+	std::vector<__u8> records;
+	off_t size = 0;
+	readFile(filename, records, &size);
+	return size;
+}
+
+int eEPGJournal::readFile(const std::string &filename, std::vector<__u8> &records, off_t *size)
+{
+	FILE *f = fopen(filename.c_str(), "r");
+	if (!f)
+		return 0;
+	int batches = 0;
+	__u8 header[17];
+	unsigned int magic = 0;
+	if (fread(header, sizeof(header), 1, f) == 1)
+		memcpy(&magic, header, 4);
+	if (magic != EPG_FILE_MAGIC || memcmp(header + 4, "ENIGMA_EPG_J2", 13))
+	{
+		eDebug("[EPGC] unknown epg journal '%s'.. ignore it", filename.c_str());
+		fclose(f);
+		return 0;
+	}
+	off_t end = sizeof(header);
+	while (1)
+	{
+		__u32 frame[2];
+		if (fread(frame, sizeof(frame), 1, f) != 1)
+			break;
+		if (!frame[0] || frame[0] > maxBatchSize)
+		{
+			eDebug("[EPGC] epg journal '%s' has a bad batch size", filename.c_str());
+			break;
+		}
+		size_t pos = records.size();
+		records.resize(pos + frame[0]);
+		if (fread(&records[pos], frame[0], 1, f) != 1 ||
+			crc32(0xFFFFFFFF, &records[pos], frame[0]) != frame[1])
+		{
+			records.resize(pos);
+			eDebug("[EPGC] epg journal '%s' ends with an incomplete batch", filename.c_str());
+			break;
+		}
+		end += sizeof(frame) + frame[0];
+		++batches;
+	}
+	fclose(f);
+	if (size)
+		*size = end;
+	return batches;
+}
+
+int eEPGJournal::read(std::vector<__u8> &records)
+{
+	eSingleLocker l(m_lock);
+	if (m_filename.empty())
+		return 0;
+	int batches = readFile(m_filename + ".prev", records);
+	return batches + readFile(m_filename, records);
+}
@@ -0,0 +1,207 @@
+#ifndef __lib_dvb_epgfile_h
+#define __lib_dvb_epgfile_h
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <asm/types.h>
+#include <vector>
+#include <string>
+#include <lib/base/elock.h>
+
+/*
+ * Layout of epg.dat version 8. The file is mapped read only at startup and the
+ * cache uses the event and descriptor data directly from the mapping.
+ *
+ *   header            one page, version is "UNFINISHED_V8" until the file is complete
+ *   service index     serviceCount * epgFileService, sorted like the records
+ *   event records     per service contiguous, each one __u8 type, __u8 len and
+ *                     len bytes EIT data (10 bytes header + descriptor crcs),
+ *                     padded to 4 bytes so the crc list is aligned
+ *   descriptor index  descriptorCount * epgFileDescriptor
+ *   descriptor blob   the raw descriptors, referenced by the index
+ *   private epg       same stream as in version 7 ("PRIVATE_EPG" ...)
+ *
+ * Everything is stored in host byte order, the magic detects foreign files.
+ * Sections start 8 byte aligned.
+ */
+
+#define EPG_FILE_MAGIC 0x98765432
+#define EPG_FILE_HEADER_SIZE 4096
+
+struct epgFileHeader
+{
+	__u32 magic;
+	char version[13];
+	__u8 reserved[3];
+	__u32 headerSize;
+	__u32 serviceCount;
+	__u32 eventCount;
+	__u32 descriptorCount;
+	__u64 serviceIndexOffset;
+	__u64 eventOffset;
+	__u64 eventSize;
+	__u64 descriptorIndexOffset;
+	__u64 descriptorOffset;
+	__u64 descriptorSize;
+	__u64 privateOffset;
+	__u64 fileSize;
+};
+
+struct epgFileService
+{
+	int sid, onid, tsid;
+	__u32 eventCount;
+	__u64 eventOffset; // relative to the start of the event records
+};
+
+struct epgFileDescriptor
+{
+	__u32 crc;
+	__u32 refcount;
+	__u32 offset;      // relative to the start of the descriptor blob
+};
+
+// size of an event record.. type, len and the EIT data padded to 4 bytes
+static inline int epgFileRecordSize(int len)
+{
+	return (2 + len + 3) & ~3;
+}
+
+/*
+ * Everything needed to write an epg.dat, taken from the cache with the cache
+ * lock held. The event and descriptor data is not copied, the cache keeps
+ * all blocks alive until the snapshot is released. Only the compressed
+ * descriptors are copied, expanded, so the file does not depend on them.
+ */
+struct eEPGSnapshot
+{
+	struct service
+	{
+		int sid, onid, tsid;
+		unsigned int eventCount;
+	};
+	struct event
+	{
+		const __u8 *data;
+		__u8 len;
+		__u8 type;
+	};
+	struct descriptor
+	{
+		__u32 crc;
+		__u32 refcount;
+		const __u8 *data;
+	};
+	std::vector<service> services;
+	std::vector<event> events;
+	std::vector<descriptor> descriptors;
+	std::vector<__u8> privateData;  // "PRIVATE_EPG" stream, may be empty
+	std::vector<__u8> expanded;     // the compressed descriptors are written expanded, they live here
+	int cacheSize;
+
+	/* writes a temporary file and renames it to filename.. returns 0 on success */
+	int write(const char *filename) const;
+	void clear();
+};
+
+/*
+ * Read only mapping of an epg.dat file. Every block still used by the cache
+ * holds a reference, the mapping goes away with the last one.
+ */
+class eEPGMappedFile
+{
+	const __u8 *m_data;
+	size_t m_size;
+	unsigned int m_refcount;
+public:
+	eEPGMappedFile();
+	~eEPGMappedFile();
+
+	/* maps the complete file.. returns 0 on success */
+	int map(int fd);
+	void unmap();
+
+	const __u8 *data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool contains(const void *ptr) const
+	{
+		return m_data && (const __u8*)ptr >= m_data && (const __u8*)ptr < m_data + m_size;
+	}
+	/* returns 0 when the range is not completely inside the mapping */
+	const __u8 *at(__u64 offset, __u64 len) const
+	{
+		if (offset > m_size || len > m_size - offset)
+			return 0;
+		return m_data + offset;
+	}
+
+	void ref() { ++m_refcount; }
+	void unref()
+	{
+		if (!--m_refcount)
+			unmap();
+	}
+	unsigned int refcount() const { return m_refcount; }
+};
+
+/*
+ * Append only journal of the changes since the last epg.dat, so a restart
+ * after a crash does not lose everything harvested since then.
+ * The file starts with the usual magic and "ENIGMA_EPG_J2", followed by
+ * batches of records: __u32 payload length, __u32 crc32 of the payload, payload.
+ * Records:
+ *   recordEvent    __u8 type, __u8 source, __u16 sid, onid, tsid, __u16 len, len bytes raw EIT event
+ *   recordFlush    __u8 type, __u16 sid, onid, tsid
+ *   recordFlushAll __u8 type
+ *   recordRemove   __u8 type, __u16 sid, onid, tsid, __u16 count, count __u16 event ids
+ *                  (events removed by the expiry or the memory limit)
+ * A batch is at most maxBatchSize bytes, one with a bad length or crc ends the
+ * journal (torn write at a crash). It is cut off before anything is appended.
+ * When a snapshot is taken the journal is rotated to .prev, which is removed
+ * when the snapshot is on disk. At startup .prev and the journal are replayed.
+ * Thread safe.
+ */
+class eEPGJournal
+{
+public:
+	enum { recordEvent = 1, recordFlush = 2, recordFlushAll = 3, recordRemove = 4 };
+	enum { maxBatchSize = 65536 };
+
+	eEPGJournal();
+	~eEPGJournal();
+
+	void setFilename(const std::string &filename);
+	/* records are collected in memory and written as one batch by flush(), or before
+	   a record that would make the batch bigger than maxBatchSize */
+	void addEvent(int sid, int onid, int tsid, int source, const __u8 *event, int len);
+	void addFlush(int sid, int onid, int tsid);
+	void addFlushAll();
+	void addRemove(int sid, int onid, int tsid, const std::vector<__u16> &event_ids);
+	bool batchFull();
+	void flush();
+	/* called when a snapshot is taken.. the snapshot contains everything journaled so far */
+	void rotate();
+	/* called when the snapshot is written */
+	void removeRotated();
+	/* removes all journal files */
+	void remove();
+
+	/* reads the records of .prev and the current journal, returns the number of valid batches */
+	int read(std::vector<__u8> &records);
+private:
+	eSingleLock m_lock;
+	std::string m_filename;
+	std::vector<__u8> m_batch;
+	int m_fd;
+
+	void put(const void *data, int len) { m_batch.insert(m_batch.end(), (const __u8*)data, (const __u8*)data + len); }
+	void put16(int value) { __u16 v = value; put(&v, 2); }
+	void reserve(size_t len);
+	void write();
+	int open();
+	void close();
+	static off_t validSize(const std::string &filename);
+	static int readFile(const std::string &filename, std::vector<__u8> &records, off_t *size = 0);
+};
+
+#endif
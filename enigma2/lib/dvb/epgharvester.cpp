@@ -0,0 +1,121 @@
+#include <lib/dvb/epgharvester.h>
+#include <lib/dvb/epgcache.h>
+#include <lib/dvb/dvb.h>
+#include <lib/base/eerror.h>
+
+#include <algorithm>
+#include <time.h>
+
+eEPGHarvester::eEPGHarvester(eEPGCache *cache)
+	:m_cache(cache), m_timer(eTimer::create(eApp)), m_tuners(0)
+{
+	CONNECT(m_timer->timeout, eEPGHarvester::check);
+}
+
+eEPGHarvester::~eEPGHarvester()
+{
+	releaseAll();
+}
+
+void eEPGHarvester::setTuners(int count)
+{
+	eDebug("[EPGC] harvest with %d idle tuners", count);
+	m_tuners = count > 0 ? count : 0;
+	if (m_tuners)
+		m_timer->start(0, true);
+	else
+	{
+		m_timer->stop();
+		releaseAll();
+	}
+}
+
+void eEPGHarvester::setChannels(const std::vector<eDVBChannelID> &channels)
+{
+	eDebug("[EPGC] %d transponders to harvest", (int)channels.size());
+	m_channels = channels;
+}
+
+void eEPGHarvester::releaseAll()
+{
+	ePtr<eDVBResourceManager> res_mgr;
+	if (!eDVBResourceManager::getInstance(res_mgr))
+	{
+		for (std::vector<harvest>::iterator it = m_active.begin(); it != m_active.end(); ++it)
+			res_mgr->releaseBackgroundChannel(it->channel);
+	}
+	m_active.clear();
+}
+
+time_t eEPGHarvester::lastUpdated(const eDVBChannelID &channel)
+{
+	eEPGReadLocker l(eEPGCache::cache_lock);
+	updateMap::iterator it = m_cache->channelLastUpdated.find(channel);
+	return it != m_cache->channelLastUpdated.end() ? it->second : 0;
+}
+
+void eEPGHarvester::check()
+{
+	ePtr<eDVBResourceManager> res_mgr;
+	if (eDVBResourceManager::getInstance(res_mgr))
+		return;
+	time_t now = ::time(0);
+
+	for (std::vector<harvest>::iterator it = m_active.begin(); it != m_active.end();)
+	{
+		bool done = lastUpdated(it->channel) >= it->started;
+		// the resource manager drops the channel when the frontend is needed
+		bool lost = !res_mgr->hasBackgroundChannel(it->channel);
+		if (done || lost || now - it->started > HARVEST_TIMEOUT || (int)m_active.size() > m_tuners)
+		{
+			if (done)
+				eDebug("[EPGC] harvested %04x:%04x in %d sec", it->channel.transport_stream_id.get(),
+					it->channel.original_network_id.get(), (int)(now - it->started));
+			else
+				eDebug("[EPGC] harvest of %04x:%04x %s", it->channel.transport_stream_id.get(),
+					it->channel.original_network_id.get(), lost ? "preempted" : "aborted");
+			if (!lost)
+				res_mgr->releaseBackgroundChannel(it->channel);
+			it = m_active.erase(it);
+		}
+		else
+			++it;
+	}
+
+	if ((int)m_active.size() < m_tuners)
+	{
+		// the transponders with the oldest epg first
+		std::vector<std::pair<time_t, eDVBChannelID> > candidates;
+		for (std::vector<eDVBChannelID>::iterator it = m_channels.begin(); it != m_channels.end(); ++it)
+		{
+			bool active = false;
+			for (std::vector<harvest>::iterator a = m_active.begin(); a != m_active.end() && !active; ++a)
+				active = a->channel == *it;
+			if (active)
+				continue;
+			time_t updated = lastUpdated(*it);
+			if (now - updated < UPDATE_INTERVAL / 1000)
+				continue;
+			std::map<eDVBChannelID, time_t>::iterator attempt = m_lastAttempt.find(*it);
+			if (attempt != m_lastAttempt.end() && now - attempt->second < UPDATE_INTERVAL / 1000)
+				continue;
+			candidates.push_back(std::pair<time_t, eDVBChannelID>(updated, *it));
+		}
+		std::sort(candidates.begin(), candidates.end());
+		for (std::vector<std::pair<time_t, eDVBChannelID> >::iterator it = candidates.begin();
+			it != candidates.end() && (int)m_active.size() < m_tuners; ++it)
+		{
+			m_lastAttempt[it->second] = now;
+			int err = res_mgr->allocateBackgroundChannel(it->second);
+			if (!err)
+			{
+				eDebug("[EPGC] harvest %04x:%04x", it->second.transport_stream_id.get(), it->second.original_network_id.get());
+				m_active.push_back(harvest(it->second, now));
+			}
+			else if (err == eDVBResourceManager::errAllSourcesBusy)
+				break;  // no idle tuner left
+		}
+	}
+	if (m_tuners)
+		m_timer->start(m_active.empty() ? HARVEST_INTERVAL : HARVEST_CHECK, true);
+}
@@ -0,0 +1,51 @@
+#ifndef __lib_dvb_epgharvester_h
+#define __lib_dvb_epgharvester_h
+
+#include <vector>
+#include <map>
+#include <lib/base/ebase.h>
+#include <lib/dvb/idvb.h>
+
+#define HARVEST_INTERVAL 60000  // 1 min.. looking for idle tuners
+#define HARVEST_CHECK 10000     // 10 sek while harvesting
+#define HARVEST_TIMEOUT 300     // 5 min
+
+class eEPGCache;
+
+/*
+ * Tunes idle frontends to the transponders of the given services in the
+ * background, so their epg gets cached without zapping around. The transponders
+ * are visited by the age of their last complete epg (channelLastUpdated of the
+ * cache), several at once when there are idle tuners. Only the resource manager
+ * holds the channels, so it gives them up at once when a live zap or a recording
+ * needs the frontend.
+ * Runs in the main thread.
+ */
+class eEPGHarvester: public Object
+{
+public:
+	eEPGHarvester(eEPGCache *cache);
+	~eEPGHarvester();
+
+	void setTuners(int count);
+	void setChannels(const std::vector<eDVBChannelID> &channels);
+private:
+	struct harvest
+	{
+		eDVBChannelID channel;
+		time_t started;
+		harvest(const eDVBChannelID &channel, time_t started): channel(channel), started(started) { }
+	};
+	eEPGCache *m_cache;
+	ePtr<eTimer> m_timer;
+	int m_tuners;
+	std::vector<eDVBChannelID> m_channels;
+	std::vector<harvest> m_active;
+	std::map<eDVBChannelID, time_t> m_lastAttempt;  // failed and aborted visits are retried after UPDATE_INTERVAL
+
+	void check();
+	void releaseAll();
+	time_t lastUpdated(const eDVBChannelID &channel);
+};
+
+#endif
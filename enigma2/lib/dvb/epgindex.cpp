@@ -0,0 +1,209 @@
+#include <lib/dvb/epgindex.h>
+#include <lib/base/estring.h>
+#include <lib/base/eerror.h>
+#include <lib/base/encoding.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+eEPGTitleIndex::eEPGTitleIndex()
+	:m_dead(0), m_indexed(0)
+{
+}
+
+bool eEPGTitleIndex::getTitle(const __u8 *descr, int tsidonid, const char *&title, int &len, std::string &buffer)
+{
+	if (descr[0] != 0x4D || descr[1] < 5) // short event descriptor
+		return false;
+	len = descr[5];
+	title = (const char*)&descr[6];
+	if (len > descr[1] - 4)
+		return false;
+	if (len && title[0] == 0x15) // already UTF-8
+	{
+		++title;
+		--len;
+	}
+	else if (len)
+	{
+		/* the cache stores the titles as received */
+		std::string cc((const char*)&descr[2], 3);
+		std::transform(cc.begin(), cc.end(), cc.begin(), tolower);
+		buffer = convertDVBUTF8((const unsigned char*)title, len, encodingHandler.getCountryCodeDefaultMapping(cc), tsidonid);
+		title = buffer.data();
+		len = buffer.length();
+	}
+	/* titles may be zero terminated */
+	while (len && !title[len-1])
+		--len;
+	return len > 0;
+}
+
+__u32 eEPGTitleIndex::trigram(const unsigned char *p)
+{
+	unsigned char a = p[0], b = p[1], c = p[2];
+	if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+	if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+	if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+	return (a << 16) | (b << 8) | c;
+}
+
+void eEPGTitleIndex::index(__u32 id, const title &t)
+{
+	const char *title;
+	int len;
+	std::string buffer;
+	if (!getTitle(t.descr, t.tsidonid, title, len, buffer))
+		return;
+	for (int i = 0; i + 3 <= len; ++i)
+	{
+		std::vector<__u32> &list = m_postings[trigram((const unsigned char*)title + i)];
+		if (list.empty() || list.back() != id) // each trigram only once per title
+			list.push_back(id);
+	}
+}
+
+void eEPGTitleIndex::add(__u32 crc, const __u8 *descr, int tsidonid)
+{
+	if (descr[0] != 0x4D || !descr[5] || m_crcs.find(crc) != m_crcs.end())
+		return;
+	__u32 id = m_titles.size();
+	title t = { crc, descr, tsidonid };
+	m_titles.push_back(t);
+	m_crcs[crc] = id;
+}
+
+// builds the trigrams of the titles added since the last call, in id order
+bool eEPGTitleIndex::update(unsigned int count)
+{
+	for (; m_indexed < m_titles.size() && count; ++m_indexed, --count)
+		if (m_titles[m_indexed].descr)
+			index(m_indexed, m_titles[m_indexed]);
+	return m_indexed < m_titles.size();
+}
+
+void eEPGTitleIndex::remove(__u32 crc)
+{
+	idMap::iterator it = m_crcs.find(crc);
+	if (it == m_crcs.end())
+		return;
+	m_titles[it->second].descr = 0;
+	m_crcs.erase(it);
+	++m_dead;
+}
+
+void eEPGTitleIndex::clear()
+{
+	m_titles.clear();
+	m_crcs.clear();
+	m_postings.clear();
+	m_dead = 0;
+	m_indexed = 0;
+}
+
+// renumbers the live titles.. the posting lists are dropped, until update() has
+// built them again the titles are returned as candidates for every search
+void eEPGTitleIndex::compact()
+{
+	std::vector<title> titles;
+	titles.reserve(m_crcs.size());
+	for (std::vector<title>::iterator it(m_titles.begin()); it != m_titles.end(); ++it)
+	{
+		if (!it->descr)
+			continue;
+		m_crcs[it->crc] = titles.size();
+		titles.push_back(*it);
+	}
+	m_titles.swap(titles);
+	m_postings.clear();
+	m_dead = 0;
+	m_indexed = 0;
+}
+
+bool eEPGTitleIndex::candidates(const char *text, int len, std::vector<__u32> &result) const
+{
+	if (len < 3)
+		return false;
+	/* the titles which are not indexed yet are always candidates */
+	for (unsigned int id = m_indexed; id < m_titles.size(); ++id)
+		if (m_titles[id].descr)
+			result.push_back(m_titles[id].crc);
+	/* collect the posting lists of all trigrams, the shortest first */
+	std::vector<const std::vector<__u32>*> lists;
+	for (int i = 0; i + 3 <= len; ++i)
+	{
+		postingMap::const_iterator it = m_postings.find(trigram((const unsigned char*)text + i));
+		if (it == m_postings.end())
+			return true; // no indexed title contains this trigram
+		std::vector<const std::vector<__u32>*>::iterator pos = lists.begin();
+		while (pos != lists.end() && (*pos)->size() <= it->second.size())
+		{
+			if (*pos == &it->second)
+				break;
+			++pos;
+		}
+		if (pos == lists.end() || *pos != &it->second)
+			lists.insert(pos, &it->second);
+	}
+	/* intersect the sorted lists */
+	std::vector<__u32> ids(*lists[0]);
+	for (unsigned int l = 1; l < lists.size() && !ids.empty(); ++l)
+	{
+		const std::vector<__u32> &list = *lists[l];
+		std::vector<__u32>::iterator out = ids.begin();
+		std::vector<__u32>::const_iterator b = list.begin();
+		for (std::vector<__u32>::iterator a = ids.begin(); a != ids.end() && b != list.end(); )
+		{
+			if (*a < *b)
+				++a;
+			else if (*b < *a)
+				++b;
+			else
+			{
+				*out++ = *a++;
+				++b;
+			}
+		}
+		ids.erase(out, ids.end());
+	}
+	for (std::vector<__u32>::iterator it(ids.begin()); it != ids.end(); ++it)
+		if (m_titles[*it].descr)
+			result.push_back(m_titles[*it].crc);
+	return true;
+}
+
+void eEPGTitleIndex::copyTitles(const std::vector<__u32> *crcs, std::vector<copiedTitle> &titles, std::vector<__u8> &data) const
+{
+	if (crcs)
+	{
+		for (std::vector<__u32>::const_iterator it(crcs->begin()); it != crcs->end(); ++it)
+		{
+			idMap::const_iterator i = m_crcs.find(*it);
+			if (i == m_crcs.end())
+				continue;
+			const title &t = m_titles[i->second];
+			copiedTitle c = { t.crc, t.tsidonid, (unsigned int)data.size() };
+			titles.push_back(c);
+			data.insert(data.end(), t.descr, t.descr + t.descr[1] + 2);
+		}
+		return;
+	}
+	titles.reserve(m_crcs.size());
+	for (std::vector<title>::const_iterator it(m_titles.begin()); it != m_titles.end(); ++it)
+	{
+		if (!it->descr)
+			continue;
+		copiedTitle c = { it->crc, it->tsidonid, (unsigned int)data.size() };
+		titles.push_back(c);
+		data.insert(data.end(), it->descr, it->descr + it->descr[1] + 2);
+	}
+}
+
+size_t eEPGTitleIndex::memoryUsage() const
+{
+	size_t size = m_titles.capacity() * sizeof(title) + m_crcs.size() * (sizeof(__u32) * 2 + sizeof(void*));
+	for (postingMap::const_iterator it(m_postings.begin()); it != m_postings.end(); ++it)
+		size += sizeof(*it) + sizeof(void*) + it->second.capacity() * sizeof(__u32);
+	return size;
+}
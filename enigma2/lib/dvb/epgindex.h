@@ -0,0 +1,79 @@
+#ifndef __lib_dvb_epgindex_h
+#define __lib_dvb_epgindex_h
+
+#include <vector>
+#include <string>
+#include <ext/hash_map>
+#include <asm/types.h>
+
+/*
+ * Trigram index over the event titles in the descriptor pool of the epg cache.
+ * Every title (short event descriptor) gets an id in insertion order, so the
+ * posting list of each trigram stays sorted while titles are only appended.
+ * Removed titles are just marked dead, the caller compacts the index when
+ * needsCompact() says that more than half of it is dead. compact() only
+ * renumbers the titles, their trigrams are built again by update() like
+ * those of new titles. New titles are only indexed by update(), so the
+ * conversion of their text is not done while events are added, until then
+ * they are returned as candidates for every search. update() indexes a
+ * limited number of titles per call, so the caller can release the lock
+ * in between.
+ * A title is converted with the tsid/onid of the first event which added it,
+ * events of other transponders sharing the same raw title are rare.
+ * The trigrams are built from the ASCII case folded UTF-8 title, so the
+ * index only returns candidates, the caller has to check the real title.
+ * Not thread safe.. the epgcache only changes it with the cache lock held exclusive.
+ */
+class eEPGTitleIndex
+{
+public:
+	eEPGTitleIndex();
+
+	void add(__u32 crc, const __u8 *descr, int tsidonid);
+	void remove(__u32 crc);
+	void clear();
+	/* indexes up to count new titles.. returns true when there are more */
+	bool update(unsigned int count);
+	bool needsCompact() const { return m_dead > 1024 && m_dead > m_crcs.size(); }
+	/* drops the removed titles, all titles are indexed again by update() */
+	void compact();
+
+	/* crcs of all titles containing every trigram of text..
+	   returns false when text is too short to use the index */
+	bool candidates(const char *text, int len, std::vector<__u32> &result) const;
+
+	struct copiedTitle
+	{
+		__u32 crc;
+		int tsidonid;
+		unsigned int offset;  // of the descriptor in the copied data
+	};
+	/* copies the raw titles (all live ones when crcs is 0), so they can be converted
+	   and compared after the cache lock is released */
+	void copyTitles(const std::vector<__u32> *crcs, std::vector<copiedTitle> &titles, std::vector<__u8> &data) const;
+
+	/* returns the title of a short event descriptor in UTF-8 (uses buffer when it must be converted) */
+	static bool getTitle(const __u8 *descr, int tsidonid, const char *&title, int &len, std::string &buffer);
+
+	unsigned int size() const { return m_crcs.size(); }
+	size_t memoryUsage() const;
+private:
+	typedef __gnu_cxx::hash_map<__u32, std::vector<__u32> > postingMap;
+	typedef __gnu_cxx::hash_map<__u32, __u32> idMap;
+	struct title
+	{
+		__u32 crc;
+		const __u8 *descr;  // 0 for removed titles
+		int tsidonid;
+	};
+	std::vector<title> m_titles;  // by title id
+	idMap m_crcs;                 // crc -> title id of all live titles
+	postingMap m_postings;        // trigram -> sorted title ids
+	unsigned int m_dead;
+	unsigned int m_indexed;       // titles below this id are in the postings
+
+	void index(__u32 id, const title &t);
+	static __u32 trigram(const unsigned char *p);
+};
+
+#endif
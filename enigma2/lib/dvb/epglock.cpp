@@ -0,0 +1,113 @@
+#include <lib/dvb/epglock.h>
+#include <lib/base/eerror.h>
+
+#include <string.h>
+#include <time.h>
+
+__thread int eEPGCacheLock::m_writeDepth;
+__thread int eEPGCacheLock::m_readDepth;
+
+eEPGCacheLock::eEPGCacheLock()
+{
+	/* the default rwlock prefers readers, which is needed for recursive shared locks */
+	pthread_rwlock_init(&m_lock, 0);
+	pthread_mutex_init(&m_statsLock, 0);
+	memset(&m_writeStart, 0, sizeof(m_writeStart));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+eEPGCacheLock::~eEPGCacheLock()
+{
+	pthread_rwlock_destroy(&m_lock);
+	pthread_mutex_destroy(&m_statsLock);
+}
+
+unsigned int eEPGCacheLock::elapsed(const struct timespec &start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+}
+
+/* only called after waiting or writing, so the mutex is rarely taken */
+void eEPGCacheLock::update(unsigned long long &total, unsigned int &max, unsigned int value)
+{
+	pthread_mutex_lock(&m_statsLock);
+	total += value;
+	if (value > max)
+		max = value;
+	pthread_mutex_unlock(&m_statsLock);
+}
+
+void eEPGCacheLock::lockRead()
+{
+	if (m_writeDepth) // we already have it exclusive
+	{
+		++m_writeDepth;
+		return;
+	}
+	__sync_fetch_and_add(&m_stats.reads, 1);
+	if (!pthread_rwlock_tryrdlock(&m_lock))
+	{
+		++m_readDepth;
+		return;
+	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	pthread_rwlock_rdlock(&m_lock);
+	++m_readDepth;
+	__sync_fetch_and_add(&m_stats.readWaits, 1);
+	update(m_stats.readWaitTime, m_stats.maxReadWait, elapsed(start));
+}
+
+void eEPGCacheLock::lockWrite()
+{
+	if (m_writeDepth)
+	{
+		++m_writeDepth;
+		return;
+	}
+	if (m_readDepth) // it would wait for ourself forever
+		eFatal("[EPGC] cache lock: exclusive lock requested by a thread holding it shared");
+	if (pthread_rwlock_trywrlock(&m_lock))
+	{
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		pthread_rwlock_wrlock(&m_lock);
+		++m_stats.writeWaits;
+		update(m_stats.writeWaitTime, m_stats.maxWriteWait, elapsed(start));
+	}
+	++m_stats.writes;
+	m_writeDepth = 1;
+	clock_gettime(CLOCK_MONOTONIC, &m_writeStart);
+}
+
+void eEPGCacheLock::unlock()
+{
+	if (m_writeDepth)
+	{
+		if (--m_writeDepth)
+			return;
+		update(m_stats.writeHoldTime, m_stats.maxWriteHold, elapsed(m_writeStart));
+	}
+	else
+		--m_readDepth;
+	pthread_rwlock_unlock(&m_lock);
+}
+
+void eEPGCacheLock::getStatistics(statistics &stats) const
+{
+	pthread_mutex_lock(&m_statsLock);
+	stats = m_stats;
+	pthread_mutex_unlock(&m_statsLock);
+}
+
+void eEPGCacheLock::dumpStatistics() const
+{
+	statistics s;
+	getStatistics(s);
+	eDebug("[EPGC] cache lock: %u reads, %u waited %llu us (max %u us), %u writes, %u waited %llu us (max %u us), held %llu us (max %u us)",
+		s.reads, s.readWaits, s.readWaitTime, s.maxReadWait,
+		s.writes, s.writeWaits, s.writeWaitTime, s.maxWriteWait,
+		s.writeHoldTime, s.maxWriteHold);
+}
@@ -0,0 +1,82 @@
+#ifndef __lib_dvb_epglock_h
+#define __lib_dvb_epglock_h
+
+#include <pthread.h>
+
+/*
+ * Lock of the epg cache data. Lookups only read and take it shared, so the
+ * GUI is never serialized against other readers. The epg thread takes it
+ * exclusive for one section (or one clean/flush pass) at a time.
+ * A thread holding the lock exclusive may lock it again, shared or exclusive.
+ * A thread holding it shared may lock it shared again, but never exclusive..
+ * that would wait for itself, so it is a fatal error.
+ * How deep a thread holds it is kept per thread, so there must not be more
+ * than one instance (the one of the epg cache).
+ * Every caller who had to wait is counted, see dumpStatistics.
+ */
+class eEPGCacheLock
+{
+public:
+	struct statistics
+	{
+		unsigned int reads, readWaits;           // shared locks, and how many of them had to wait
+		unsigned int writes, writeWaits;         // exclusive locks
+		unsigned long long readWaitTime;         // microseconds
+		unsigned long long writeWaitTime;
+		unsigned long long writeHoldTime;
+		unsigned int maxReadWait, maxWriteWait, maxWriteHold;
+	};
+
+	eEPGCacheLock();
+	~eEPGCacheLock();
+
+	void lockRead();
+	void lockWrite();
+	void unlock();
+
+	void getStatistics(statistics &stats) const;
+	void dumpStatistics() const;
+private:
+	pthread_rwlock_t m_lock;
+	static __thread int m_writeDepth;  // of the calling thread, shared locks inside count here as well
+	static __thread int m_readDepth;
+	struct timespec m_writeStart;
+	mutable pthread_mutex_t m_statsLock;  // the times and maxima
+	statistics m_stats;
+
+	eEPGCacheLock(const eEPGCacheLock &);
+	static unsigned int elapsed(const struct timespec &start);
+	void update(unsigned long long &total, unsigned int &max, unsigned int value);
+};
+
+class eEPGReadLocker
+{
+	eEPGCacheLock &m_lock;
+public:
+	eEPGReadLocker(eEPGCacheLock &lock)
+		:m_lock(lock)
+	{
+		m_lock.lockRead();
+	}
+	~eEPGReadLocker()
+	{
+		m_lock.unlock();
+	}
+};
+
+class eEPGWriteLocker
+{
+	eEPGCacheLock &m_lock;
+public:
+	eEPGWriteLocker(eEPGCacheLock &lock)
+		:m_lock(lock)
+	{
+		m_lock.lockWrite();
+	}
+	~eEPGWriteLocker()
+	{
+		m_lock.unlock();
+	}
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef __lib_dvb_epgmap_h
+#define __lib_dvb_epgmap_h
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+/*
+ * Sorted vector with the part of the std::map interface the epg cache uses.
+ * One service has a few hundred events at most, so a contiguous array is
+ * much faster to search and smaller than a tree with one node per event.
+ * Differences to std::map:
+ *  - insert and erase invalidate all iterators behind the position
+ *  - the key of value_type is not const, don't change it through an iterator
+ * Events mostly arrive in time order, so inserting behind the last element
+ * (or at a correct hint) does not search at all.
+ */
+template <class Key, class T>
+class eEPGFlatMap
+{
+public:
+	typedef Key key_type;
+	typedef T mapped_type;
+	typedef std::pair<Key, T> value_type;
+	typedef typename std::vector<value_type>::iterator iterator;
+	typedef typename std::vector<value_type>::const_iterator const_iterator;
+	typedef typename std::vector<value_type>::size_type size_type;
+
+	iterator begin() { return m_data.begin(); }
+	iterator end() { return m_data.end(); }
+	const_iterator begin() const { return m_data.begin(); }
+	const_iterator end() const { return m_data.end(); }
+	size_type size() const { return m_data.size(); }
+	size_type capacity() const { return m_data.capacity(); }
+	bool empty() const { return m_data.empty(); }
+	void clear() { m_data.clear(); }
+	void reserve(size_type n) { m_data.reserve(n); }
+
+	iterator lower_bound(const Key &key) { return std::lower_bound(m_data.begin(), m_data.end(), key, compare()); }
+	const_iterator lower_bound(const Key &key) const { return std::lower_bound(m_data.begin(), m_data.end(), key, compare()); }
+	iterator upper_bound(const Key &key) { return std::upper_bound(m_data.begin(), m_data.end(), key, compare()); }
+	const_iterator upper_bound(const Key &key) const { return std::upper_bound(m_data.begin(), m_data.end(), key, compare()); }
+
+	iterator find(const Key &key)
+	{
+		iterator it = lower_bound(key);
+		return (it != m_data.end() && !(key < it->first)) ? it : m_data.end();
+	}
+	const_iterator find(const Key &key) const
+	{
+		const_iterator it = lower_bound(key);
+		return (it != m_data.end() && !(key < it->first)) ? it : m_data.end();
+	}
+
+	T &operator[](const Key &key)
+	{
+		return insert(end(), value_type(key, T()))->second;
+	}
+
+	std::pair<iterator, bool> insert(const value_type &value)
+	{
+		iterator it = lower_bound(value.first);
+		if (it != m_data.end() && !(value.first < it->first))
+			return std::pair<iterator, bool>(it, false);
+		return std::pair<iterator, bool>(m_data.insert(it, value), true);
+	}
+
+	/* value is inserted right before or right after hint when that keeps the order,
+	   so passing the last inserted position works for ascending keys */
+	iterator insert(iterator hint, const value_type &value)
+	{
+		if (hint != m_data.end() && hint->first < value.first)
+			++hint;
+		if ((hint == m_data.end() || value.first < hint->first) &&
+			(hint == m_data.begin() || (hint - 1)->first < value.first))
+			return m_data.insert(hint, value);
+		return insert(value).first;
+	}
+
+	/* inserts a batch of values sorted by key.. existing keys keep their value.
+	   The batch is appended and merged in place, so a whole section costs one pass. */
+	void merge(const std::vector<value_type> &values)
+	{
+		if (values.empty())
+			return;
+		if (m_data.empty() || m_data.back().first < values.front().first)
+		{
+			m_data.insert(m_data.end(), values.begin(), values.end());
+			return;
+		}
+		size_type old = m_data.size();
+		m_data.insert(m_data.end(), values.begin(), values.end());
+		std::inplace_merge(m_data.begin(), m_data.begin() + old, m_data.end(), compare());
+		/* inplace_merge is stable, so the existing entry comes first on equal keys */
+		m_data.erase(std::unique(m_data.begin(), m_data.end(), equal()), m_data.end());
+	}
+
+	/* returns the iterator following the erased element */
+	iterator erase(iterator it) { return m_data.erase(it); }
+	iterator erase(iterator first, iterator last) { return m_data.erase(first, last); }
+	size_type erase(const Key &key)
+	{
+		iterator it = find(key);
+		if (it == m_data.end())
+			return 0;
+		m_data.erase(it);
+		return 1;
+	}
+
+	void swap(eEPGFlatMap &other) { m_data.swap(other.m_data); }
+private:
+	struct compare
+	{
+		bool operator()(const value_type &a, const value_type &b) const { return a.first < b.first; }
+		bool operator()(const value_type &a, const Key &b) const { return a.first < b; }
+		bool operator()(const Key &a, const value_type &b) const { return a < b.first; }
+	};
+	struct equal
+	{
+		bool operator()(const value_type &a, const value_type &b) const { return !(a.first < b.first) && !(b.first < a.first); }
+	};
+	std::vector<value_type> m_data;
+};
+
+#endif
@@ -0,0 +1,223 @@
+#include <lib/dvb/epgpool.h>
+#include <lib/base/eerror.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+eEPGAllocator::eEPGAllocator(const char *name)
+	:m_name(name)
+{
+	memset(m_partial, 0, sizeof(m_partial));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+eEPGAllocator::~eEPGAllocator()
+{
+	/* all blocks should be returned at this point.. but don't leak the slabs when not */
+	for (unsigned int cls = 0; cls < classCount; ++cls)
+	{
+		while (m_partial[cls])
+		{
+			slab *s = m_partial[cls];
+			m_partial[cls] = s->next;
+			::free(s);
+		}
+	}
+}
+
+eEPGAllocator::slab *eEPGAllocator::newSlab(unsigned int cls)
+{
+	void *mem = 0;
+	if (posix_memalign(&mem, slabSize, slabSize))
+		return 0;
+	slab *s = (slab*)mem;
+	unsigned int header = (sizeof(slab) + granularity - 1) & ~(granularity - 1);
+	s->blockSize = (cls + 1) * granularity;
+	s->capacity = (slabSize - header) / s->blockSize;
+	s->used = 0;
+	s->prev = s->next = 0;
+	/* thread all blocks into the free list of the slab */
+	__u8 *first = ((__u8*)mem) + header;
+	block *b = 0;
+	for (int i = s->capacity - 1; i >= 0; --i)
+	{
+		block *n = (block*)(first + i * s->blockSize);
+		n->next = b;
+		b = n;
+	}
+	s->free = b;
+	++m_stats.slabs;
+	m_stats.bytesAllocated += slabSize;
+	return s;
+}
+
+void eEPGAllocator::unlink(slab *s)
+{
+	unsigned int cls = s->blockSize / granularity - 1;
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		m_partial[cls] = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+	s->prev = s->next = 0;
+}
+
+void eEPGAllocator::link(slab *s, unsigned int cls)
+{
+	s->prev = 0;
+	s->next = m_partial[cls];
+	if (s->next)
+		s->next->prev = s;
+	m_partial[cls] = s;
+}
+
+void *eEPGAllocator::alloc(size_t size)
+{
+	if (!size)
+		size = 1;
+	m_stats.bytesUsed += size;
+	++m_stats.blocks;
+	if (size > maxBlockSize)
+	{
+		m_stats.bytesAllocated += size;
+		return ::malloc(size);
+	}
+	unsigned int cls = (size - 1) / granularity;
+	slab *s = m_partial[cls];
+	if (!s)
+	{
+		s = newSlab(cls);
+		if (!s)
+		{
+			eDebug("[eEPGAllocator] %s: out of memory", m_name);
+			m_stats.bytesUsed -= size;
+			--m_stats.blocks;
+			return 0;
+		}
+		link(s, cls);
+	}
+	block *b = s->free;
+	s->free = b->next;
+	if (++s->used == s->capacity) // slab is full now
+		unlink(s);
+	return b;
+}
+
+void eEPGAllocator::free(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+	if (!size)
+		size = 1;
+	m_stats.bytesUsed -= size;
+	--m_stats.blocks;
+	if (size > maxBlockSize)
+	{
+		m_stats.bytesAllocated -= size;
+		::free(ptr);
+		return;
+	}
+	slab *s = (slab*)((unsigned long)ptr & ~((unsigned long)slabSize - 1));
+	unsigned int cls = s->blockSize / granularity - 1;
+	block *b = (block*)ptr;
+	b->next = s->free;
+	s->free = b;
+	if (s->used-- == s->capacity) // was full.. so it is not in the partial list
+		link(s, cls);
+	/* give unused slabs back to the system, but keep one per class to avoid thrashing */
+	if (!s->used && (s->prev || s->next))
+	{
+		unlink(s);
+		::free(s);
+		--m_stats.slabs;
+		m_stats.bytesAllocated -= slabSize;
+	}
+}
+
+void eEPGAllocator::getStatistics(statistics &stats) const
+{
+	stats = m_stats;
+}
+
+void eEPGAllocator::dumpStatistics() const
+{
+	eDebug("[eEPGAllocator] %s: %u blocks, %u bytes used, %u bytes allocated in %u slabs (%d%% utilization)",
+		m_name, m_stats.blocks, (unsigned int)m_stats.bytesUsed, (unsigned int)m_stats.bytesAllocated, m_stats.slabs,
+		m_stats.bytesAllocated ? (int)((m_stats.bytesUsed * 100) / m_stats.bytesAllocated) : 100);
+}
+
+eEPGDescriptorPool::eEPGDescriptorPool()
+	:m_table(0), m_mask(0), m_used(0)
+{
+}
+
+eEPGDescriptorPool::~eEPGDescriptorPool()
+{
+	::free(m_table);
+}
+
+void eEPGDescriptorPool::grow()
+{
+	entry *old = m_table;
+	unsigned int oldSize = m_table ? m_mask + 1 : 0;
+	unsigned int newSize = oldSize ? oldSize * 2 : 4096;
+	m_table = (entry*)calloc(newSize, sizeof(entry));
+	m_mask = newSize - 1;
+	for (unsigned int i = 0; i < oldSize; ++i)
+	{
+		if (old[i].data)
+		{
+			unsigned int n = slotFor(old[i].crc);
+			while (m_table[n].data)
+				n = (n + 1) & m_mask;
+			m_table[n] = old[i];
+		}
+	}
+	::free(old);
+}
+
+eEPGDescriptorPool::entry *eEPGDescriptorPool::insert(__u32 crc, __u8 *data)
+{
+	/* keep the load factor below 75% */
+	if (!m_table || (m_used + 1) * 4 > (m_mask + 1) * 3)
+		grow();
+	unsigned int i = slotFor(crc);
+	while (m_table[i].data)
+		i = (i + 1) & m_mask;
+	entry &e = m_table[i];
+	e.crc = crc;
+	e.refcount = 1;
+	e.data = data;
+	++m_used;
+	return &e;
+}
+
+void eEPGDescriptorPool::erase(entry *e)
+{
+	unsigned int i = e - m_table;
+	unsigned int j = i;
+	/* backward shift deletion.. move all following entries of the cluster
+	   which would not be reachable anymore into the hole */
+	while (1)
+	{
+		j = (j + 1) & m_mask;
+		if (!m_table[j].data)
+			break;
+		unsigned int k = slotFor(m_table[j].crc);
+		/* entry j may be moved to i when its home slot k is not in the range (i, j] */
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		m_table[i] = m_table[j];
+		i = j;
+	}
+	m_table[i].data = 0;
+	--m_used;
+}
+
+void eEPGDescriptorPool::clear()
+{
+	if (m_table)
+		memset(m_table, 0, (m_mask + 1) * sizeof(entry));
+	m_used = 0;
+}
@@ -0,0 +1,154 @@
+#ifndef __lib_dvb_epgpool_h
+#define __lib_dvb_epgpool_h
+
+#include <stddef.h>
+#include <asm/types.h>
+
+/*
+ * Size class slab allocator for the small, long living blocks of the epg cache
+ * (eventData objects, their EIT headers and the shared descriptors).
+ * Every slab is slabSize bytes big, aligned to slabSize and holds blocks of
+ * exactly one size class, so a block can find its slab by masking its address.
+ * Completely unused slabs are given back to the system.
+ * Blocks bigger than maxBlockSize are taken from the normal heap.
+ * Not thread safe.. the epgcache only uses it with the cache lock held.
+ */
+class eEPGAllocator
+{
+public:
+	enum { granularity = 8, maxBlockSize = 512, slabSize = 16384 };
+	struct statistics
+	{
+		size_t bytesUsed;       // sum of all requested block sizes
+		size_t bytesAllocated;  // memory taken from the system (slabs + big blocks)
+		unsigned int blocks;
+		unsigned int slabs;
+	};
+
+	eEPGAllocator(const char *name);
+	~eEPGAllocator();
+
+	void *alloc(size_t size);
+	void free(void *ptr, size_t size);
+
+	void getStatistics(statistics &stats) const;
+	void dumpStatistics() const;
+private:
+	enum { classCount = maxBlockSize / granularity };
+	struct block
+	{
+		block *next;
+	};
+	struct slab
+	{
+		slab *prev, *next;
+		block *free;
+		unsigned int used;
+		unsigned int capacity;
+		unsigned int blockSize;
+	};
+
+	/* slabs which have at least one free block, per size class */
+	slab *m_partial[classCount];
+	const char *m_name;
+	statistics m_stats;
+
+	slab *newSlab(unsigned int cls);
+	void unlink(slab *s);
+	void link(slab *s, unsigned int cls);
+
+	eEPGAllocator(const eEPGAllocator &);
+	eEPGAllocator &operator=(const eEPGAllocator &);
+};
+
+/*
+ * Pool of the descriptors shared between all cached events, keyed by the
+ * crc32 of the descriptor data.
+ * Open addressing hash table with linear probing and backward shift deletion,
+ * so lookups touch one or two cache lines instead of walking a tree.
+ * The entries do not own their data, the caller allocates and frees it.
+ */
+class eEPGDescriptorPool
+{
+public:
+	struct entry
+	{
+		__u32 crc;
+		int refcount;
+		__u8 *data;  // 0 for unused slots
+	};
+
+	eEPGDescriptorPool();
+	~eEPGDescriptorPool();
+
+	entry *find(__u32 crc) const
+	{
+		if (!m_used)
+			return 0;
+		unsigned int i = slotFor(crc);
+		while (m_table[i].data)
+		{
+			if (m_table[i].crc == crc)
+				return m_table + i;
+			i = (i + 1) & m_mask;
+		}
+		return 0;
+	}
+	/* crc must not be in the pool yet.. returns the new entry with refcount 1 */
+	entry *insert(__u32 crc, __u8 *data);
+	/* removes the entry, pointers to other entries may be invalidated */
+	void erase(entry *e);
+	void clear();
+
+	unsigned int size() const { return m_used; }
+	size_t memoryUsage() const { return (m_mask + 1) * sizeof(entry); }
+	/* the slots of the table, for walking it in several steps.. slot() returns 0 for an unused one */
+	unsigned int capacity() const { return m_table ? m_mask + 1 : 0; }
+	entry *slot(unsigned int i) const { return m_table[i].data ? m_table + i : 0; }
+
+	class iterator
+	{
+		friend class eEPGDescriptorPool;
+		entry *m_pos, *m_end;
+		iterator(entry *pos, entry *end)
+			:m_pos(pos), m_end(end)
+		{
+			skip();
+		}
+		void skip()
+		{
+			while (m_pos != m_end && !m_pos->data)
+				++m_pos;
+		}
+	public:
+		iterator(): m_pos(0), m_end(0) { }
+		entry &operator*() const { return *m_pos; }
+		entry *operator->() const { return m_pos; }
+		iterator &operator++()
+		{
+			++m_pos;
+			skip();
+			return *this;
+		}
+		bool operator==(const iterator &o) const { return m_pos == o.m_pos; }
+		bool operator!=(const iterator &o) const { return m_pos != o.m_pos; }
+	};
+	iterator begin() const { return iterator(m_table, m_table + (m_table ? m_mask + 1 : 0)); }
+	iterator end() const { return iterator(m_table + (m_table ? m_mask + 1 : 0), m_table + (m_table ? m_mask + 1 : 0)); }
+private:
+	entry *m_table;
+	unsigned int m_mask;
+	unsigned int m_used;
+
+	unsigned int slotFor(__u32 crc) const
+	{
+		/* the crc itself is well distributed.. but mix in the high bits for small tables */
+		return ((crc * 0x9E3779B1U) >> 7) & m_mask;
+	}
+	void grow();
+
+	eEPGDescriptorPool(const eEPGDescriptorPool &);
+	eEPGDescriptorPool &operator=(const eEPGDescriptorPool &);
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include <lib/dvb/epgsections.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+eEPGSectionMap::eEPGSectionMap()
+	:m_seen(0), m_expected(0), m_lastKey(0), m_last(0)
+{
+}
+
+eEPGSectionMap::bitmap &eEPGSectionMap::get(int tid, int sid)
+{
+	__u32 key = (tid << 16) | sid;
+	if (m_last && m_lastKey == key) // the sections of a table mostly come in a row
+		return *m_last;
+	tableMap::iterator it = m_tables.find(key);
+	if (it == m_tables.end())
+	{
+		bitmap b;
+		memset(&b, 0, sizeof(b));
+		it = m_tables.insert(tableMap::value_type(key, b)).first;
+	}
+	m_lastKey = key;
+	m_last = &it->second;
+	return *m_last;
+}
+
+bool eEPGSectionMap::markSeen(int tid, int sid, int section)
+{
+	bitmap &b = get(tid, sid);
+	__u32 bit = 1u << (section & 31);
+	__u32 &seen = b.seen[(section >> 5) & 7];
+	if (seen & bit)
+		return false;
+	seen |= bit;
+	++m_seen;
+	markExpected(tid, sid, section);
+	return true;
+}
+
+void eEPGSectionMap::markExpected(int tid, int sid, int section)
+{
+	bitmap &b = get(tid, sid);
+	__u32 bit = 1u << (section & 31);
+	__u32 &expected = b.expected[(section >> 5) & 7];
+	if (!(expected & bit))
+	{
+		expected |= bit;
+		++m_expected;
+	}
+}
+
+void eEPGSectionMap::clear()
+{
+	m_tables.clear();
+	m_seen = m_expected = 0;
+	m_last = 0;
+}
+
+eEPGSectionCRCCache::eEPGSectionCRCCache()
+	:m_table(0), m_mask(0), m_used(0)
+{
+	memset(m_generations, 0, sizeof(m_generations));
+}
+
+eEPGSectionCRCCache::~eEPGSectionCRCCache()
+{
+	::free(m_table);
+}
+
+void eEPGSectionCRCCache::grow()
+{
+	entry *old = m_table;
+	unsigned int oldSize = m_table ? m_mask + 1 : 0;
+	unsigned int newSize = oldSize ? oldSize * 2 : 4096;
+	m_table = (entry*)calloc(newSize, sizeof(entry));
+	m_mask = newSize - 1;
+	for (unsigned int i = 0; i < oldSize; ++i)
+	{
+		if (old[i].key)
+		{
+			unsigned int n = slotFor(old[i].key, old[i].channel);
+			while (m_table[n].key)
+				n = (n + 1) & m_mask;
+			m_table[n] = old[i];
+		}
+	}
+	::free(old);
+}
+
+bool eEPGSectionCRCCache::unchanged(const __u8 *section, __u32 channel)
+{
+	int len = ((section[1] & 0x0F) << 8 | section[2]) + 3;
+	if (len < 16)
+		return false;
+	/* table_id, service_id, section_number, transport_stream_id, original_network_id */
+	__u64 key = (__u64)section[0] << 56 | (__u64)section[3] << 48 | (__u64)section[4] << 40 | (__u64)section[6] << 32 |
+		(__u32)section[8] << 24 | section[9] << 16 | section[10] << 8 | section[11];
+	__u32 crc = section[len-4] << 24 | section[len-3] << 16 | section[len-2] << 8 | section[len-1];
+	crc ^= *(volatile __u32*)&m_generations[(section[3] << 8 | section[4]) & (generations - 1)] * 0x9E3779B1u;
+	if (!key)
+		return false;
+	if (m_used >= maxEntries)
+		clear();
+	/* keep the load factor below 75% */
+	if (!m_table || (m_used + 1) * 4 > (m_mask + 1) * 3)
+		grow();
+	unsigned int i = slotFor(key, channel);
+	while (m_table[i].key)
+	{
+		entry &e = m_table[i];
+		if (e.key == key && e.channel == channel)
+		{
+			if (e.crc == crc)
+				return true;
+			e.crc = crc; // new version
+			return false;
+		}
+		i = (i + 1) & m_mask;
+	}
+	entry &e = m_table[i];
+	e.key = key;
+	e.channel = channel;
+	e.crc = crc;
+	++m_used;
+	return false;
+}
+
+void eEPGSectionCRCCache::clear()
+{
+	if (m_table)
+		memset(m_table, 0, (m_mask + 1) * sizeof(entry));
+	m_used = 0;
+}
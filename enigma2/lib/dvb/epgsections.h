@@ -0,0 +1,87 @@
+#ifndef __lib_dvb_epgsections_h
+#define __lib_dvb_epgsections_h
+
+#include <stddef.h>
+#include <asm/types.h>
+#include <ext/hash_map>
+
+/*
+ * Which sections of the eit tables of one channel were received, and which
+ * are expected (from last_section_number and segment_last_section_number).
+ * A reader is complete when every expected section was received.
+ * One bitmap of the 256 sections per table_id and service_id, the received
+ * sections are always expected too, so comparing the counts is enough.
+ */
+class eEPGSectionMap
+{
+public:
+	eEPGSectionMap();
+
+	/* marks the section as received.. returns false when it was received before */
+	bool markSeen(int tid, int sid, int section);
+	void markExpected(int tid, int sid, int section);
+	bool complete() const { return m_seen == m_expected; }
+	void clear();
+private:
+	struct bitmap
+	{
+		__u32 seen[8], expected[8];
+	};
+	typedef __gnu_cxx::hash_map<__u32, bitmap> tableMap;
+	tableMap m_tables;
+	unsigned int m_seen, m_expected;
+	__u32 m_lastKey;
+	bitmap *m_last;  // hash_map nodes don't move, so this stays valid until clear()
+
+	bitmap &get(int tid, int sid);
+};
+
+/*
+ * The crc32 of every parsed eit section, so the unchanged sections of the
+ * carousel are not parsed again when the readers restart. The sections are
+ * identified by table_id, service_id, section_number, the ids in the section
+ * and the channel they came from (some providers need the ids of the channel).
+ * Open addressing with 16 bytes per section, cleared when it gets too big.
+ * When events of a service are removed (expired, evicted, replaced by an
+ * overlapping one) its sections must be parsed again: the stored crc is
+ * mixed with a generation per service_id, invalidate() increments it.
+ * The services share 4096 generations, a collision only costs a parse.
+ * unchanged() is only called by the epg thread, invalidate() by every
+ * writer of the cache.
+ */
+class eEPGSectionCRCCache
+{
+public:
+	enum { maxEntries = 262144, generations = 4096 };
+
+	eEPGSectionCRCCache();
+	~eEPGSectionCRCCache();
+
+	/* returns true when the section was parsed before with the same crc,
+	   otherwise the crc is remembered */
+	bool unchanged(const __u8 *section, __u32 channel);
+	void invalidate(int sid) { __sync_fetch_and_add(&m_generations[sid & (generations - 1)], 1); }
+	void clear();
+
+	unsigned int size() const { return m_used; }
+	size_t memoryUsage() const { return m_table ? (m_mask + 1) * sizeof(entry) : 0; }
+private:
+	struct entry
+	{
+		__u64 key;  // never 0 for an eit section, 0 marks a free slot
+		__u32 channel;
+		__u32 crc;
+	};
+	entry *m_table;
+	unsigned int m_mask, m_used;
+	__u32 m_generations[generations];
+
+	void grow();
+	unsigned int slotFor(__u64 key, __u32 channel) const
+	{
+		__u64 h = (key ^ ((__u64)channel << 17)) * 0x9E3779B97F4A7C15ULL;
+		return (unsigned int)(h >> 32) & m_mask;
+	}
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include <lib/dvb/epgtext.h>
+#include <lib/base/encoding.h>
+#include <lib/base/estring.h>
+
+#include <algorithm>
+#include <ctype.h>
+
+eEPGTextCache::eEPGTextCache()
+	:m_hits(0), m_misses(0)
+{
+}
+
+bool eEPGTextCache::needsConversion(const __u8 *descr)
+{
+	int len = descr[1] + 2;
+	if (len < 7)
+		return false;
+	int nameLen = descr[5];
+	if (nameLen && descr[6] != 0x15)
+		return true;
+	if (6 + nameLen >= len)
+		return false;
+	int textLen = descr[6 + nameLen];
+	return textLen && 7 + nameLen < len && descr[7 + nameLen] != 0x15;
+}
+
+void eEPGTextCache::convert(const __u8 *descr, int tsidonid, std::string &result)
+{
+	int len = descr[1] + 2;
+	int nameLen = len > 6 ? descr[5] : 0;
+	int textLen = 0;
+	if (6 + nameLen >= len)
+		nameLen = len > 6 ? len - 6 : 0;
+	else
+	{
+		textLen = descr[6 + nameLen];
+		if (7 + nameLen + textLen > len)
+			textLen = len - 7 - nameLen;
+	}
+
+	std::string cc((const char*)&descr[2], 3);
+	std::transform(cc.begin(), cc.end(), cc.begin(), tolower);
+	int table = encodingHandler.getCountryCodeDefaultMapping(cc);
+	std::string name = convertDVBUTF8(descr + 6, nameLen, table, tsidonid);
+	std::string text = convertDVBUTF8(descr + 7 + nameLen, textLen, table, tsidonid);
+
+	/* the result has to fit into one descriptor again.. language code,
+	   two length bytes and the UTF-8 marker in front of each string */
+	if (!name.empty())
+		truncateUTF8(name, 255 - 6);
+	int textMax = 255 - 5 - (name.empty() ? 0 : name.length() + 1) - 1;
+	if (textMax <= 0)
+		text.clear();
+	else if (!text.empty())
+		truncateUTF8(text, textMax);
+
+	result.clear();
+	result.reserve(8 + name.length() + text.length());
+	result += (char)descr[0];
+	result += (char)0; // length, set below
+	result.append((const char*)&descr[2], 3);
+	if (name.empty())
+		result += (char)0;
+	else
+	{
+		result += (char)(name.length() + 1);
+		result += (char)0x15; // UTF-8
+		result += name;
+	}
+	if (text.empty())
+		result += (char)0;
+	else
+	{
+		result += (char)(text.length() + 1);
+		result += (char)0x15;
+		result += text;
+	}
+	result[1] = (char)(result.length() - 2);
+}
+
+void eEPGTextCache::get(__u32 crc, const __u8 *descr, int tsidonid, std::string &result)
+{
+	__u64 key = (__u64)crc << 32 | (__u32)tsidonid;
+	m_lock.lock();
+	textMap::iterator it = m_young.find(key);
+	if (it != m_young.end())
+	{
+		++m_hits;
+		result = it->second;
+		m_lock.unlock();
+		return;
+	}
+	it = m_old.find(key);
+	if (it != m_old.end())
+	{
+		++m_hits;
+		result = it->second;
+	}
+	else
+	{
+		++m_misses;
+		/* don't block the other readers while converting */
+		m_lock.unlock();
+		convert(descr, tsidonid, result);
+		m_lock.lock();
+	}
+	if (m_young.size() >= generationSize)
+	{
+		m_old.swap(m_young);
+		m_young.clear();
+	}
+	m_young[key] = result;
+	m_lock.unlock();
+}
+
+void eEPGTextCache::clear()
+{
+	eSingleLocker l(m_lock);
+	m_young.clear();
+	m_old.clear();
+}
+
+size_t eEPGTextCache::memoryUsage()
+{
+	eSingleLocker l(m_lock);
+	size_t size = 0;
+	for (textMap::const_iterator it(m_young.begin()); it != m_young.end(); ++it)
+		size += sizeof(*it) + sizeof(void*) + it->second.capacity();
+	for (textMap::const_iterator it(m_old.begin()); it != m_old.end(); ++it)
+		size += sizeof(*it) + sizeof(void*) + it->second.capacity();
+	return size;
+}
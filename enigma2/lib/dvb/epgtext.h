@@ -0,0 +1,49 @@
+#ifndef __lib_dvb_epgtext_h
+#define __lib_dvb_epgtext_h
+
+#include <string>
+#include <stddef.h>
+#include <asm/types.h>
+#include <ext/hash_map>
+#include <lib/base/elock.h>
+
+/*
+ * The short event descriptors are cached as received, in their DVB encoding,
+ * and only converted to UTF-8 when an event is looked up.. most events are
+ * never shown. The conversion needs the language code of the descriptor and
+ * the mapping of the transponder, so the result is kept per descriptor crc
+ * and tsid/onid. The cache has two generations, when the young one is full
+ * the old one is dropped and the young one becomes the old one, so the
+ * recently shown events stay converted.
+ * Thread safe, the readers of the epg cache share its lock.
+ */
+class eEPGTextCache
+{
+public:
+	enum { generationSize = 2048 };
+
+	eEPGTextCache();
+
+	/* returns the short event descriptor descr converted to UTF-8 in result */
+	void get(__u32 crc, const __u8 *descr, int tsidonid, std::string &result);
+	void clear();
+
+	/* true when the name or the text of the short event descriptor is not UTF-8 yet */
+	static bool needsConversion(const __u8 *descr);
+	static void convert(const __u8 *descr, int tsidonid, std::string &result);
+
+	unsigned int hits() const { return m_hits; }
+	unsigned int misses() const { return m_misses; }
+	size_t memoryUsage();
+private:
+	struct hash
+	{
+		size_t operator()(__u64 key) const { return (size_t)(key ^ (key >> 32)); }
+	};
+	typedef __gnu_cxx::hash_map<__u64, std::string, hash> textMap;
+	eSingleLock m_lock;
+	textMap m_young, m_old;
+	unsigned int m_hits, m_misses;
+};
+
+#endif
@@ -5,7 +5,11 @@
 #include <fcntl.h>
 #include <byteswap.h>
 #include <sys/mman.h>
+#include <algorithm>
 #include <lib/gdi/xineLib.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #ifndef BYTE_ORDER
 #	error no byte order defined!
@@ -14,16 +18,47 @@
 #ifndef PAGESIZE
 #	define PAGESIZE 4096
 #endif
-#define ROUND_TO_PAGESIZE(value) ((value) & 0xFFFFF000)
 #define MAPSIZE (PAGESIZE*8)
 
+static const int entry_size = eMappedEntries::entrySize;
+
+int eMappedEntries::map(int fd, int index, size_t maxbytes)
+{
+	unmap();
+	off_t where = (off_t)index * entry_size;
+	off_t until = ::lseek(fd, 0, SEEK_END);
+	if (where >= until)
+		return 0;
+	where -= where % PAGESIZE;
+	size_t bytes = maxbytes;
+	if (where + (off_t)bytes > until)
+		bytes = (size_t)(until - where);
+	void *data = ::mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, where);
+	if (data == MAP_FAILED)
+		return -1;
+	m_data = (unsigned long long*)data;
+	m_size = bytes;
+	m_index = (int)(where / entry_size);
+	m_entries = (int)(bytes / entry_size);
+	return m_entries;
+}
+
+void eMappedEntries::unmap()
+{
+	if (m_data != NULL)
+		::munmap(m_data, m_size);
+	m_data = NULL;
+	m_size = 0;
+	m_index = -1;
+	m_entries = 0;
+}
+
 eMPEGStreamInformation::eMPEGStreamInformation():
+	m_ap(NULL),
+	m_ap_count(0),
 	m_structure_read_fd(-1),
-	m_cache_index(-1),
 	m_current_entry(-1),
-	m_structure_cache_entries(0),
 	m_structure_file_entries(0),
-	m_structure_cache(NULL),
 	m_streamtime_accesspoints(false)
 {
 }
@@ -37,94 +72,163 @@ void eMPEGStreamInformation::close()
 {
 	if (m_structure_read_fd >= 0)
 	{
-		if (m_structure_cache != NULL)
-		{
-			//eDebug("[eMPEGStreamInformation] {%d} close - unmap %p size %d", gettid(), m_structure_cache, m_structure_cache_entries * 16);
-			::munmap(m_structure_cache, m_structure_cache_entries * 16);
-			m_structure_cache = NULL;
-		}
+		m_structure_cache.unmap();
 		::close(m_structure_read_fd);
-		m_structure_cache_entries = 0;
-		m_cache_index = -1;
 		m_structure_read_fd = -1;
 		m_structure_file_entries = 0;
 	}
 }
 
+struct accessPointOrder
+{
+	const unsigned long long *ap;
+	accessPointOrder(const unsigned long long *a): ap(a) {}
+	bool operator()(int a, int b) const { return (pts_t)be64toh(ap[a*2+1]) < (pts_t)be64toh(ap[b*2+1]); }
+};
+
+struct accessPointEntry
+{
+	off_t off;
+	pts_t pts;
+	bool operator<(const accessPointEntry &o) const { return off < o.off; }
+};
+
 int eMPEGStreamInformation::load(const char *filename)
 {
 	//eDebug("[eMPEGStreamInformation] load(%s)", filename);
 	close();
 	std::string s_filename(filename);
 	m_structure_read_fd = ::open((s_filename + ".sc").c_str(), O_RDONLY);
-	m_access_points.clear();
-	m_pts_to_offset.clear();
+	m_ap_map.unmap();
+	m_ap_copy.clear();
+	m_ap = NULL;
+	m_ap_count = 0;
+	m_pts_order.clear();
 	m_timestamp_deltas.clear();
-	FILE *f = fopen((s_filename + ".ap").c_str(), "rb");
-	if (!f)
+	int fd = ::open((s_filename + ".ap").c_str(), O_RDONLY);
+	if (fd < 0)
 		return -1;
-	while (1)
+	off_t size = ::lseek(fd, 0, SEEK_END);
+	int count = m_ap_map.map(fd, 0, size - size % entry_size);
+	::close(fd); /* the mapping stays */
+	if (count < 0)
 	{
-		unsigned long long d[2];
-		if (fread(d, sizeof(d), 1, f) < 1)
+		eDebug("[eMPEGStreamInformation] failed to mmap %s.ap: %m", filename);
+		return -1;
+	}
+	m_ap = m_ap_map.data();
+	m_ap_count = count;
+	for (int i = 1; i < count; ++i)
+	{
+		if (apOffset(i) <= apOffset(i - 1))
+		{
+			/* not written by us.. sort it, the last one of the same offset wins */
+			std::vector<accessPointEntry> sorted(count);
+			for (int j = 0; j < count; ++j)
+			{
+				sorted[j].off = apOffset(j);
+				sorted[j].pts = apPts(j);
+			}
+			std::stable_sort(sorted.begin(), sorted.end());
+			m_ap_copy.reserve(count * 2);
+			for (int j = 0; j < count; ++j)
+			{
+				if (j + 1 < count && sorted[j + 1].off == sorted[j].off)
+					continue;
+				m_ap_copy.push_back(htobe64(sorted[j].off));
+				m_ap_copy.push_back(htobe64(sorted[j].pts));
+			}
+			m_ap_map.unmap();
+			m_ap = &m_ap_copy[0];
+			m_ap_count = m_ap_copy.size() / 2;
 			break;
-		d[0] = be64toh(d[0]);
-		d[1] = be64toh(d[1]);
-		m_access_points[d[0]] = d[1];
-		m_pts_to_offset.insert(std::pair<pts_t,off_t>(d[1], d[0]));
+		}
 	}
-	fclose(f);
+	m_pts_order.resize(m_ap_count);
+	for (int i = 0; i < m_ap_count; ++i)
+		m_pts_order[i] = i;
+	std::stable_sort(m_pts_order.begin(), m_pts_order.end(), accessPointOrder(m_ap));
 	/* assume the accesspoints are in streamtime, if they start with a 0 timestamp */
-	m_streamtime_accesspoints = (!m_access_points.empty() && m_access_points.begin()->second == 0);
+	m_streamtime_accesspoints = (m_ap_count && apPts(0) == 0);
 	fixupDiscontinuties();
 	return 0;
 }
 
+int eMPEGStreamInformation::apLowerBound(off_t offset) const
+{
+	int low = 0, high = m_ap_count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (apOffset(mid) < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+int eMPEGStreamInformation::apUpperBound(off_t offset) const
+{
+	int low = 0, high = m_ap_count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (apOffset(mid) <= offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
 void eMPEGStreamInformation::fixupDiscontinuties()
 {
-	if (m_access_points.empty())
+	if (!m_ap_count)
 		return;
 		/* if we have no delta at the beginning, extrapolate it */
-	if ((m_access_points.find(0) == m_access_points.end()) && (m_access_points.size() > 1))
+	if ((apOffset(0) != 0) && (m_ap_count > 1))
 	{
-		std::map<off_t,pts_t>::const_iterator second = m_access_points.begin();
-		std::map<off_t,pts_t>::const_iterator first  = second++;
-		if (first->first < second->first) /* i.e., not equal or broken */
+		if (apOffset(0) < apOffset(1)) /* i.e., not equal or broken */
 		{
-			off_t diff = second->first - first->first;
-			pts_t tdiff = second->second - first->second;
-			tdiff *= first->first;
+			off_t diff = apOffset(1) - apOffset(0);
+			pts_t tdiff = apPts(1) - apPts(0);
+			tdiff *= apOffset(0);
 			tdiff /= diff;
-			m_timestamp_deltas[0] = first->second - tdiff;
-//			eDebug("first delta is %08llx", first->second - tdiff);
+			m_timestamp_deltas.push_back(std::pair<off_t, pts_t>(0, apPts(0) - tdiff));
+//			eDebug("first delta is %08llx", apPts(0) - tdiff);
 		}
 	}
 
 	if (m_timestamp_deltas.empty())
-		m_timestamp_deltas[m_access_points.begin()->first] = m_access_points.begin()->second;
+		m_timestamp_deltas.push_back(std::pair<off_t, pts_t>(apOffset(0), apPts(0)));
 
-	pts_t currentDelta = m_timestamp_deltas.begin()->second, lastpts_t = 0;
-	for (std::map<off_t,pts_t>::const_iterator i(m_access_points.begin()); i != m_access_points.end(); ++i)
+	pts_t currentDelta = m_timestamp_deltas.front().second, lastpts_t = 0;
+	for (int i = 0; i < m_ap_count; ++i)
 	{
-		pts_t current = i->second - currentDelta;
+		pts_t current = apPts(i) - currentDelta;
 		pts_t diff = current - lastpts_t;
 		
 		if (llabs(diff) > (90000*10)) // 10sec diff
 		{
-//			eDebug("%llx < %llx, have discont. new timestamp is %llx (diff is %llx)!", current, lastpts_t, i->second, diff);
-			currentDelta = i->second - lastpts_t; /* FIXME: should be the extrapolated new timestamp, based on the current rate */
-//			eDebug("current delta now %llx, making current to %llx", currentDelta, i->second - currentDelta);
-			m_timestamp_deltas[i->first] = currentDelta;
+//			eDebug("%llx < %llx, have discont. new timestamp is %llx (diff is %llx)!", current, lastpts_t, apPts(i), diff);
+			currentDelta = apPts(i) - lastpts_t; /* FIXME: should be the extrapolated new timestamp, based on the current rate */
+//			eDebug("current delta now %llx, making current to %llx", currentDelta, apPts(i) - currentDelta);
+			if (m_timestamp_deltas.back().first == apOffset(i))
+				m_timestamp_deltas.back().second = currentDelta;
+			else
+				m_timestamp_deltas.push_back(std::pair<off_t, pts_t>(apOffset(i), currentDelta));
 		}
-		lastpts_t = i->second - currentDelta;
+		lastpts_t = apPts(i) - currentDelta;
 	}
 }
 
 pts_t eMPEGStreamInformation::getDelta(off_t offset)
 {
-	if (!m_timestamp_deltas.size())
+	if (m_timestamp_deltas.empty())
 		return 0;
-	std::map<off_t,pts_t>::iterator i = m_timestamp_deltas.upper_bound(offset);
+	std::vector<std::pair<off_t, pts_t> >::const_iterator i = std::upper_bound(m_timestamp_deltas.begin(), m_timestamp_deltas.end(),
+		std::pair<off_t, pts_t>(offset, 0x7fffFFFFffffFFFFll));
 	/* i can be the first when you query for something before the first PTS */
 	if (i != m_timestamp_deltas.begin())
 		--i;
@@ -148,21 +252,36 @@ int eMPEGStreamInformation::fixupPTS(const off_t &offset, pts_t &ts)
 	if (m_timestamp_deltas.empty())
 		return -1;
 
-	std::multimap<pts_t, off_t>::const_iterator 
-		l = m_pts_to_offset.upper_bound(ts - 60 * 90000), 
-		u = m_pts_to_offset.upper_bound(ts + 60 * 90000), 
-		nearest = m_pts_to_offset.end();
+	/* upper bounds of ts - 60s and ts + 60s in the pts order */
+	int l = 0, u = 0;
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		pts_t bound = pass ? ts + 60 * 90000 : ts - 60 * 90000;
+		int low = 0, high = m_ap_count;
+		while (low < high)
+		{
+			int mid = (low + high) / 2;
+			if (apPts(m_pts_order[mid]) <= bound)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		if (pass)
+			u = low;
+		else
+			l = low;
+	}
 
-	while (l != u)
+	int nearest = -1;
+	for (; l < u; ++l)
 	{
-		if ((nearest == m_pts_to_offset.end()) || (llabs(l->first - ts) < llabs(nearest->first - ts)))
-			nearest = l;
-		++l;
+		if ((nearest < 0) || (llabs(apPts(m_pts_order[l]) - ts) < llabs(apPts(nearest) - ts)))
+			nearest = m_pts_order[l];
 	}
-	if (nearest == m_pts_to_offset.end())
+	if (nearest < 0)
 		return 1;
 
-	ts -= getDelta(nearest->second);
+	ts -= getDelta(apOffset(nearest));
 
 	return 0;
 }
@@ -171,20 +290,20 @@ int eMPEGStreamInformation::fixupPTS(const off_t &offset, pts_t &ts)
 int eMPEGStreamInformation::getPTS(off_t &offset, pts_t &pts)
 {
 	//eDebug("[eMPEGStreamInformation] {%d} getPTS(offset=%llu, pts=%llu)", gettid(), offset, pts);
-	std::map<off_t,pts_t>::iterator before = m_access_points.lower_bound(offset);
-
-		/* usually, we prefer the AP before the given offset. however if there is none, we take any. */
-	if (before != m_access_points.begin())
-		--before;
-	
-	if (before == m_access_points.end())
+	if (!m_ap_count)
 	{
 		pts = 0;
 		return -1;
 	}
+
+	int before = apLowerBound(offset);
+
+		/* usually, we prefer the AP before the given offset. however if there is none, we take any. */
+	if (before != 0)
+		--before;
 	
-	offset = before->first;
-	pts = before->second - getDelta(offset);
+	offset = apOffset(before);
+	pts = apPts(before) - getDelta(offset);
 	
 	return 0;
 }
@@ -192,33 +311,27 @@ int eMPEGStreamInformation::getPTS(off_t &offset, pts_t &pts)
 pts_t eMPEGStreamInformation::getInterpolated(off_t offset)
 {
 		/* get the PTS values before and after the offset. */
-	std::map<off_t,pts_t>::iterator before, after;
-	after = m_access_points.upper_bound(offset);
-	before = after;
-
-	if (before != m_access_points.begin())
-		--before;
-	else	/* we query before the first known timestamp ... FIXME */
-		return 0;
+	int after = apUpperBound(offset);
 
-		/* empty... */
-	if (before == m_access_points.end())
+		/* empty, or we query before the first known timestamp ... FIXME */
+	if (after == 0)
 		return 0;
+	int before = after - 1;
 
 		/* if after == end, then we need to extrapolate ... FIXME */
-	if ((before->first == offset) || (after == m_access_points.end()))
-		return before->second - getDelta(offset);
+	if ((apOffset(before) == offset) || (after == m_ap_count))
+		return apPts(before) - getDelta(offset);
 	
-	pts_t before_ts = before->second - getDelta(before->first);
-	pts_t after_ts = after->second - getDelta(after->first);
+	pts_t before_ts = apPts(before) - getDelta(apOffset(before));
+	pts_t after_ts = apPts(after) - getDelta(apOffset(after));
 	
 //	eDebug("%08llx .. ? .. %08llx", before_ts, after_ts);
-//	eDebug("%08llx .. %08llx .. %08llx", before->first, offset, after->first);
+//	eDebug("%08llx .. %08llx .. %08llx", apOffset(before), offset, apOffset(after));
 	
 	pts_t diff = after_ts - before_ts;
-	off_t diff_off = after->first - before->first;
+	off_t diff_off = apOffset(after) - apOffset(before);
 	
-	diff = (offset - before->first) * diff / diff_off;
+	diff = (offset - apOffset(before)) * diff / diff_off;
 //	eDebug("%08llx .. %08llx .. %08llx", before_ts, before_ts + diff, after_ts);
 	return before_ts + diff;
 }
@@ -230,20 +343,25 @@ off_t eMPEGStreamInformation::getAccessPoint(pts_t ts, int marg)
 	off_t last = 0;
 	off_t last2 = 0;
 	ts += 1; // Add rounding error margin
-	for (std::map<off_t, pts_t>::const_iterator i(m_access_points.begin()); i != m_access_points.end(); ++i)
+		/* the deltas are sorted like the access points, follow them along */
+	size_t d = 0;
+	for (int i = 0; i < m_ap_count; ++i)
 	{
-		pts_t delta = getDelta(i->first);
-		pts_t c = i->second - delta;
+		off_t offset = apOffset(i);
+		while (d + 1 < m_timestamp_deltas.size() && m_timestamp_deltas[d + 1].first <= offset)
+			++d;
+		pts_t delta = m_timestamp_deltas.empty() ? 0 : m_timestamp_deltas[d].second;
+		pts_t c = apPts(i) - delta;
 		if (c > ts) {
 			if (marg > 0)
-				return (last + i->first)/376*188;
+				return (last + offset)/376*188;
 			else if (marg < 0)
 				return (last + last2)/376*188;
 			else
 				return last;
 		}
 		last2 = last;
-		last = i->first;
+		last = offset;
 	}
 	if (marg < 0)
 		return (last + last2)/376*188;
@@ -253,136 +371,107 @@ off_t eMPEGStreamInformation::getAccessPoint(pts_t ts, int marg)
 
 int eMPEGStreamInformation::getNextAccessPoint(pts_t &ts, const pts_t &start, int direction)
 {
-	if (m_access_points.empty())
+	if (!m_ap_count)
 	{
 		eDebug("can't get next access point without streaminfo (yet)");
 		return -1;
 	}
 	off_t offset = getAccessPoint(start);
-	std::map<off_t, pts_t>::const_iterator i = m_access_points.find(offset);
-	if (i == m_access_points.end())
+	int i = apLowerBound(offset);
+	if (i == m_ap_count || apOffset(i) != offset)
 	{
 		eDebug("getNextAccessPoint: initial AP not found");
 		return -1;
 	}
-	pts_t c1 = i->second - getDelta(i->first);
+	pts_t c1 = apPts(i) - getDelta(apOffset(i));
 	while (direction)
 	{
 		while (direction > 0)
 		{
-			if (i == m_access_points.end())
+			if (i + 1 >= m_ap_count)
 				return -1;
 			++i;
-			pts_t c2 = i->second - getDelta(i->first);
+			pts_t c2 = apPts(i) - getDelta(apOffset(i));
 			if (c1 == c2) { // Discontinuity
+				if (i + 1 >= m_ap_count)
+					return -1;
 				++i;
-				c2 = i->second - getDelta(i->first);
+				c2 = apPts(i) - getDelta(apOffset(i));
 			}
 			c1 = c2;
 			direction--;
 		}
 		while (direction < 0)
 		{
-			if (i == m_access_points.begin())
+			if (i == 0)
 			{
 				eDebug("getNextAccessPoint at start");
 				return -1;
 			}
 			--i;
-			pts_t c2 = i->second - getDelta(i->first);
+			pts_t c2 = apPts(i) - getDelta(apOffset(i));
 			if (c1 == c2) { // Discontinuity
+				if (i == 0)
+				{
+					eDebug("getNextAccessPoint at start");
+					return -1;
+				}
 				--i;
-				c2 = i->second - getDelta(i->first);
+				c2 = apPts(i) - getDelta(apOffset(i));
 			}
 			c1 = c2;
 			direction++;
 		}
 	}
-	ts = i->second - getDelta(i->first);
-	eDebug("getNextAccessPoint fine, at %lld - %lld = %lld", ts, i->second, getDelta(i->first));
+	ts = apPts(i) - getDelta(apOffset(i));
+	eDebug("getNextAccessPoint fine, at %lld - %lld = %lld", ts, apPts(i), getDelta(apOffset(i)));
 	return 0;
 }
 
-#define structureCacheOffset(i) ((off_t)be64toh(m_structure_cache[(i)*2]))
-#define structureCacheData(i) ((off_t)be64toh(m_structure_cache[(i)*2+1]))
-
-static const int entry_size = 16;
+#define structureCacheOffset(i) (m_structure_cache.offset(i))
+#define structureCacheData(i) ((off_t)m_structure_cache.value(i))
 
 int eMPEGStreamInformation::moveCache(int index)
 {
-	//eDebug("[eMPEGStreamInformation::moveCache] index=%d m_cache_index=%d m_structure_cache_entries=%d", index, m_cache_index, m_structure_cache_entries);
+	//eDebug("[eMPEGStreamInformation::moveCache] index=%d m_cache_index=%d m_structure_cache_entries=%d", index, m_structure_cache.index(), m_structure_cache.entries());
 	// Check if index falls inside current range.
-	if ((m_structure_cache_entries != 0) && (index >= m_cache_index) && (index < m_cache_index + m_structure_cache_entries))
+	int entries = m_structure_cache.entries();
+	if ((entries != 0) && (index >= m_structure_cache.index()) && (index < m_structure_cache.index() + entries))
 	{
 		// Request for the same data. If the request is at the end of the stream,
 		// check if the file has become larger.
-		if (index + m_structure_cache_entries >= m_structure_file_entries)
+		if (index + entries >= m_structure_file_entries)
 		{
 			int l = ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
 			if (l == m_structure_file_entries)
 			{
 				// No change to file, just return
-				return m_structure_cache_entries;
+				return entries;
 			}
 			m_structure_file_entries = l;
 		}
 		else
 		{
 			// Requested same position as last time, just return
-			return m_structure_cache_entries;
+			return entries;
 		}
 	}
 	// Really have to re-read the cache now
 	return loadCache(index);
 }
 
-// Page size is 4k, entry size is 16. To round it down, (((value*16)/PAGESIZE)*PAGESIZE)/16
-
 int eMPEGStreamInformation::loadCache(int index)
 {
 	//eDebug("[eMPEGStreamInformation::loadCache] index=%d", index);
-	if (m_structure_cache != NULL)
-	{
-		//eDebug("[eMPEGStreamInformation] munmap %p size %d index %d", m_structure_cache, m_structure_cache_entries * entry_size, m_cache_index);
-		::munmap(m_structure_cache, m_structure_cache_entries * entry_size);
-		m_structure_cache = NULL;
-		m_structure_cache_entries = 0;
-		m_cache_index = -1;
-	}
-	off_t where = ROUND_TO_PAGESIZE(index * entry_size);
-	off_t until = ::lseek(m_structure_read_fd, 0, SEEK_END);
-	size_t bytes;
-	if (where + MAPSIZE <= until)
-	{
-		bytes = MAPSIZE;
-	}
-	else
-	{
-		if (index * entry_size >= until)
-		{
-			eDebug("[eMPEGStreamInformation] index %d is past EOF", index);
-			return 0;
-		}
-		bytes = (size_t)(until-where);
-		if (bytes == 0)
-		{
-			eDebug("[eMPEGStreamInformation] mmap file is empty");
-			return 0;
-		}
-	}
-	//eDebug("[eMPEGStreamInformation] mmap offset=%lld size %d", where, bytes);
-	m_structure_cache = (unsigned long long*) ::mmap(NULL, bytes, PROT_READ, MAP_SHARED, m_structure_read_fd, where);
-	if (m_structure_cache == NULL)
+	int num = m_structure_cache.map(m_structure_read_fd, index, MAPSIZE);
+	if (num < 0)
 	{
 		eDebug("[eMPEGStreamInformation] failed to mmap cache: %m");
-		m_cache_index = -1;
-		m_structure_cache_entries = 0;
 		return -1;
 	}
-	m_cache_index = (int)(where / entry_size);
-//	eDebug("[eMPEGStreamInformation] cache index %d starts at %d (%lld) bytes: %d", index, m_cache_index, where, bytes);
-	int num = (int)bytes / entry_size;
-	m_structure_cache_entries = num;
+	if (num == 0)
+		eDebug("[eMPEGStreamInformation] index %d is past EOF", index);
+//	eDebug("[eMPEGStreamInformation] cache index %d starts at %d", index, m_structure_cache.index());
 	return num;
 }
 
@@ -395,9 +484,9 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 		return -1;
 	}
 
-	if ((m_structure_cache_entries == 0) ||
+	if ((m_structure_cache.entries() == 0) ||
 	    (structureCacheOffset(0) > offset) ||
-	    (structureCacheOffset(m_structure_cache_entries - 1) <= offset))
+	    (structureCacheOffset(m_structure_cache.entries() - 1) <= offset))
 	{
 		int l = ::lseek(m_structure_read_fd, 0, SEEK_END) / entry_size;
 		if (l == 0)
@@ -449,7 +538,7 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 	// Binary search for offset
 	int i = 0;
 	int low = 0;
-	int high = m_structure_cache_entries - 1;
+	int high = m_structure_cache.entries() - 1;
 	while (low <= high)
 	{
 		int mid = (low + high) / 2;
@@ -466,7 +555,7 @@ int eMPEGStreamInformation::getStructureEntryFirst(off_t &offset, unsigned long
 		i = 0;
 	offset = structureCacheOffset(i);
 	data = structureCacheData(i);
-	m_current_entry = m_cache_index + i;
+	m_current_entry = m_structure_cache.index() + i;
 	//eDebug("[eMPEGStreamInformation] first index=%d (%d); %llu: %llu", m_current_entry, i, offset, data);
 	return 0;
 }
@@ -480,8 +569,8 @@ int eMPEGStreamInformation::getStructureEntryNext(off_t &offset, unsigned long l
 		eDebug("getStructureEntryNext before start-of-file");
 		return -1;
 	}
-	int index = next - m_cache_index;
-	if ((index < 0) || (index >= m_structure_cache_entries))
+	int index = next - m_structure_cache.index();
+	if ((index < 0) || (index >= m_structure_cache.entries()))
 	{
 		// Moved outsize cache range, fetch a new array
 		int where;
@@ -503,12 +592,12 @@ int eMPEGStreamInformation::getStructureEntryNext(off_t &offset, unsigned long l
 			eDebug("getStructureEntryNext failed, no data");
 			return -1;
 		}
-		index = next - m_cache_index;
-		//eDebug("[getStructureEntryNext] Moved outside cache, next=%d delta=%d cache=%d index=+%d", next, delta, m_cache_index, index);
+		index = next - m_structure_cache.index();
+		//eDebug("[getStructureEntryNext] Moved outside cache, next=%d delta=%d cache=%d index=+%d", next, delta, m_structure_cache.index(), index);
 	}
 	offset = structureCacheOffset(index);
 	data = structureCacheData(index);
-	m_current_entry = m_cache_index + index;
+	m_current_entry = m_structure_cache.index() + index;
 	//eDebug("[eMPEGStreamInformation] next index=%d (%d); %llu: %llu", m_current_entry, index, offset, data);
 	return 0;
 }
@@ -517,11 +606,10 @@ int eMPEGStreamInformation::getStructureEntryNext(off_t &offset, unsigned long l
 int eMPEGStreamInformation::getFirstFrame(off_t &offset, pts_t& pts)
 {
 	//eDebug("{%d} eMPEGStreamInformation::getFirstFrame", gettid());
-	std::map<off_t,pts_t>::const_iterator entry = m_access_points.begin();
-	if (entry != m_access_points.end())
+	if (m_ap_count)
 	{
-		offset = entry->first;
-		pts = entry->second;
+		offset = apOffset(0);
+		pts = apPts(0);
 		return 0;
 	}
 	// No access points (yet?) use the .sc data instead
@@ -552,11 +640,10 @@ int eMPEGStreamInformation::getFirstFrame(off_t &offset, pts_t& pts)
 int eMPEGStreamInformation::getLastFrame(off_t &offset, pts_t& pts)
 {
 	//eDebug("{%d} eMPEGStreamInformation::getLastFrame", gettid());
-	std::map<off_t,pts_t>::const_reverse_iterator entry = m_access_points.rbegin();
-	if (entry != m_access_points.rend())
+	if (m_ap_count)
 	{
-		offset = entry->first;
-		pts = entry->second;
+		offset = apOffset(m_ap_count - 1);
+		pts = apPts(m_ap_count - 1);
 		return 0;
 	}
 	// No access points (yet?) use the .sc data instead
@@ -647,8 +734,11 @@ int eMPEGStreamInformationWriter::stopSave(void)
 		return 1;
 	std::string ap_filename(m_filename);
 	ap_filename += ".ap";
+	/* readers map the file, it is replaced as a whole instead of truncated */
+	std::string tmp_filename(ap_filename);
+	tmp_filename += ".$$$";
 	{
-		FILE *f = fopen(ap_filename.c_str(), "wb");
+		FILE *f = fopen(tmp_filename.c_str(), "wb");
 		if (!f)
 			return -1;
 		for (std::deque<AccessPoint>::const_iterator i(m_streamtime_access_points.begin()); i != m_streamtime_access_points.end(); ++i)
@@ -667,14 +757,26 @@ int eMPEGStreamInformationWriter::stopSave(void)
 			if (fwrite(d, sizeof(d), 1, f) <= 0)
 				goto write_ap_error;
 		}
-		fclose(f);
-	}
-	return 0;
+		if (fclose(f) != 0)
+		{
+			f = NULL;
+			goto write_ap_error;
+		}
+		if (::rename(tmp_filename.c_str(), ap_filename.c_str()) < 0)
+		{
+			eDebug("Failed to rename %s: %m", tmp_filename.c_str());
+			::unlink(tmp_filename.c_str());
+			return -1;
+		}
+		return 0;
 write_ap_error:
+		if (f)
+			fclose(f);
+	}
 	/* Writing half an AP file is worse than no file at all, so unlink
 	* it if writing it fails */
 	eDebug("Failed to write %s, removing it", ap_filename.c_str());
-	::unlink(ap_filename.c_str());
+	::unlink(tmp_filename.c_str());
 	return -1;
 }
 
@@ -833,6 +935,152 @@ void eMPEGStreamInformationWriter::close()
 }
 
 
+	/* The recorder runs all data through parseData, but only the packets of */
+	/* the timing pid are parsed. The headers of a run of packets are compared */
+	/* with the wanted pid at once, and inside a packet the start codes are */
+	/* searched a vector at a time, with AVX2 when the cpu has it. The scalar */
+	/* versions do the rest, and all of it on other cpus. */
+
+	/* the first three header bytes are compared as a little endian word: */
+	/* sync byte, pusi and pid high bits, pid low bits. a packet is wanted */
+	/* when (header & mask) == key, the key of no pid has no sync byte. */
+
+	/* number of packets from hdr on that have a sync byte and are not wanted */
+static int skipPacketsScalar(const unsigned char *hdr, int count, int packetsize, unsigned int key, unsigned int mask)
+{
+	int i;
+	for (i = 0; i < count; ++i, hdr += packetsize)
+	{
+		if (hdr[0] != 0x47 || ((hdr[0] | (hdr[1] << 8) | (hdr[2] << 16)) & mask) == key)
+			break;
+	}
+	return i;
+}
+
+	/* first p in [p, end) with 00 00 01 at p, or end. reads up to end[1] */
+static inline const unsigned char *findStartCodeScalar(const unsigned char *p, const unsigned char *end)
+{
+	while (p < end)
+	{
+		if (p[2] > 1) /* no start code at p, p + 1 or p + 2 */
+			p += 3;
+		else if (p[2] == 0)
+			++p;
+		else if (!p[0] && !p[1])
+			return p;
+		else
+			p += 3;
+	}
+	return end;
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+static bool detectAVX2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+static const bool haveAVX2 = detectAVX2();
+
+__attribute__((target("avx2")))
+static int skipPacketsAVX2(const unsigned char *hdr, int count, int packetsize, unsigned int key, unsigned int mask)
+{
+	const __m256i index = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(packetsize));
+	const __m256i syncmask = _mm256_set1_epi32(0xFF), sync = _mm256_set1_epi32(0x47);
+	const __m256i wantmask = _mm256_set1_epi32(mask), want = _mm256_set1_epi32(key);
+	int i = 0;
+	for (; i + 8 <= count; i += 8, hdr += 8 * packetsize)
+	{
+		__m256i w = _mm256_i32gather_epi32((const int*)hdr, index, 1);
+		__m256i insync = _mm256_cmpeq_epi32(_mm256_and_si256(w, syncmask), sync);
+		__m256i wanted = _mm256_cmpeq_epi32(_mm256_and_si256(w, wantmask), want);
+		unsigned int skip = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(wanted, insync)));
+		if (skip != 0xFF)
+			return i + __builtin_ctz(~skip);
+	}
+	return i + skipPacketsScalar(hdr, count - i, packetsize, key, mask);
+}
+
+__attribute__((target("avx2")))
+static const unsigned char *findStartCodeAVX2(const unsigned char *p, const unsigned char *end)
+{
+	const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi8(1);
+	for (; p + 32 <= end; p += 32)
+	{
+		__m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)p), zero);
+		__m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 1)), zero);
+		__m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + 2)), one);
+		unsigned int found = _mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), c));
+		if (found)
+			return p + __builtin_ctz(found);
+	}
+	return findStartCodeScalar(p, end);
+}
+#endif
+
+#ifdef __SSE2__
+static int skipPacketsSSE2(const unsigned char *hdr, int count, int packetsize, unsigned int key, unsigned int mask)
+{
+	const __m128i syncmask = _mm_set1_epi32(0xFF), sync = _mm_set1_epi32(0x47);
+	const __m128i wantmask = _mm_set1_epi32(mask), want = _mm_set1_epi32(key);
+	int i = 0;
+	for (; i + 4 <= count; i += 4, hdr += 4 * packetsize)
+	{
+		unsigned int h[4];
+		for (int j = 0; j < 4; ++j)
+			memcpy(&h[j], hdr + j * packetsize, 4);
+		__m128i w = _mm_loadu_si128((const __m128i*)h);
+		__m128i insync = _mm_cmpeq_epi32(_mm_and_si128(w, syncmask), sync);
+		__m128i wanted = _mm_cmpeq_epi32(_mm_and_si128(w, wantmask), want);
+		unsigned int skip = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(wanted, insync)));
+		if (skip != 0xF)
+			return i + __builtin_ctz(~skip);
+	}
+	return i + skipPacketsScalar(hdr, count - i, packetsize, key, mask);
+}
+
+static const unsigned char *findStartCodeSSE2(const unsigned char *p, const unsigned char *end)
+{
+	const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+	for (; p + 16 <= end; p += 16)
+	{
+		__m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), zero);
+		__m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 1)), zero);
+		__m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + 2)), one);
+		unsigned int found = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c));
+		if (found)
+			return p + __builtin_ctz(found);
+	}
+	return findStartCodeScalar(p, end);
+}
+#endif
+
+static inline int skipPackets(const unsigned char *hdr, int count, int packetsize, unsigned int key, unsigned int mask)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	if (haveAVX2)
+		return skipPacketsAVX2(hdr, count, packetsize, key, mask);
+#endif
+#ifdef __SSE2__
+	return skipPacketsSSE2(hdr, count, packetsize, key, mask);
+#else
+	return skipPacketsScalar(hdr, count, packetsize, key, mask);
+#endif
+}
+
+static inline const unsigned char *findStartCode(const unsigned char *p, const unsigned char *end)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	if (haveAVX2)
+		return findStartCodeAVX2(p, end);
+#endif
+#ifdef __SSE2__
+	return findStartCodeSSE2(p, end);
+#else
+	return findStartCodeScalar(p, end);
+#endif
+}
+
 eMPEGStreamParserTS::eMPEGStreamParserTS(int packetsize):
 	m_pktptr(0),
 	m_pid(-1),
@@ -848,7 +1096,8 @@ eMPEGStreamParserTS::eMPEGStreamParserTS(int packetsize):
 	m_last_time(1072224000), // 01.01.2004
 	m_enable_accesspoints(true),
 	m_pts_found(false),
-	m_has_accesspoints(false)
+	m_has_accesspoints(false),
+	m_offline(false)
 {
 }
 
@@ -871,7 +1120,7 @@ int eMPEGStreamParserTS::processPacket(const unsigned char *pkt, off_t offset)
 	if (pkt[3] & 0xc0) 
 	{
 		/* scrambled stream, we cannot parse pts, extrapolate with measured stream time instead */
-		if (pusi && m_enable_accesspoints)
+		if (pusi && m_enable_accesspoints && !m_offline)
 		{
 			timespec now, diff;
 			clock_gettime(CLOCK_MONOTONIC, &now);
@@ -962,82 +1211,79 @@ int eMPEGStreamParserTS::processPacket(const unsigned char *pkt, off_t offset)
 		pkt += pkt[8] + 9;
 	}
 
-	for (; pkt < (end-4); ++pkt)
+	for (pkt = findStartCode(pkt, end - 4); pkt < (end-4); pkt = findStartCode(pkt + 1, end - 4))
 	{
 		int pkt_offset = pkt - begin;
-		if (!(pkt[0] || pkt[1] || (pkt[2] != 1)))
-		{
-//			 ("SC %02x %02x %02x %02x, %02x", pkt[0], pkt[1], pkt[2], pkt[3], pkt[4]);
-			unsigned int sc = pkt[3];
+//		 ("SC %02x %02x %02x %02x, %02x", pkt[0], pkt[1], pkt[2], pkt[3], pkt[4]);
+		unsigned int sc = pkt[3];
 
-			if (m_streamtype < 0) /* unknown */
+		if (m_streamtype < 0) /* unknown */
+		{
+			if ((sc == 0x00) || (sc == 0xb3) || (sc == 0xb8))
 			{
-				if ((sc == 0x00) || (sc == 0xb3) || (sc == 0xb8))
-				{
-					eDebug("eMPEGStreamParserTS - detected MPEG2 stream");
-					m_streamtype = 0;
-				}
-				else if (sc == 0x09)
-				{
-					eDebug("eMPEGStreamParserTS - detected H264 stream");
-					m_streamtype =  1;
-				}
-				else
-					continue;
+				eDebug("eMPEGStreamParserTS - detected MPEG2 stream");
+				m_streamtype = 0;
+			}
+			else if (sc == 0x09)
+			{
+				eDebug("eMPEGStreamParserTS - detected H264 stream");
+				m_streamtype =  1;
 			}
+			else
+				continue;
+		}
 
-			if (m_streamtype == 0) /* mpeg2 */
+		if (m_streamtype == 0) /* mpeg2 */
+		{
+			if ((sc == 0x00) || (sc == 0xb3) || (sc == 0xb8)) /* picture, sequence, group start code */
 			{
-				if ((sc == 0x00) || (sc == 0xb3) || (sc == 0xb8)) /* picture, sequence, group start code */
+				if ((sc == 0xb3) && m_enable_accesspoints) /* sequence header */
 				{
-					if ((sc == 0xb3) && m_enable_accesspoints) /* sequence header */
-					{
-						if (ptsvalid)
-						{
-							addAccessPoint(offset, pts);
-							//eDebug("Sequence header at %llx, pts %llx", offset, pts);
-						}
-					}
-					if (pkt <= (end - 6))
-					{
-						unsigned long long data = sc | ((unsigned)pkt[4] << 8) | ((unsigned)pkt[5] << 16);
-						if (ptsvalid) // If available, add timestamp data as well. PTS = 33 bits
-							data |= (pts << 31) | 0x1000000;
-						writeStructureEntry(offset + pkt_offset, data);
-					}
-					else
+					if (ptsvalid)
 					{
-						// Returning non-zero suggests we need more data. This does not
-						// work, and never has, so we should make this a void function
-						// or fix that...
-						return 1;
+						addAccessPoint(offset, pts);
+						//eDebug("Sequence header at %llx, pts %llx", offset, pts);
 					}
 				}
-			}
-			else /* (m_streamtype == 1) means H.264 */
-			{
-				if (sc == 0x09)
+				if (pkt <= (end - 6))
 				{
-					/* store image type */
-					unsigned long long data = sc | (pkt[4] << 8);
+					unsigned long long data = sc | ((unsigned)pkt[4] << 8) | ((unsigned)pkt[5] << 16);
 					if (ptsvalid) // If available, add timestamp data as well. PTS = 33 bits
 						data |= (pts << 31) | 0x1000000;
 					writeStructureEntry(offset + pkt_offset, data);
-					if ( //pkt[3] == 0x09 &&   /* MPEG4 AVC NAL unit access delimiter */
-						 (pkt[4] >> 5) == 0) /* and I-frame */
+				}
+				else
+				{
+					// Returning non-zero suggests we need more data. This does not
+					// work, and never has, so we should make this a void function
+					// or fix that...
+					return 1;
+				}
+			}
+		}
+		else /* (m_streamtype == 1) means H.264 */
+		{
+			if (sc == 0x09)
+			{
+				/* store image type */
+				unsigned long long data = sc | (pkt[4] << 8);
+				if (ptsvalid) // If available, add timestamp data as well. PTS = 33 bits
+					data |= (pts << 31) | 0x1000000;
+				writeStructureEntry(offset + pkt_offset, data);
+				if ( //pkt[3] == 0x09 &&   /* MPEG4 AVC NAL unit access delimiter */
+					 (pkt[4] >> 5) == 0) /* and I-frame */
+				{
+					if (ptsvalid && m_enable_accesspoints)
 					{
-						if (ptsvalid && m_enable_accesspoints)
-						{
-							addAccessPoint(offset, pts);
-							// eDebug("MPEG4 AVC UAD at %llx, pts %llx", offset, pts);
-						}
+						addAccessPoint(offset, pts);
+						// eDebug("MPEG4 AVC UAD at %llx, pts %llx", offset, pts);
 					}
 				}
 			}
 		}
 	}
 
-	if (m_broken && m_pts_found)
+	if (m_broken && m_pts_found && !m_offline)
 	{
 		cXineLib *xineLib = cXineLib::getInstance();
 		xineLib->playVideo();
@@ -1102,6 +1348,26 @@ void eMPEGStreamParserTS::parseData(off_t offset, const void *data, unsigned int
 		
 		if (!len)
 			break;
+
+		if (!m_pktptr && len >= (unsigned int)m_packetsize)
+		{
+				/* whole packets which wantPacket would drop are skipped in one go */
+			unsigned int key = 0, mask = 0xFF1FFF;
+			if (m_pid >= 0)
+				key = 0x47 | ((m_pid >> 8) << 8) | ((m_pid & 0xFF) << 16);
+			if (!m_need_next_packet && m_streamtype != 0) /* just the pusi packets */
+			{
+				key |= 0x4000;
+				mask |= 0x4000;
+			}
+			unsigned int skiplen = skipPackets(packet + m_header_offset, len / m_packetsize, m_packetsize, key, mask) * m_packetsize;
+			if (skiplen)
+			{
+				packet += skiplen;
+				len -= skiplen;
+				continue;
+			}
+		}
 		
 		if (m_pktptr)
 		{
@@ -1129,10 +1395,8 @@ void eMPEGStreamParserTS::parseData(off_t offset, const void *data, unsigned int
 				if (m_pktptr == m_header_offset + 4)
 					if (!wantPacket(m_pkt))
 					{
-							/* skip packet */
-						packet += 184 + m_header_offset;
-						len -= 184 + m_header_offset;
-						m_pktptr = 0;
+							/* skip the rest of the packet, which may be in the next buffer */
+						m_pktptr -= m_packetsize;
 						continue;
 					}
 			}
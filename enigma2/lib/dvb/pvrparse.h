@@ -6,11 +6,38 @@
 #include <map>
 #include <set>
 #include <deque>
+#include <vector>
 #include <aio.h>
+#include <endian.h>
 
 	/* This module parses TS data and collects valuable information  */
 	/* about it, like PTS<->offset correlations and sequence starts. */
 
+	/* a read only mapped window of a .ap or .sc file, which both are */
+	/* arrays of big endian (offset, data) pairs. */
+class eMappedEntries
+{
+public:
+	enum { entrySize = 16 };
+	eMappedEntries(): m_data(NULL), m_size(0), m_index(-1), m_entries(0) {}
+	~eMappedEntries() { unmap(); }
+		/* maps the entries from index on, at most maxbytes from the page before it.
+		   returns the number of entries mapped, 0 past the end of the file, or -1 */
+	int map(int fd, int index, size_t maxbytes);
+	void unmap();
+	int index() const { return m_index; } /* of the first entry mapped */
+	int entries() const { return m_entries; }
+	const unsigned long long *data() const { return m_data; }
+	off_t offset(int i) const { return (off_t)be64toh(m_data[i*2]); }
+	unsigned long long value(int i) const { return be64toh(m_data[i*2+1]); }
+private:
+	unsigned long long *m_data;
+	size_t m_size;
+	int m_index, m_entries;
+	eMappedEntries(const eMappedEntries &);
+	eMappedEntries &operator=(const eMappedEntries &);
+};
+
 class eMPEGStreamInformation
 {
 public:
@@ -30,7 +57,7 @@ public:
 	
 	int getNextAccessPoint(pts_t &ts, const pts_t &start, int direction);
 	
-	bool hasAccessPoints() { return !m_access_points.empty(); }
+	bool hasAccessPoints() { return m_ap_count != 0; }
 	bool hasStructure() { return m_structure_read_fd >= 0; }
 	
 		/* get a structure entry at given offset (or previous one, if no exact match was found).
@@ -56,19 +83,28 @@ private:
 	/* we order by off_t here, since the timestamp may */
 	/* wrap around. */
 	/* we only record sequence start's pts values here. */
-	std::map<off_t, pts_t> m_access_points;
+	/* m_ap points to the mapped .ap file, or to m_ap_copy */
+	/* when the file wasn't sorted. */
+	eMappedEntries m_ap_map;
+	std::vector<unsigned long long> m_ap_copy;
+	const unsigned long long *m_ap;
+	int m_ap_count;
+	off_t apOffset(int i) const { return (off_t)be64toh(m_ap[i*2]); }
+	pts_t apPts(int i) const { return (pts_t)be64toh(m_ap[i*2+1]); }
+	/* first access point at or after / after offset */
+	int apLowerBound(off_t offset) const;
+	int apUpperBound(off_t offset) const;
 	/* timestampDelta is in fact the difference between */
 	/* the PTS in the stream and a real PTS from 0..max */
-	std::map<off_t, pts_t> m_timestamp_deltas;
-	/* these are non-fixed up pts value (like m_access_points), just used to accelerate stuff. */
-	std::multimap<pts_t, off_t> m_pts_to_offset;
+	/* sorted by offset, one entry per discontinuity */
+	std::vector<std::pair<off_t, pts_t> > m_timestamp_deltas;
+	/* the access points ordered by their non-fixed up pts, just used to accelerate stuff. */
+	std::vector<int> m_pts_order;
 
 	int m_structure_read_fd;
-	int m_cache_index;   // Location of cache
 	int m_current_entry; // For getStructureEntryNext
-	int m_structure_cache_entries;
 	int m_structure_file_entries; // Also to detect changes to file
-	unsigned long long* m_structure_cache;
+	eMappedEntries m_structure_cache;
 	bool m_streamtime_accesspoints;
 };
 
@@ -120,6 +156,9 @@ public:
 	int getLastPTS(pts_t &last_pts);
 	int getFirstPTS(pts_t &first_pts);
 	void enableAccessPoints(bool enable) { m_enable_accesspoints = enable; }
+		/* parsing a file instead of a live stream: no access points from the */
+		/* wall clock for scrambled data, and the player is left alone. */
+	void setOffline(bool offline) { m_offline = offline; }
 private:
 	unsigned char m_pkt[192];
 	int m_pktptr;
@@ -143,6 +182,7 @@ private:
 	bool m_enable_accesspoints; /* set to false to prevent saving .ap files (e.g. timeshift) */
 	bool m_pts_found; /* 'real' mpeg pts has been found, no longer measuring streamtime */
 	bool m_has_accesspoints;
+	bool m_offline;
 };
 
 #endif
@@ -14,3 +14,6 @@ def InitRecordingConfig():
 		("short", _("Short filenames")),
 		("long", _("Long filenames")) ] )
 	config.recording.offline_decode_delay = ConfigNumber(default = 1000)
+	config.recording.io_uring = ConfigYesNo(default = True)
+	config.recording.direct_io = ConfigYesNo(default = False)
+	config.recording.io_scheduler = ConfigYesNo(default = False)
@@ -278,6 +278,32 @@ def InitUsageConfig():
 		eEPGCache.getInstance().setEpgHistorySeconds(config.epg.histminutes.getValue()*60)
 	config.epg.histminutes.addNotifier(EpgHistorySecondsChanged)
 
+	config.epg.maxmemory = ConfigSelection(default = "0", choices = [("0", _("unlimited")), ("4", "4 MB"), ("8", "8 MB"), ("16", "16 MB"), ("32", "32 MB"), ("64", "64 MB")])
+	def EpgMaxMemoryChanged(configElement):
+		from enigma import eEPGCache
+		refreshPreferredServices()
+		eEPGCache.getInstance().setMemoryLimit(int(configElement.value) * 1024)
+	config.epg.maxmemory.addNotifier(EpgMaxMemoryChanged)
+
+	config.epg.compress = ConfigYesNo(default = False)
+	def EpgCompressChanged(configElement):
+		from enigma import eEPGCache
+		eEPGCache.getInstance().setCompression(configElement.value)
+	config.epg.compress.addNotifier(EpgCompressChanged)
+
+	config.epg.statistics = ConfigSelection(default = "0", choices = [("0", _("no")), ("5", "5 min"), ("15", "15 min"), ("60", "60 min")])
+	def EpgStatisticsChanged(configElement):
+		from enigma import eEPGCache
+		eEPGCache.getInstance().setStatisticsInterval(int(configElement.value))
+	config.epg.statistics.addNotifier(EpgStatisticsChanged)
+
+	config.epg.harvest_tuners = ConfigSelection(default = "0", choices = [("0", _("no")), ("1", "1"), ("2", "2"), ("3", "3"), ("4", "4")])
+	def EpgHarvestTunersChanged(configElement):
+		from enigma import eEPGCache
+		tuners = int(configElement.value)
+		eEPGCache.getInstance().setHarvester(tuners, tuners and getBouquetServices() or [])
+	config.epg.harvest_tuners.addNotifier(EpgHarvestTunersChanged)
+
 	def setHDDStandby(configElement):
 		for hdd in harddiskmanager.HDDList():
 			hdd[1].setIdleTime(int(configElement.value))
@@ -496,6 +522,34 @@ def updateChoices(sel, choices):
 					break
 		sel.setChoices(map(str, choices), defval)
 
+# the services of all tv and radio bouquets, as reference strings
+def getBouquetServices():
+	from enigma import eServiceCenter, eServiceReference
+	services = []
+	serviceHandler = eServiceCenter.getInstance()
+	for root in ('1:7:1:0:0:0:0:0:0:0:FROM BOUQUET "bouquets.tv" ORDER BY bouquet', '1:7:2:0:0:0:0:0:0:0:FROM BOUQUET "bouquets.radio" ORDER BY bouquet'):
+		bouquets = serviceHandler.list(eServiceReference(root))
+		if bouquets is None:
+			continue
+		for bouquet in bouquets.getContent("R", True):
+			servicelist = serviceHandler.list(bouquet)
+			if servicelist is None:
+				continue
+			while True:
+				service = servicelist.getNext()
+				if not service.valid():
+					break
+				if not service.flags & (eServiceReference.isDirectory | eServiceReference.isMarker):
+					services.append(service.toString())
+	return services
+
+# the epg of the bouquet services is kept longest when the epg memory is limited,
+# called again whenever the bouquets were changed
+def refreshPreferredServices():
+	from enigma import eEPGCache
+	if int(config.epg.maxmemory.value):
+		eEPGCache.getInstance().setPreferredServices(getBouquetServices())
+
 def preferredPath(path):
 	if config.usage.setup_level.index < 2 or path == "<default>":
 		return None  # config.usage.default_path.value, but delay lookup until usage
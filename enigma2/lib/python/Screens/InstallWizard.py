@@ -5,6 +5,7 @@ from Components.Sources.StaticText import StaticText
 from Components.config import config, ConfigSubsection, ConfigBoolean, getConfigListEntry, ConfigSelection, ConfigYesNo, ConfigIP
 from Components.Network import iNetwork
 from Components.Ipkg import IpkgComponent
+from Components.UsageConfig import refreshPreferredServices
 from enigma import eDVBDB
 
 config.misc.installwizard = ConfigSubsection()
@@ -148,4 +149,5 @@ class InstallWizardIpkgUpdater(Screen):
 					config.misc.installwizard.channellistdownloaded.value = True
 					eDVBDB.getInstance().reloadBouquets()
 					eDVBDB.getInstance().reloadServicelist()
+					refreshPreferredServices()
 			self.close()
@@ -354,11 +354,13 @@ class MovieContextMenu(Screen):
 					(_("Reset playback position"), csel.do_reset),
 					(_("Rename"), csel.do_rename),
 					(_("Start offline decode"), csel.do_decode),
+					(_("Create seek index"), csel.do_createindex),
 					]
 				# Plugins expect a valid selection, so only include them if we selected a non-dir 
 				menu.extend([(p.description, boundFunction(p, session, service)) for p in plugins.getPlugins(PluginDescriptor.WHERE_MOVIELIST)])
 
 		menu.append((_("Add bookmark"), csel.do_addbookmark))
+		menu.append((_("Create seek index for this directory"), csel.do_createindexdir))
 		menu.append((_("create directory"), csel.do_createdir))
 		menu.append((_("Network") + "...", csel.showNetworkSetup))
 		menu.append((_("Settings") + "...", csel.configure))
@@ -1421,6 +1423,31 @@ class MovieSelection(Screen, HelpableScreen, SelectionEventInfo, InfoBarBase):
 		recording.setAutoincreaseEnd()
 		self.session.nav.RecordTimer.record(recording, ignoreTSC = True)
 
+	def do_createindex(self):
+		current = self.getCurrent()
+		if current:
+			self.queueIndex([current.getPath()])
+
+	def do_createindexdir(self):
+		path = config.movielist.last_videodir.value
+		try:
+			files = [os.path.join(path, f) for f in sorted(os.listdir(path)) if f.endswith('.ts')]
+		except OSError, e:
+			print "[ML] cannot list", path, e
+			files = []
+		self.queueIndex(files)
+
+	def queueIndex(self, files):
+		# recordings which have an index already are skipped by the indexer
+		from enigma import eBackgroundTSIndexer
+		indexer = eBackgroundTSIndexer.getInstance()
+		count = len([f for f in files if indexer.index(f)])
+		if count:
+			msg = ngettext("%d recording will be indexed in the background.", "%d recordings will be indexed in the background.", count) % count
+		else:
+			msg = _("All recordings have a seek index already.")
+		self.session.open(MessageBox, msg, type = MessageBox.TYPE_INFO, timeout = 5)
+
 	def renameCallback(self, name):
 		if not name:
 			return
@@ -0,0 +1,28 @@
+from enigma import eEPGCache
+from struct import unpack_from, calcsize
+
+# one row of eEPGCache.lookupEventRows: service index, event id, begin, duration, title length
+ROW = "=HHIIB"
+ROW_SIZE = calcsize(ROW)
+
+def decodeEventRows(rows):
+	# returns a list of (service index, event id, begin, duration, title)
+	result = [ ]
+	offset = 0
+	end = len(rows)
+	while offset + ROW_SIZE <= end:
+		index, event_id, begin, duration, length = unpack_from(ROW, rows, offset)
+		offset += ROW_SIZE
+		result.append((index, event_id, begin, duration, rows[offset:offset + length]))
+		offset += length
+	return result
+
+def lookupEventRows(services, begin = -1, minutes = 0, count = 2):
+	# returns one list of (event id, begin, duration, title) for each service reference string,
+	# the defaults give now/next
+	result = [ [ ] for x in services ]
+	epgcache = eEPGCache.getInstance()
+	if epgcache is not None and services:
+		for index, event_id, start, duration, title in decodeEventRows(epgcache.lookupEventRows(list(services), begin, minutes, count)):
+			result[index].append((event_id, start, duration, title))
+	return result
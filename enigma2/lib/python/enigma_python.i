@@ -94,6 +94,7 @@ is usually caused by not marking PSignals as immutable.
 #include <lib/dvb/cablescan.h>
 #include <lib/components/scan.h>
 #include <lib/components/file_eraser.h>
+#include <lib/components/ts_indexer.h>
 #include <lib/components/tuxtxtapp.h>
 #include <lib/driver/avswitch.h>
 #include <lib/driver/hdmi_cec.h>
@@ -234,6 +235,7 @@ typedef long time_t;
 %include <lib/dvb/cablescan.h>
 %include <lib/components/scan.h>
 %include <lib/components/file_eraser.h>
+%include <lib/components/ts_indexer.h>
 %include <lib/components/tuxtxtapp.h>
 %include <lib/driver/avswitch.h>
 %include <lib/driver/hdmi_cec.h>
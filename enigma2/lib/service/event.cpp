@@ -27,11 +27,11 @@ DEFINE_REF(eGenreData);
 DEFINE_REF(eParentalData);
 
 /* search for the presence of language from given EIT event descriptors*/
-bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidonid)
+bool eServiceEvent::loadLanguage(const DescriptorList *descriptors, const std::string &lang, int tsidonid)
 {
 	bool retval=0;
 	std::string language = lang;
-	for (DescriptorConstIterator desc = evt->getDescriptors()->begin(); desc != evt->getDescriptors()->end(); ++desc)
+	for (DescriptorConstIterator desc = descriptors->begin(); desc != descriptors->end(); ++desc)
 	{
 		switch ((*desc)->getTag())
 		{
@@ -97,7 +97,7 @@ bool eServiceEvent::loadLanguage(Event *evt, const std::string &lang, int tsidon
 	}
 	if ( retval == 1 )
 	{
-		for (DescriptorConstIterator desc = evt->getDescriptors()->begin(); desc != evt->getDescriptors()->end(); ++desc)
+		for (DescriptorConstIterator desc = descriptors->begin(); desc != descriptors->end(); ++desc)
 		{
 			switch ((*desc)->getTag())
 			{
@@ -174,22 +174,34 @@ RESULT eServiceEvent::parseFrom(Event *evt, int tsidonid)
 	uint16_t stime_mjd = evt->getStartTimeMjd();
 	uint32_t stime_bcd = evt->getStartTimeBcd();
 	uint32_t duration = evt->getDuration();
-	m_begin = parseDVBtime(
-		stime_mjd >> 8,
-		stime_mjd&0xFF,
-		stime_bcd >> 16,
-		(stime_bcd >> 8)&0xFF,
-		stime_bcd & 0xFF
-	);
-	m_event_id = evt->getEventId();
-	m_duration = fromBCD(duration>>16)*3600+fromBCD(duration>>8)*60+fromBCD(duration);
-	if (m_language != "---" && loadLanguage(evt, m_language, tsidonid))
+	return parseFrom(
+		parseDVBtime(
+			stime_mjd >> 8,
+			stime_mjd&0xFF,
+			stime_bcd >> 16,
+			(stime_bcd >> 8)&0xFF,
+			stime_bcd & 0xFF),
+		fromBCD(duration>>16)*3600+fromBCD(duration>>8)*60+fromBCD(duration),
+		evt->getEventId(),
+		evt->getDescriptors(),
+		tsidonid);
+}
+
+/* descriptors may be 0 when just the event header infos are needed */
+RESULT eServiceEvent::parseFrom(time_t begin, int duration, int event_id, const DescriptorList *descriptors, int tsidonid)
+{
+	m_begin = begin;
+	m_event_id = event_id;
+	m_duration = duration;
+	if (!descriptors)
+		return 0;
+	if (m_language != "---" && loadLanguage(descriptors, m_language, tsidonid))
 		return 0;
-	if (m_language_alternative != "---" && loadLanguage(evt, m_language_alternative, tsidonid))
+	if (m_language_alternative != "---" && loadLanguage(descriptors, m_language_alternative, tsidonid))
 		return 0;
-	if (loadLanguage(evt, "eng", tsidonid))
+	if (loadLanguage(descriptors, "eng", tsidonid))
 		return 0;
-	if (loadLanguage(evt, "---", tsidonid))
+	if (loadLanguage(descriptors, "---", tsidonid))
 		return 0;
 	return 0;
 }
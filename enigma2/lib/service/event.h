@@ -6,6 +6,7 @@
 #include <list>
 #include <string>
 class Event;
+class Descriptor;
 #endif
 
 #include <lib/base/object.h>
@@ -73,7 +74,7 @@ SWIG_IGNORE(eServiceEvent);
 class eServiceEvent: public iObject
 {
 	DECLARE_REF(eServiceEvent);
-	bool loadLanguage(Event *event, const std::string &lang, int tsidonid);
+	bool loadLanguage(const std::list<Descriptor*> *descriptors, const std::string &lang, int tsidonid);
 	std::list<eComponentData> m_component_data;
 	std::list<eServiceReference> m_linkage_services;
 	std::list<eGenreData> m_genres;
@@ -87,6 +88,7 @@ class eServiceEvent: public iObject
 public:
 #ifndef SWIG
 	RESULT parseFrom(Event *evt, int tsidonid=0);
+	RESULT parseFrom(time_t begin, int duration, int event_id, const std::list<Descriptor*> *descriptors, int tsidonid=0);
 	RESULT parseFrom(const std::string& filename, int tsidonid=0);
 	static void setEPGLanguage(const std::string& language) { m_language = language; }
 	static void setEPGLanguageAlternative(const std::string& language) { m_language_alternative = language; }
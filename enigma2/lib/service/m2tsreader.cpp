@@ -0,0 +1,119 @@
+#include <lib/service/m2tsreader.h>
+#include <lib/base/eerror.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+eM2TSReader::eM2TSReader(int fd, off_t current_offset):
+	m_fd(fd),
+	m_sync_offset(0),
+	m_current_offset(current_offset),
+	m_chunk((unsigned char*)malloc(chunkPackets * 192))
+{
+}
+
+eM2TSReader::~eM2TSReader()
+{
+	free(m_chunk);
+}
+
+/* looks for two sync bytes 192 bytes apart in the packets at pos (data, if it has
+   enough of them), add_offs is the distance to the start of the packet then */
+bool eM2TSReader::resync(off_t pos, const unsigned char *data, size_t len, int &add_offs)
+{
+	unsigned char tmp[192*3];
+	if (len < sizeof(tmp))
+	{
+		ssize_t ret = ::pread(m_fd, tmp, sizeof(tmp), pos);
+		if (ret < 0)
+			return false;
+		len = ret;
+		data = tmp;
+	}
+	eDebug("m2ts out of sync at pos %lld", (long long)pos);
+	for (int x = 0; x < 192 && (size_t)x + 192 < len; ++x)
+	{
+		if (data[x] == 0x47 && data[x+192] == 0x47)
+		{
+			add_offs = x - 4;
+			return true;
+		}
+	}
+	return false;
+}
+
+ssize_t eM2TSReader::read(off_t offset, void *b, size_t count)
+{
+	unsigned char *buf = (unsigned char*)b;
+
+	if (!m_chunk)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+
+	size_t rd=0;
+	offset = (offset % 188) + (offset * 192) / 188;
+	off_t pos = offset + m_sync_offset;
+	m_current_offset = (pos % 192) + (pos * 188) / 192;
+
+	while (rd < count)
+	{
+		/* as many whole packets as fit, in one read */
+		size_t packets = (count - rd) / 188;
+		if (!packets)
+			break;
+		if (packets > chunkPackets)
+			packets = chunkPackets;
+		ssize_t ret = ::pread(m_fd, m_chunk, packets * 192, pos);
+		if (ret < 0)
+			return rd ? rd : ret;
+		size_t full = ret / 192;
+		if (!full)
+			break;
+
+		/* the packets up to the first one out of sync, without the 4 byte timecodes */
+		size_t good = 0;
+		while (good < full && m_chunk[good * 192 + 4] == 0x47)
+			++good;
+		const unsigned char *src = m_chunk + 4;
+		unsigned char *dst = buf + rd;
+		for (size_t i = 0; i < good; ++i, src += 192, dst += 188)
+			memcpy(dst, src, 188);
+		rd += good * 188;
+		pos += good * 192;
+		m_current_offset += good * 188;
+		if (good == full)
+		{
+			if (full < packets)
+				break;  /* end of file */
+			continue;
+		}
+
+		if (rd > 0)
+		{
+			eDebug("short read at pos %lld async!!", m_current_offset);
+			break;
+		}
+		int add_offs;
+		if (resync(pos, m_chunk + good * 192, ret - good * 192, add_offs))
+		{
+			eDebug("sync found, sync_offset is now %d, old was %d", add_offs + m_sync_offset, m_sync_offset);
+			m_sync_offset += add_offs;
+			pos = offset + m_sync_offset;
+			m_current_offset = (pos % 192) + (pos * 188) / 192;
+			continue;
+		}
+		/* no sync nearby, pass the packet on as it is */
+		memcpy(buf + rd, m_chunk + good * 192 + 4, 188);
+		rd += 188;
+		pos += 192;
+		m_current_offset += 188;
+	}
+
+	m_sync_offset %= 188;
+
+	return rd;
+}
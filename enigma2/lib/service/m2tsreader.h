@@ -0,0 +1,26 @@
+#ifndef __lib_service_m2tsreader_h
+#define __lib_service_m2tsreader_h
+
+#include <sys/types.h>
+
+/* reads 188 byte packets from a file of 192 byte m2ts packets (4 byte timecode
+   first), up to chunkPackets of them per pread(). Not thread safe. */
+class eM2TSReader
+{
+public:
+	eM2TSReader(int fd, off_t current_offset = 0);
+	~eM2TSReader();
+
+	/* offset and count in 188 byte packets, like iTsSource::read */
+	ssize_t read(off_t offset, void *buf, size_t count);
+	off_t offset() { return m_current_offset; }
+private:
+	enum { chunkPackets = 512 };
+	int m_fd;
+	int m_sync_offset;
+	off_t m_current_offset;
+	unsigned char *m_chunk;  // chunkPackets packets of 192 bytes, as in the file
+	bool resync(off_t pos, const unsigned char *data, size_t len, int &add_offs);
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <lib/base/init.h>
 #include <lib/dvb/metaparser.h>
 #include <lib/service/servicem2ts.h>
+#include <lib/service/m2tsreader.h>
 
 DEFINE_REF(eServiceFactoryM2TS)
 
@@ -21,10 +22,9 @@ public:
 	off_t offset();
 	int valid();
 private:
-	int m_sync_offset;
 	int m_fd;
-	off_t m_current_offset;
 	off_t m_length;
+	eM2TSReader m_reader;
 	off_t lseek_internal(off_t offset, int whence);
 };
 
@@ -158,13 +158,10 @@ DEFINE_REF(eM2TSFile);
 
 eM2TSFile::eM2TSFile(const char *filename):
 	m_lock(),
-	m_sync_offset(0),
 	m_fd(::open(filename, O_RDONLY | O_LARGEFILE)),
-	m_current_offset(0),
-	m_length(0)
+	m_length(m_fd != -1 ? lseek_internal(0, SEEK_END) : 0),
+	m_reader(m_fd, m_length)
 {
-	if (m_fd != -1)
-		m_current_offset = m_length = lseek_internal(0, SEEK_END);
 }
 
 eM2TSFile::~eM2TSFile()
@@ -181,71 +178,10 @@ off_t eM2TSFile::lseek_internal(off_t offset, int whence)
 	return ret <= 0 ? ret : (ret % 192) + (ret*188) / 192;
 }
 
-ssize_t eM2TSFile::read(off_t offset, void *b, size_t count)
+ssize_t eM2TSFile::read(off_t offset, void *buf, size_t count)
 {
 	eSingleLocker l(m_lock);
-	unsigned char tmp[192*3];
-	unsigned char *buf = (unsigned char*)b;
-
-	size_t rd=0;
-	offset = (offset % 188) + (offset * 192) / 188;
-
-sync:
-	if ((offset+m_sync_offset) != m_current_offset)
-	{
-//		eDebug("seekTo %lld", offset+m_sync_offset);
-		m_current_offset = lseek_internal(offset+m_sync_offset, SEEK_SET);
-		if (m_current_offset < 0)
-			return m_current_offset;
-	}
-
-	while (rd < count) {
-		size_t ret;
-		ret = ::read(m_fd, tmp, 192);
-		if (ret < 0 || ret < 192)
-			return rd ? rd : ret;
-
-		if (tmp[4] != 0x47)
-		{
-			if (rd > 0) {
-				eDebug("short read at pos %lld async!!", m_current_offset);
-				return rd;
-			}
-			else {
-				int x=0;
-				ret = ::read(m_fd, tmp+192, 384);
-
-#if 0
-				eDebugNoNewLine("m2ts out of sync at pos %lld, real %lld:", offset + m_sync_offset, m_current_offset);
-				for (; x < 192; ++x)
-					eDebugNoNewLine(" %02x", tmp[x]);
-				eDebug("");
-				x=0;
-#else
-				eDebug("m2ts out of sync at pos %lld, real %lld", offset + m_sync_offset, m_current_offset);
-#endif
-				for (; x < 192; ++x)
-				{
-					if (tmp[x] == 0x47 && tmp[x+192] == 0x47)
-					{
-						int add_offs = (x - 4);
-						eDebug("sync found at pos %d, sync_offset is now %d, old was %d", x, add_offs + m_sync_offset, m_sync_offset);
-						m_sync_offset += add_offs;
-						goto sync;
-					}
-				}
-			}
-		}
-
-		memcpy(buf+rd, tmp+4, 188);
-
-		rd += 188;
-		m_current_offset += 188;
-	}
-
-	m_sync_offset %= 188;
-
-	return rd;
+	return m_reader.read(offset, buf, count);
 }
 
 int eM2TSFile::valid()
@@ -260,7 +196,7 @@ off_t eM2TSFile::length()
 
 off_t eM2TSFile::offset()
 {
-	return m_current_offset;
+	return m_reader.offset();
 }
 
 eServiceFactoryM2TS::eServiceFactoryM2TS()
@@ -0,0 +1,137 @@
+/*
+ * Micro benchmark of the per service tables of the epg cache, the node based
+ * std::map against the sorted vector eEPGFlatMap (lib/dvb/epgmap.h).
+ * Not part of the build, compile it on the host:
+ *
+ *   g++ -O2 -I. tools/epgmap_benchmark.cpp -o epgmap_benchmark
+ *
+ * The numbers give a rough idea only, run it on the box for real ones.
+ */
+#include <lib/dvb/epgmap.h>
+
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define SERVICES 2000
+#define EVENTS 300
+#define LOOKUPS 2000000
+
+struct event
+{
+	time_t begin;
+	int duration;
+};
+
+static long long now_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+template <class Map>
+static long long build(std::vector<Map> &maps, std::vector<event> &events)
+{
+	long long start = now_us();
+	for (int s = 0; s < SERVICES; ++s)
+	{
+		Map &m = maps[s];
+		typename Map::iterator hint = m.end();
+		for (int e = 0; e < EVENTS; ++e)
+		{
+			event *ev = &events[s * EVENTS + e];
+			hint = m.insert(hint, typename Map::value_type(ev->begin, ev));
+		}
+	}
+	return now_us() - start;
+}
+
+/* the current event of a random service at a random time, like lookupEventTime does */
+template <class Map>
+static long long nownext(std::vector<Map> &maps, long &found)
+{
+	srand(1);
+	long long start = now_us();
+	for (int i = 0; i < LOOKUPS; ++i)
+	{
+		Map &m = maps[rand() % SERVICES];
+		time_t t = 1000000 + rand() % (EVENTS * 1800);
+		typename Map::iterator it = m.upper_bound(t);
+		if (it != m.begin())
+		{
+			--it;
+			if (t < it->first + it->second->duration)
+				++found;
+		}
+	}
+	return now_us() - start;
+}
+
+/* six hours of every service, like the multi epg */
+template <class Map>
+static long long range(std::vector<Map> &maps, long &found)
+{
+	long long start = now_us();
+	for (int round = 0; round < 20; ++round)
+	{
+		time_t begin = 1000000 + round * 3600;
+		for (int s = 0; s < SERVICES; ++s)
+		{
+			Map &m = maps[s];
+			typename Map::iterator end = m.lower_bound(begin + 6 * 3600);
+			for (typename Map::iterator it = m.lower_bound(begin); it != end; ++it)
+				found += it->second->duration;
+		}
+	}
+	return now_us() - start;
+}
+
+int main()
+{
+	std::vector<event> events(SERVICES * EVENTS);
+	for (int s = 0; s < SERVICES; ++s)
+	{
+		time_t t = 1000000;
+		for (int e = 0; e < EVENTS; ++e)
+		{
+			int duration = 900 + (rand() % 6) * 450;
+			events[s * EVENTS + e].begin = t;
+			events[s * EVENTS + e].duration = duration;
+			t += duration;
+		}
+	}
+
+	std::vector<std::map<time_t, event*> > trees(SERVICES);
+	std::vector<eEPGFlatMap<time_t, event*> > flat(SERVICES);
+	long found_tree = 0, found_flat = 0;
+
+	long long build_tree = build(trees, events);
+	long long build_flat = build(flat, events);
+	long long lookup_tree = nownext(trees, found_tree);
+	long long lookup_flat = nownext(flat, found_flat);
+	long long range_tree = range(trees, found_tree);
+	long long range_flat = range(flat, found_flat);
+
+	/* a red black tree node has three pointers and the color besides the value */
+	size_t mem_tree = (size_t)SERVICES * EVENTS * (sizeof(std::pair<time_t, event*>) + 3 * sizeof(void*) + sizeof(int));
+	size_t mem_flat = 0;
+	for (int s = 0; s < SERVICES; ++s)
+		mem_flat += flat[s].capacity() * sizeof(std::pair<time_t, event*>);
+
+	printf("%d services with %d events\n", SERVICES, EVENTS);
+	printf("               std::map   eEPGFlatMap\n");
+	printf("build      %8lld us   %8lld us\n", build_tree, build_flat);
+	printf("now/next   %8lld us   %8lld us   (%d lookups)\n", lookup_tree, lookup_flat, LOOKUPS);
+	printf("range      %8lld us   %8lld us\n", range_tree, range_flat);
+	printf("memory     %8u kB   %8u kB   (without malloc overhead)\n", (unsigned int)(mem_tree / 1024), (unsigned int)(mem_flat / 1024));
+	if (found_tree != found_flat)
+	{
+		printf("results differ!\n");
+		return 1;
+	}
+	return 0;
+}
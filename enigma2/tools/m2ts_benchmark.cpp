@@ -0,0 +1,185 @@
+/*
+ * Throughput of the m2ts read of the player, the former read of single 192
+ * byte packets (a copy of the old code) against eM2TSReader
+ * (lib/service/m2tsreader.cpp), which reads whole chunks. The reader is
+ * built from the player source, without the logging. Not part of the build,
+ * compile it on the host in the top directory:
+ *
+ *   g++ -O2 -I. tools/m2ts_benchmark.cpp -o m2ts_benchmark
+ *   ./m2ts_benchmark file.m2ts [size_mb]
+ *
+ * A synthetic file of size_mb (default 110) is written when file does not
+ * exist, with three bytes of garbage at the start, so the readers resync once.
+ * The output of both readers is compared before the timing.
+ * The numbers give a rough idea only, run it on the box for real ones.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+/* the reader of the player, eerror.h needs the rest of enigma */
+#define __E_ERROR__
+#define eDebug(...) do { } while (0)
+#include <lib/service/m2tsreader.cpp>
+
+#define READ_SIZE (188 * 512)
+
+/* the reader before the chunks, one read() per packet */
+struct packetReader
+{
+	int m_fd;
+	int m_sync_offset;
+	off_t m_current_offset;
+
+	packetReader(int fd): m_fd(fd), m_sync_offset(0), m_current_offset(-1) {}
+
+	off_t lseek_internal(off_t offset, int whence)
+	{
+		off_t ret = ::lseek(m_fd, offset, whence);
+		return ret <= 0 ? ret : (ret % 192) + (ret*188) / 192;
+	}
+
+	ssize_t read(off_t offset, void *b, size_t count)
+	{
+		unsigned char tmp[192*3];
+		unsigned char *buf = (unsigned char*)b;
+		size_t rd=0;
+		offset = (offset % 188) + (offset * 192) / 188;
+sync:
+		if ((offset+m_sync_offset) != m_current_offset)
+		{
+			m_current_offset = lseek_internal(offset+m_sync_offset, SEEK_SET);
+			if (m_current_offset < 0)
+				return m_current_offset;
+		}
+		while (rd < count)
+		{
+			ssize_t ret = ::read(m_fd, tmp, 192);
+			if (ret < 192)
+				return rd ? (ssize_t)rd : ret;
+			if (tmp[4] != 0x47)
+			{
+				if (rd > 0)
+					return rd;
+				ret = ::read(m_fd, tmp+192, 384);
+				for (int x = 0; x < 192; ++x)
+				{
+					if (tmp[x] == 0x47 && tmp[x+192] == 0x47)
+					{
+						m_sync_offset += x-4;
+						goto sync;
+					}
+				}
+			}
+			memcpy(buf+rd, tmp+4, 188);
+			rd += 188;
+			m_current_offset += 188;
+		}
+		m_sync_offset %= 188;
+		return rd;
+	}
+};
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int writeSample(const char *filename, int size_mb)
+{
+	FILE *f = fopen(filename, "wb");
+	if (!f)
+		return -1;
+	fwrite("\x00\x11\x22", 3, 1, f);
+	unsigned char packet[192];
+	memset(packet, 0, sizeof(packet));
+	int count = (int)(((long long)size_mb << 20) / 192);
+	for (int i = 0; i < count; ++i)
+	{
+		packet[0] = i >> 24;
+		packet[1] = i >> 16;
+		packet[2] = i >> 8;
+		packet[3] = i;
+		packet[4] = 0x47;
+		packet[5] = i & 0x1F;
+		for (int j = 6; j < 192; ++j)
+			packet[j] = i + j;
+		fwrite(packet, sizeof(packet), 1, f);
+	}
+	return fclose(f);
+}
+
+template <class Reader>
+static double readAll(Reader &reader, unsigned char *buffer, long long &total)
+{
+	double start = now();
+	off_t offset = 0;
+	while (1)
+	{
+		ssize_t r = reader.read(offset, buffer, READ_SIZE);
+		if (r <= 0)
+			break;
+		offset += r;
+	}
+	total = offset;
+	return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s file.m2ts [size_mb]\n", argv[0]);
+		return 1;
+	}
+	const char *filename = argv[1];
+	if (access(filename, F_OK) && writeSample(filename, argc > 2 ? atoi(argv[2]) : 110) < 0)
+	{
+		perror(filename);
+		return 1;
+	}
+	int fd_packet = open(filename, O_RDONLY), fd_chunk = open(filename, O_RDONLY);
+	if (fd_packet < 0 || fd_chunk < 0)
+	{
+		perror(filename);
+		return 1;
+	}
+	packetReader packets(fd_packet);
+	eM2TSReader chunks(fd_chunk);
+	unsigned char *a = (unsigned char*)malloc(READ_SIZE), *b = (unsigned char*)malloc(READ_SIZE);
+
+	off_t offset = 0;
+	long long total = 0;
+	while (1)
+	{
+		ssize_t x = packets.read(offset, a, READ_SIZE), y = chunks.read(offset, b, READ_SIZE);
+		if (x != y || (x > 0 && memcmp(a, b, x)))
+		{
+			printf("results differ at %lld: %d %d bytes\n", (long long)offset, (int)x, (int)y);
+			return 1;
+		}
+		if (x <= 0)
+			break;
+		offset += x;
+	}
+	printf("same output, %lld MB\n", (long long)(offset >> 20));
+
+	for (int round = 0; round < 3; ++round)
+	{
+		double t_packet = readAll(packets, a, total);
+		double t_chunk = readAll(chunks, b, total);
+		printf("packets %7.1f MB/s   chunks %7.1f MB/s\n", total / t_packet / 1e6, total / t_chunk / 1e6);
+	}
+	free(a);
+	free(b);
+	close(fd_packet);
+	close(fd_chunk);
+	return 0;
+}
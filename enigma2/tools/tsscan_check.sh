@@ -0,0 +1,151 @@
+#!/bin/sh
+#
+# Checks that the AVX2, SSE2 and scalar packet and start code scan of
+# eMPEGStreamParserTS (lib/dvb/pvrparse.cpp) write the same .ap/.sc files
+# and log the same as the parser before the vector scan, on a synthetic
+# corpus (tools/tsscan_corpus.cpp) with MPEG2, H.264, m2ts, scrambled
+# packets, garbage between the packets and a PTS wrap, read in recorder
+# sized and in random chunks.
+# Runs on an x86 host with g++ in the git tree, the AVX2 build is only used
+# when the cpu has it.
+#
+#   tools/tsscan_check.sh [workdir]            equivalence check
+#   tools/tsscan_check.sh bench [workdir]      parseData throughput of all builds
+#
+# The reference is pvrparse.cpp of the commit $TSSCAN_BASE (default 949ee5d^,
+# before the vector scan), with the fix of the skipped packet that continues
+# in the next buffer applied, the current parser has it as well.
+#
+
+BENCH=0
+if [ "$1" = "bench" ]; then
+	BENCH=1
+	shift
+fi
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+WORK=${1:-/tmp/tsscan}
+BASE=${TSSCAN_BASE:-949ee5d^}
+mkdir -p "$WORK" || exit 1
+cd "$WORK" || exit 1
+
+# the parser needs little of the rest of enigma
+mkdir -p stub/lib/base stub/lib/dvb stub/lib/gdi
+cat > stub/lib/base/eerror.h <<EOF
+#pragma once
+extern int g_verbose;
+#define eDebug(...) do { if (g_verbose) { fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } } while (0)
+#define eWarning eDebug
+EOF
+cat > stub/lib/dvb/idvb.h <<EOF
+#pragma once
+#include <sys/types.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+typedef long long pts_t;
+struct iDVBTSRecorder { enum timing_pid_type { none = -1, video_pid, audio_pid }; };
+static inline timespec operator-(const timespec &a, const timespec &b)
+{ timespec r; r.tv_sec = a.tv_sec - b.tv_sec; r.tv_nsec = a.tv_nsec - b.tv_nsec; if (r.tv_nsec < 0) { --r.tv_sec; r.tv_nsec += 1000000000; } return r; }
+EOF
+echo "#pragma once" > stub/lib/dvb/idemux.h
+cat > stub/lib/gdi/xineLib.h <<EOF
+#pragma once
+struct cXineLib { static cXineLib *getInstance() { static cXineLib x; return &x; } void playVideo() {} };
+EOF
+
+# the reference, and three builds of the current parser: avx2 as is, sse2 with
+# the cpu detection switched off, scalar without the SSE2 code as well
+mkdir -p ref/lib/dvb
+(cd "$TOP" && git show "$BASE:./lib/dvb/pvrparse.h") > ref/lib/dvb/pvrparse.h || exit 1
+(cd "$TOP" && git show "$BASE:./lib/dvb/pvrparse.cpp") |
+	sed '/packet += 184 + m_header_offset;/{N;N;s/.*\n.*\n\(\t*\)m_pktptr = 0;/\1m_pktptr -= m_packetsize;/}' > ref/lib/dvb/pvrparse.cpp || exit 1
+if ! grep -q "m_pktptr -= m_packetsize;" ref/lib/dvb/pvrparse.cpp; then
+	echo "skip fix not applied to the reference"
+	exit 1
+fi
+BUILDS="ref scalar sse2 avx2"
+for b in scalar sse2 avx2; do
+	mkdir -p $b/lib/dvb
+	cp "$TOP/lib/dvb/pvrparse.h" $b/lib/dvb/
+	cp "$TOP/lib/dvb/pvrparse.cpp" $b/lib/dvb/
+done
+sed -i 's/haveAVX2 = detectAVX2()/haveAVX2 = false/' sse2/lib/dvb/pvrparse.cpp scalar/lib/dvb/pvrparse.cpp
+for b in $BUILDS; do
+	FLAGS=""
+	[ $b = scalar ] && FLAGS="-U__SSE2__"
+	for offline in 0 1; do
+		D=""
+		[ $offline = 1 ] && D="-DOFFLINE"
+		g++ -O2 $FLAGS $D -I $b -I stub -o index_${b}_$offline "$TOP/tools/tsscan_index.cpp" $b/lib/dvb/pvrparse.cpp -lrt || exit 1
+	done
+done
+g++ -O2 -o tsscan_corpus "$TOP/tools/tsscan_corpus.cpp" || exit 1
+
+if [ $BENCH = 1 ]; then
+	[ -e b_h264.ts ] || ./tsscan_corpus b_h264.ts 300 1 188 21
+	[ -e b_mpeg2.ts ] || ./tsscan_corpus b_mpeg2.ts 300 0 188 22
+	for f in b_h264.ts b_mpeg2.ts; do
+		for b in $BUILDS; do
+			printf "%s %-7s MB/s:" $f $b
+			for i in 1 2 3 4 5; do
+				./index_${b}_0 $f 188 0 0x100 o_bench 1 2>/dev/null | awk '{ printf " %s", $(NF-1) }'
+			done
+			echo
+		done
+	done
+	rm -f o_bench.ap o_bench.sc
+	exit 0
+fi
+
+[ -e c_h264.ts ] || ./tsscan_corpus c_h264.ts 60 1 188 11
+[ -e c_mpeg2.ts ] || ./tsscan_corpus c_mpeg2.ts 60 0 188 12
+[ -e c_h264_192.ts ] || ./tsscan_corpus c_h264_192.ts 30 1 192 13
+[ -e c_mpeg2_192.ts ] || ./tsscan_corpus c_mpeg2_192.ts 30 0 192 14
+[ -e c_garb_h264.ts ] || ./tsscan_corpus c_garb_h264.ts 30 1 188 15 0 1
+[ -e c_garb_mpeg2.ts ] || ./tsscan_corpus c_garb_mpeg2.ts 30 0 188 16 0 1
+[ -e c_scr.ts ] || ./tsscan_corpus c_scr.ts 30 1 188 17 1 0
+[ -e c_scr_mpeg2_192.ts ] || ./tsscan_corpus c_scr_mpeg2_192.ts 20 0 192 18 1 1
+[ -e c_wrap.ts ] || ./tsscan_corpus c_wrap.ts 20 0 188 19 0 0 0x1FFFF0000
+# not starting at a packet boundary
+[ -e c_mis.ts ] || (head -c 1000 /dev/urandom; cat c_garb_mpeg2.ts) > c_mis.ts
+
+fail=0
+runs=0
+for f in c_*.ts; do
+	ps=188
+	case $f in *192*) ps=192;; esac
+	for offline in 0 1; do
+		for mode in 0 1; do
+			for pid in 0x100 0x101 -1; do
+				for seed in 1 2; do
+					[ $mode = 0 ] && [ $seed = 2 ] && continue
+					rm -f o_*
+					for b in $BUILDS; do
+						./index_${b}_$offline $f $ps $mode $pid o_$b $seed 2>&1 >/dev/null | grep -v "Waiting for I/O" > o_$b.log
+					done
+					for b in $BUILDS; do
+						[ $b = ref ] && continue
+						for ext in .ap .sc .log; do
+							# missing on both sides is fine
+							if ! cmp -s o_ref$ext o_$b$ext && { [ -e o_ref$ext ] || [ -e o_$b$ext ]; }; then
+								echo "DIFF $f offline=$offline mode=$mode pid=$pid seed=$seed $b$ext"
+								fail=1
+							fi
+						done
+					done
+					runs=$((runs + 1))
+				done
+			done
+		done
+	done
+done
+rm -f o_*
+echo "$runs runs, builds: $BUILDS"
+if [ $fail = 1 ]; then
+	echo "FAILED"
+	exit 1
+fi
+echo "all equal"
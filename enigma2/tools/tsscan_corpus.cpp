@@ -0,0 +1,208 @@
+/*
+ * Writes a synthetic transport stream for the checks of the packet and start
+ * code scan of eMPEGStreamParserTS (lib/dvb/pvrparse.cpp), see tsscan_check.sh.
+ * Not part of the build, compile it on the host:
+ *
+ *   g++ -O2 tools/tsscan_corpus.cpp -o tsscan_corpus
+ *   ./tsscan_corpus file size_mb codec packetsize seed [scrambled] [garbage] [first_pts]
+ *
+ *   codec       0 = MPEG2, 1 = H.264
+ *   packetsize  188 or 192 (m2ts, a random timestamp before each packet)
+ *   scrambled   1 = some video packets have the scrambling bits set
+ *   garbage     1 = now and then a few random bytes between the packets
+ *   first_pts   e.g. 0x1FFFF0000 for a PTS wrap after a few seconds
+ *
+ * The video (pid 0x100) has an I frame every 12 frames, the frames are
+ * split at random points and have start code lookalikes in the payload.
+ * Audio (0x101), stuffing (0x1FFF) and a section pid (0x64) are mixed in.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned int rnd_state;
+static FILE *out;
+static int packetsize, scrambled, garbage;
+static int cc[8192];
+
+static unsigned int rnd()
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 8) & 0xFFFFFF;
+}
+
+static void put(const unsigned char *packet)
+{
+	if (packetsize == 192)
+	{
+		unsigned int t = rnd();
+		unsigned char hdr[4] = { (unsigned char)(t >> 24), (unsigned char)(t >> 16), (unsigned char)(t >> 8), (unsigned char)t };
+		fwrite(hdr, 4, 1, out);
+	}
+	fwrite(packet, 188, 1, out);
+	if (garbage && rnd() % 20000 == 0)
+	{
+		int n = 1 + rnd() % 300;
+		for (int i = 0; i < n; ++i)
+			fputc(rnd() & 0xFF, out);
+	}
+}
+
+/* one packet with up to 184 bytes of payload, the rest is adaptation field stuffing */
+static void packet(int pid, bool pusi, const unsigned char *payload, int len, bool forceaf = false)
+{
+	unsigned char p[188];
+	p[0] = 0x47;
+	p[1] = (pusi ? 0x40 : 0) | (pid >> 8);
+	p[2] = pid & 0xFF;
+	bool af = forceaf || len < 184 || rnd() % 30 == 0;
+	int aflen = 0;
+	if (af)
+	{
+		aflen = 184 - 1 - (len < 183 ? len : 183);
+		if (aflen < 0)
+			aflen = 0;
+		if (forceaf && aflen == 0 && len >= 183)
+		{
+			len = 183 - 1;
+			aflen = 1;
+		}
+	}
+	int sc = (scrambled && rnd() % 50 == 0) ? 0x80 : 0;
+	p[3] = sc | (af ? 0x30 : 0x10) | (cc[pid]++ & 15);
+	int pos = 4, room = 184;
+	if (af)
+	{
+		p[4] = aflen;
+		if (aflen)
+		{
+			p[5] = 0;
+			memset(p + 6, 0xFF, aflen - 1);
+		}
+		pos = 5 + aflen;
+		room = 188 - pos;
+	}
+	if (len > room)
+		len = room;
+	memcpy(p + pos, payload, len);
+	memset(p + pos + len, 0xFF, 188 - pos - len);
+	put(p);
+}
+
+/* the PES header and the picture start of one video frame */
+static int frameHeader(unsigned char *b, unsigned long long pts, int codec, bool iframe, int frame)
+{
+	int n = 0;
+	b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = 0xE0; b[n++] = 0; b[n++] = 0;
+	b[n++] = 0x80; b[n++] = 0x80; b[n++] = 5;
+	pts &= 0x1FFFFFFFFULL;
+	b[n++] = 0x21 | ((pts >> 29) & 0xE);
+	b[n++] = pts >> 22;
+	b[n++] = ((pts >> 14) & 0xFE) | 1;
+	b[n++] = pts >> 7;
+	b[n++] = ((pts << 1) & 0xFE) | 1;
+	if (codec == 1)
+	{
+		/* access unit delimiter and an IDR or non IDR slice */
+		b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = 0x09; b[n++] = iframe ? 0x10 : (frame % 3 ? 0x30 : 0x50);
+		b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = iframe ? 0x65 : 0x41;
+	}
+	else
+	{
+		/* sequence header and gop before the I frames, then the picture header */
+		if (iframe)
+		{
+			b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = 0xB3;
+			for (int i = 0; i < 8; ++i)
+				b[n++] = rnd();
+			b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = 0xB8;
+			for (int i = 0; i < 4; ++i)
+				b[n++] = rnd();
+		}
+		b[n++] = 0; b[n++] = 0; b[n++] = 1; b[n++] = 0x00; b[n++] = rnd(); b[n++] = (iframe ? 1 : 2) << 3;
+	}
+	return n;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 6)
+	{
+		fprintf(stderr, "usage: %s file size_mb codec packetsize seed [scrambled] [garbage] [first_pts]\n", argv[0]);
+		return 1;
+	}
+	out = fopen(argv[1], "wb");
+	if (!out)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	long long size = atoll(argv[2]) << 20;
+	int codec = atoi(argv[3]);
+	packetsize = atoi(argv[4]);
+	rnd_state = atoi(argv[5]);
+	scrambled = argc > 6 && atoi(argv[6]);
+	garbage = argc > 7 && atoi(argv[7]);
+	unsigned long long pts = argc > 8 ? strtoull(argv[8], 0, 0) : 900000;
+
+	static unsigned char buf[184 * 400];
+	for (int frame = 0; ftell(out) < size; ++frame, pts += 3600)
+	{
+		bool iframe = frame % 12 == 0;
+		int n = frameHeader(buf, pts, codec, iframe, frame);
+		int length = (iframe ? 150 : 20) * 184 + rnd() % (60 * 184);
+		while (n < length)
+		{
+			unsigned int v = rnd();
+			buf[n++] = v;
+			buf[n++] = v >> 8;
+			if (v % 97 == 0)
+			{
+				buf[n++] = 0; buf[n++] = 0; buf[n++] = 1; buf[n++] = v >> 16;
+			}
+			if (codec == 0 && v % 211 == 0) /* slices */
+			{
+				buf[n++] = 0; buf[n++] = 0; buf[n++] = 1; buf[n++] = 1 + (v >> 16) % 0xAF;
+			}
+		}
+		for (int offset = 0; offset < n; )
+		{
+			int chunk = n - offset, room = 184;
+			bool af = rnd() % 30 == 0 || chunk < 184;
+			if (af)
+				room = chunk < 183 ? chunk : 183 - (rnd() % 8);
+			if (chunk > room)
+				chunk = room;
+			packet(0x100, offset == 0, buf + offset, chunk, af && chunk == room && room < 184);
+			offset += chunk;
+
+			unsigned char other[184];
+			unsigned int r = rnd() % 100;
+			if (r < 10)
+			{
+				for (int i = 0; i < 184; ++i)
+					other[i] = rnd();
+				if (r < 2)
+				{
+					other[0] = 0; other[1] = 0; other[2] = 1; other[3] = 0xC0;
+				}
+				packet(0x101, r < 2, other, 184);
+			}
+			else if (r < 13)
+			{
+				for (int i = 0; i < 184; ++i)
+					other[i] = rnd();
+				packet(0x1FFF, false, other, 184);
+			}
+			else if (r < 14)
+			{
+				memset(other, 0xFF, 184);
+				other[0] = 0;
+				other[1] = 0x02;
+				packet(0x64, true, other, 184);
+			}
+		}
+	}
+	fclose(out);
+	return 0;
+}
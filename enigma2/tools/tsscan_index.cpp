@@ -0,0 +1,85 @@
+/*
+ * Runs a file through eMPEGStreamParserTS (lib/dvb/pvrparse.cpp) like the
+ * recorder does and writes the .ap and .sc files, for the equivalence check
+ * and the benchmark of the packet and start code scan. Built by
+ * tsscan_check.sh together with pvrparse.cpp and a few stub headers.
+ *
+ *   tsscan_index file packetsize readmode pid outbase seed
+ *
+ *   readmode  0 = reads of 188 * 2048 bytes like the recorder,
+ *             1 = reads of random sizes, packets split at any byte
+ *   pid       the timing pid, -1 for none
+ *
+ * Compiled with -DOFFLINE the parser runs in offline mode like the
+ * background indexer. Prints the throughput of parseData.
+ */
+#include <lib/dvb/pvrparse.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+int g_verbose = 1;
+
+static unsigned int rnd_state;
+
+static unsigned int rnd()
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return (rnd_state >> 8) & 0xFFFFFF;
+}
+
+static double seconds(const timespec &a, const timespec &b)
+{
+	return (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 7)
+	{
+		fprintf(stderr, "usage: %s file packetsize readmode pid outbase seed\n", argv[0]);
+		return 1;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	int packetsize = atoi(argv[2]), mode = atoi(argv[3]);
+	int pid = strtol(argv[4], 0, 0);
+	rnd_state = atoi(argv[6]);
+
+	eMPEGStreamParserTS parser(packetsize);
+#ifdef OFFLINE
+	parser.setOffline(true);
+#endif
+	parser.setPid(pid, iDVBTSRecorder::video_pid, -1);
+	parser.startSave(argv[5]);
+
+	static unsigned char buffer[188 * 2048 * 2];
+	off_t offset = 0;
+	double parse = 0;
+	while (1)
+	{
+		size_t want = 188 * 2048;
+		if (mode)
+			want = rnd() % 4 ? 1 + rnd() % sizeof(buffer) : 1 + rnd() % 400;
+		ssize_t r = read(fd, buffer, want);
+		if (r <= 0)
+			break;
+		timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		parser.parseData(offset, buffer, r);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		parse += seconds(start, end);
+		offset += r;
+	}
+	parser.stopSave();
+	close(fd);
+	printf("%lld MB, parseData %.3f s, %.0f MB/s\n", (long long)(offset >> 20), parse, parse > 0 ? (offset / 1048576.0) / parse : 0);
+	return 0;
+}